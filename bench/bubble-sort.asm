@@ -0,0 +1,113 @@
+; Bubble sort: sorts 300 pseudo-random words 10 times and prints
+; a checksum of the sorted array in hex
+        .ORIG x3000
+        LD R6, REPS
+AGAIN   JSR FILL
+        LD R1, N            ; i: passes left
+        ADD R1, R1, #-1
+PASS    LD R2, ARRAY        ; pointer to a[j]
+        ADD R3, R1, #0      ; compares in this pass
+INNER   LDR R4, R2, #0
+        LDR R5, R2, #1
+        NOT R0, R4
+        ADD R0, R0, #1
+        ADD R0, R5, R0      ; a[j+1] - a[j]
+        BRzp KEEP
+        STR R5, R2, #0
+        STR R4, R2, #1
+KEEP    ADD R2, R2, #1
+        ADD R3, R3, #-1
+        BRp INNER
+        ADD R1, R1, #-1
+        BRp PASS
+        ADD R6, R6, #-1
+        BRp AGAIN
+
+        LD R1, ARRAY
+        LD R2, N
+        JSR CHECK
+        ST R0, RESULT
+        LEA R0, MSG
+        PUTS
+        LD R0, RESULT
+        JSR PRHEX
+        HALT
+
+; Fill N words from ARRAY with RAND() & x7FFF, from seed 1234
+FILL    ST R7, FSAVE
+        LD R0, SEED0
+        ST R0, SEED
+        LD R1, ARRAY
+        LD R2, N
+FLOOP   JSR RAND
+        LD R3, MASK
+        AND R0, R0, R3
+        STR R0, R1, #0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp FLOOP
+        LD R7, FSAVE
+        RET
+FSAVE   .BLKW 1
+SEED0   .FILL #1234
+MASK    .FILL x7FFF
+
+; Next pseudo-random number in R0: SEED = 5 * SEED + 1
+RAND    ST R1, RSAVE
+        LD R0, SEED
+        ADD R1, R0, R0
+        ADD R1, R1, R1
+        ADD R0, R1, R0
+        ADD R0, R0, #1
+        ST R0, SEED
+        LD R1, RSAVE
+        RET
+RSAVE   .BLKW 1
+SEED    .BLKW 1
+
+; Checksum of R2 words from R1 in R0: sum = 3 * sum + word. Uses R0-R3
+CHECK   AND R0, R0, #0
+CHLOOP  ADD R3, R0, R0
+        ADD R0, R3, R0
+        LDR R3, R1, #0
+        ADD R0, R0, R3
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp CHLOOP
+        RET
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #10
+N       .FILL #300
+ARRAY   .FILL x4000
+RESULT  .BLKW 1
+MSG     .STRINGZ "sorted: "
+        .END
@@ -0,0 +1,69 @@
+; Recursive Fibonacci: fib(20), 20 times, on a stack in R6. Prints
+; the result in hex
+        .ORIG x3000
+        LD R6, STACK
+        LD R5, REPS
+AGAIN   LD R0, ARG
+        JSR FIB
+        ADD R5, R5, #-1
+        BRp AGAIN
+        ST R0, RESULT
+        LEA R0, MSG
+        PUTS
+        LD R0, RESULT
+        JSR PRHEX
+        HALT
+
+; R0 = fib(R0). Uses R1
+FIB     ADD R1, R0, #-2
+        BRn FIBRET          ; fib(0) = 0, fib(1) = 1
+        ADD R6, R6, #-3
+        STR R7, R6, #0
+        STR R0, R6, #1
+        ADD R0, R0, #-1
+        JSR FIB
+        STR R0, R6, #2
+        LDR R0, R6, #1
+        ADD R0, R0, #-2
+        JSR FIB
+        LDR R1, R6, #2
+        ADD R0, R0, R1
+        LDR R7, R6, #0
+        ADD R6, R6, #3
+FIBRET  RET
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #20
+ARG     .FILL #20
+STACK   .FILL xF000
+RESULT  .BLKW 1
+MSG     .STRINGZ "fib: "
+        .END
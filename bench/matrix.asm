@@ -0,0 +1,185 @@
+; Matrix multiply: C = A x B for pseudo-random 10 x 10 matrices of
+; bytes, 40 times, with a shift-and-add software multiply. Prints a
+; checksum of C in hex
+        .ORIG x3000
+        LD R0, SEED0
+        ST R0, SEED
+        LD R1, APTR         ; A and B are adjacent
+        LD R2, SIZE2
+INIT    JSR RAND
+        LD R3, BYTE
+        AND R0, R0, R3
+        STR R0, R1, #0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp INIT
+
+        LD R0, REPS
+        ST R0, COUNT
+AGAIN   JSR MATMUL
+        LD R0, COUNT
+        ADD R0, R0, #-1
+        ST R0, COUNT
+        BRp AGAIN
+
+        LD R1, CPTR
+        LD R2, SIZE
+        JSR CHECK
+        ST R0, RESULT
+        LEA R0, MSG
+        PUTS
+        LD R0, RESULT
+        JSR PRHEX
+        HALT
+
+; C = A x B
+MATMUL  ST R7, MMSAVE
+        LD R0, APTR
+        ST R0, ROWA
+        LD R0, CPTR
+        ST R0, CELL
+        LD R0, DIM
+        ST R0, ICOUNT
+MI      LD R0, BPTR
+        ST R0, COLB
+        LD R0, DIM
+        ST R0, JCOUNT
+MJ      AND R0, R0, #0
+        ST R0, SUM
+        LD R0, ROWA
+        ST R0, PA
+        LD R0, COLB
+        ST R0, PB
+        LD R0, DIM
+        ST R0, KCOUNT
+MK      LDI R1, PA
+        LDI R2, PB
+        JSR MUL
+        LD R1, SUM
+        ADD R1, R1, R0
+        ST R1, SUM
+        LD R0, PA
+        ADD R0, R0, #1
+        ST R0, PA
+        LD R0, PB
+        ADD R0, R0, #10
+        ST R0, PB
+        LD R0, KCOUNT
+        ADD R0, R0, #-1
+        ST R0, KCOUNT
+        BRp MK
+        LD R0, SUM
+        STI R0, CELL
+        LD R0, CELL
+        ADD R0, R0, #1
+        ST R0, CELL
+        LD R0, COLB
+        ADD R0, R0, #1
+        ST R0, COLB
+        LD R0, JCOUNT
+        ADD R0, R0, #-1
+        ST R0, JCOUNT
+        BRp MJ
+        LD R0, ROWA
+        ADD R0, R0, #10
+        ST R0, ROWA
+        LD R0, ICOUNT
+        ADD R0, R0, #-1
+        ST R0, ICOUNT
+        BRp MI
+        LD R7, MMSAVE
+        RET
+
+; R0 = R1 x R2 (low 16 bits), one bit of R2 at a time from the top.
+; Uses R4 and R5
+MUL     AND R0, R0, #0
+        ADD R4, R2, #0
+        AND R5, R5, #0
+        ADD R5, R5, #8
+        ADD R5, R5, #8
+MLOOP   ADD R0, R0, R0
+        ADD R4, R4, #0
+        BRzp MSKIP
+        ADD R0, R0, R1
+MSKIP   ADD R4, R4, R4
+        ADD R5, R5, #-1
+        BRp MLOOP
+        RET
+
+MMSAVE  .BLKW 1
+ROWA    .BLKW 1
+COLB    .BLKW 1
+CELL    .BLKW 1
+PA      .BLKW 1
+PB      .BLKW 1
+SUM     .BLKW 1
+ICOUNT  .BLKW 1
+JCOUNT  .BLKW 1
+KCOUNT  .BLKW 1
+
+; Next pseudo-random number in R0: SEED = 5 * SEED + 1
+RAND    ST R1, RSAVE
+        LD R0, SEED
+        ADD R1, R0, R0
+        ADD R1, R1, R1
+        ADD R0, R1, R0
+        ADD R0, R0, #1
+        ST R0, SEED
+        LD R1, RSAVE
+        RET
+RSAVE   .BLKW 1
+SEED    .BLKW 1
+
+; Checksum of R2 words from R1 in R0: sum = 3 * sum + word. Uses R0-R3
+CHECK   AND R0, R0, #0
+CHLOOP  ADD R3, R0, R0
+        ADD R0, R3, R0
+        LDR R3, R1, #0
+        ADD R0, R0, R3
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp CHLOOP
+        RET
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #40
+COUNT   .BLKW 1
+DIM     .FILL #10
+SIZE    .FILL #100
+SIZE2   .FILL #200
+SEED0   .FILL #1234
+BYTE    .FILL x00FF
+APTR    .FILL x4000
+BPTR    .FILL x4064
+CPTR    .FILL x4100
+RESULT  .BLKW 1
+MSG     .STRINGZ "product: "
+        .END
@@ -0,0 +1,151 @@
+; Quicksort: sorts 2000 pseudo-random words 20 times, recursing on a
+; stack in R6, and prints a checksum of the sorted array in hex
+        .ORIG x3000
+        LD R6, STACK
+        LD R0, REPS
+        ST R0, COUNT
+AGAIN   JSR FILL
+        LD R1, ARRAY
+        LD R2, N
+        ADD R2, R1, R2
+        ADD R2, R2, #-1
+        JSR QSORT
+        LD R0, COUNT
+        ADD R0, R0, #-1
+        ST R0, COUNT
+        BRp AGAIN
+
+        LD R1, ARRAY
+        LD R2, N
+        JSR CHECK
+        ST R0, RESULT
+        LEA R0, MSG
+        PUTS
+        LD R0, RESULT
+        JSR PRHEX
+        HALT
+
+; Sort the words from address R1 to address R2 inclusive (Lomuto
+; partition, last word as pivot). Uses R0-R5 and R7
+QSORT   NOT R0, R2
+        ADD R0, R0, #1
+        ADD R0, R1, R0
+        BRzp QRET           ; fewer than two words
+        ADD R6, R6, #-4
+        STR R7, R6, #0
+        STR R1, R6, #1
+        STR R2, R6, #2
+        LDR R3, R2, #0
+        NOT R3, R3
+        ADD R3, R3, #1      ; -pivot
+        ADD R4, R1, #0      ; i
+        ADD R5, R1, #0      ; j
+PLOOP   NOT R0, R2
+        ADD R0, R0, #1
+        ADD R0, R5, R0
+        BRzp PDONE
+        LDR R0, R5, #0
+        ADD R0, R0, R3
+        BRp PSKIP           ; a[j] > pivot
+        LDR R0, R5, #0
+        LDR R7, R4, #0
+        STR R0, R4, #0
+        STR R7, R5, #0
+        ADD R4, R4, #1
+PSKIP   ADD R5, R5, #1
+        BR PLOOP
+PDONE   LDR R0, R4, #0      ; pivot into place
+        LDR R7, R2, #0
+        STR R7, R4, #0
+        STR R0, R2, #0
+        STR R4, R6, #3
+        ADD R2, R4, #-1
+        JSR QSORT
+        LDR R4, R6, #3
+        ADD R1, R4, #1
+        LDR R2, R6, #2
+        JSR QSORT
+        LDR R7, R6, #0
+        ADD R6, R6, #4
+QRET    RET
+
+; Fill N words from ARRAY with RAND() & x7FFF, from seed 1234
+FILL    ST R7, FSAVE
+        LD R0, SEED0
+        ST R0, SEED
+        LD R1, ARRAY
+        LD R2, N
+FLOOP   JSR RAND
+        LD R3, MASK
+        AND R0, R0, R3
+        STR R0, R1, #0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp FLOOP
+        LD R7, FSAVE
+        RET
+FSAVE   .BLKW 1
+SEED0   .FILL #1234
+MASK    .FILL x7FFF
+
+; Next pseudo-random number in R0: SEED = 5 * SEED + 1
+RAND    ST R1, RSAVE
+        LD R0, SEED
+        ADD R1, R0, R0
+        ADD R1, R1, R1
+        ADD R0, R1, R0
+        ADD R0, R0, #1
+        ST R0, SEED
+        LD R1, RSAVE
+        RET
+RSAVE   .BLKW 1
+SEED    .BLKW 1
+
+; Checksum of R2 words from R1 in R0: sum = 3 * sum + word. Uses R0-R3
+CHECK   AND R0, R0, #0
+CHLOOP  ADD R3, R0, R0
+        ADD R0, R3, R0
+        LDR R3, R1, #0
+        ADD R0, R0, R3
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp CHLOOP
+        RET
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #20
+COUNT   .BLKW 1
+N       .FILL #2000
+ARRAY   .FILL x4000
+STACK   .FILL xF000
+RESULT  .BLKW 1
+MSG     .STRINGZ "sorted: "
+        .END
@@ -0,0 +1,59 @@
+; Self-modifying code: each trip of the loop rewrites the immediate
+; of the ADD at PATCH with the trip number mod 16 before running it,
+; 4096 trips 200 times. Prints the sum in hex
+        .ORIG x3000
+        LD R6, REPS
+        AND R1, R1, #0      ; sum
+        LD R3, ADDOP
+AGAIN   LD R5, TRIPS
+        AND R2, R2, #0      ; trip number
+LOOP    AND R4, R2, #15
+        ADD R4, R4, R3
+        ST R4, PATCH
+PATCH   ADD R1, R1, #0      ; rewritten
+        ADD R2, R2, #1
+        ADD R5, R5, #-1
+        BRp LOOP
+        ADD R6, R6, #-1
+        BRp AGAIN
+
+        LEA R0, MSG
+        PUTS
+        ADD R0, R1, #0
+        JSR PRHEX
+        HALT
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #200
+TRIPS   .FILL #4096
+ADDOP   .FILL x1260         ; ADD R1, R1, #0
+MSG     .STRINGZ "sum: "
+        .END
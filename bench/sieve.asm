@@ -0,0 +1,80 @@
+; Sieve of Eratosthenes: counts the primes below 16000, 20 times,
+; and prints the count in hex
+        .ORIG x3000
+        LD R6, REPS
+AGAIN   LD R1, FLAGS        ; clear the flags
+        LD R2, N
+        AND R0, R0, #0
+CLEAR   STR R0, R1, #0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp CLEAR
+
+        AND R5, R5, #0      ; primes found
+        AND R2, R2, #0
+        ADD R2, R2, #2      ; i
+OUTER   LD R3, NEGN
+        ADD R3, R2, R3
+        BRzp DONE
+        LD R1, FLAGS
+        ADD R1, R1, R2
+        LDR R3, R1, #0
+        BRnp NEXT
+        ADD R5, R5, #1      ; i is prime, mark its multiples
+        ADD R4, R2, R2
+        AND R0, R0, #0
+        ADD R0, R0, #1
+MARK    LD R3, NEGN
+        ADD R3, R4, R3
+        BRzp NEXT
+        LD R1, FLAGS
+        ADD R1, R1, R4
+        STR R0, R1, #0
+        ADD R4, R4, R2
+        BR MARK
+NEXT    ADD R2, R2, #1
+        BR OUTER
+
+DONE    ADD R6, R6, #-1
+        BRp AGAIN
+        LEA R0, MSG
+        PUTS
+        ADD R0, R5, #0
+        JSR PRHEX
+        HALT
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #20
+N       .FILL #16000
+NEGN    .FILL #-16000
+FLAGS   .FILL x4000
+MSG     .STRINGZ "primes: "
+        .END
@@ -0,0 +1,103 @@
+; String search: counts the occurrences of "abcab" in 8000 pseudo-random
+; letters from a-d, 50 times, with a naive search. Prints the count
+; in hex
+        .ORIG x3000
+        LD R0, SEED0
+        ST R0, SEED
+        LD R1, TEXT
+        LD R2, LENGTH
+GEN     JSR RAND            ; letter from the top two bits
+        AND R3, R3, #0
+        ADD R0, R0, #0
+        BRzp GENLOW
+        ADD R3, R3, #2
+GENLOW  ADD R0, R0, R0
+        BRzp GENPUT
+        ADD R3, R3, #1
+GENPUT  LD R0, LETTERA
+        ADD R3, R3, R0
+        STR R3, R1, #0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp GEN
+        STR R2, R1, #0      ; terminator
+
+        LD R6, REPS
+AGAIN   AND R5, R5, #0      ; matches
+        LD R1, TEXT
+SPOS    LDR R0, R1, #0
+        BRz SDONE
+        ADD R2, R1, #0
+        LEA R3, PATTERN
+SCMP    LDR R4, R3, #0
+        BRz SFOUND
+        LDR R0, R2, #0
+        NOT R4, R4
+        ADD R4, R4, #1
+        ADD R0, R0, R4
+        BRnp SNEXT
+        ADD R2, R2, #1
+        ADD R3, R3, #1
+        BR SCMP
+SFOUND  ADD R5, R5, #1
+SNEXT   ADD R1, R1, #1
+        BR SPOS
+SDONE   ADD R6, R6, #-1
+        BRp AGAIN
+
+        LEA R0, MSG
+        PUTS
+        ADD R0, R5, #0
+        JSR PRHEX
+        HALT
+
+; Next pseudo-random number in R0: SEED = 5 * SEED + 1
+RAND    ST R1, RSAVE
+        LD R0, SEED
+        ADD R1, R0, R0
+        ADD R1, R1, R1
+        ADD R0, R1, R0
+        ADD R0, R0, #1
+        ST R0, SEED
+        LD R1, RSAVE
+        RET
+RSAVE   .BLKW 1
+SEED    .BLKW 1
+
+; Print R0 as four hex digits and a newline. Uses R0-R4
+PRHEX   ST R7, PRSAVE
+        ADD R1, R0, #0
+        AND R2, R2, #0
+        ADD R2, R2, #4
+PRDIG   AND R3, R3, #0
+        AND R4, R4, #0
+        ADD R4, R4, #4
+PRBIT   ADD R3, R3, R3
+        ADD R1, R1, #0
+        BRzp PRZERO
+        ADD R3, R3, #1
+PRZERO  ADD R1, R1, R1
+        ADD R4, R4, #-1
+        BRp PRBIT
+        LEA R0, HEXDIG
+        ADD R0, R0, R3
+        LDR R0, R0, #0
+        OUT
+        ADD R2, R2, #-1
+        BRp PRDIG
+        AND R0, R0, #0
+        ADD R0, R0, #10
+        OUT
+        LD R7, PRSAVE
+        RET
+PRSAVE  .BLKW 1
+HEXDIG  .STRINGZ "0123456789ABCDEF"
+
+REPS    .FILL #50
+LENGTH  .FILL #8000
+SEED0   .FILL #1234
+LETTERA .FILL x61
+TEXT    .FILL x4000
+PATTERN .STRINGZ "abcab"
+MSG     .STRINGZ "matches: "
+        .END
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../core/core.h"
+
+#include "idiom.h"
+#include "instruction-set.h"
+#include "fetch-execute.h"
+
+// Execute one fetched instruction using switch statement
+void execute(lc3_vm* vm, uint16_t instruction) {
+  uint16_t opcode = instruction >> 12;
+
+  switch (opcode) {
+  case OP_ADD:
+    add(vm, instruction);      
+    break;
+  case OP_AND:
+    and(vm, instruction);
+    break;
+  case OP_NOT:
+    not(vm, instruction);
+    break;
+  case OP_BR:
+    branch(vm, instruction);
+    break;
+  case OP_JMP:
+    jump(vm, instruction);
+    break;
+  case OP_JSR:
+    jumpToSubroutine(vm, instruction);
+    break;
+  case OP_LD:
+    load(vm, instruction);
+    break;
+  case OP_LDI:
+    loadIndirect(vm, instruction);
+    break;
+  case OP_LDR:
+    loadRegister(vm, instruction);
+    break;
+  case OP_LEA:
+    loadEffectiveAddress(vm, instruction);
+    break;
+  case OP_ST:
+    store(vm, instruction);
+    break;
+  case OP_STI:
+    storeIndirect(vm, instruction);
+    break;
+  case OP_STR:
+    storeRegister(vm, instruction);
+    break;
+  case OP_TRAP:
+    trap(vm, instruction);
+    break;
+  case OP_RES:
+    vm->status = VM_FAULT;
+    break;
+  case OP_RTI:
+    vm->status = VM_FAULT;
+    break;
+  default:
+    // Bad opcode
+    printf("BAD OPCODE\n");
+    break;
+  }
+}
+
+// Standard fetch/execute cycle using switch statement
+void fetchExecute(lc3_vm* vm) {
+  /* FETCH */
+  uint16_t instruction = mem_fetch(vm, vm->registers[R_PC]++);
+  execute(vm, instruction);
+}
+
+// Run the switch statement fetch/execute cycle
+uint64_t fetchExecuteLoop(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    fetchExecute(vm);
+    ++executed;
+  }
+  return executed;
+}
+
+// Alternate fetch/execute using computed GOTO
+// This method supposedly uses less branching by
+// eliminating the outer while loop
+// Each instruction should use only one JMP instruction
+// instead of two, which should make the execution faster
+// However, compiler optimizations may make the 
+// execution times of both approaches approximately the same.
+// I have not personally instrumented the code to determine
+// if the computed GOTO method offers any advantages
+// See: https://eli.thegreenplace.net/2012/07/12/computed-goto-for-efficient-dispatch-tables
+// Also: https://news.ycombinator.com/item?id=18678699
+#define DISPATCH() {\
+  if (vm->status != VM_RUNNING || executed == budget) {\
+    return executed;\
+  }\
+  ++executed;\
+  currentInstruction = mem_fetch(vm, vm->registers[R_PC]++);\
+  uint16_t opcode = currentInstruction >> 12;\
+  goto *dispatch_table[opcode];\
+}
+
+uint64_t fetchExecuteComputedGoto(lc3_vm* vm, uint64_t budget) {
+
+  // NOTE: THE ORDER OF THIS TABLE
+  // MUST MATCH THE ORDER OF THE INSTRUCTIONS
+  // IN instruction-set.h
+  // i.e. OP_BR must be at index 0 etc.
+  static void *dispatch_table[] = {
+    &&OP_BR, 
+    &&OP_ADD, 
+    &&OP_LD, 
+    &&OP_ST,
+    &&OP_JSR, 
+    &&OP_AND, 
+    &&OP_LDR, 
+    &&OP_STR,
+    &&OP_RTI, 
+    &&OP_NOT, 
+    &&OP_LDI, 
+    &&OP_STI, 
+    &&OP_JMP, 
+    &&OP_RES, 
+    &&OP_LEA, 
+    &&OP_TRAP
+  };
+
+  uint16_t currentInstruction;
+  uint64_t executed = 0;
+
+  DISPATCH();
+
+  OP_ADD:
+    add(vm, currentInstruction);
+    DISPATCH();
+  OP_AND:
+    and(vm, currentInstruction);
+    DISPATCH();
+  OP_NOT:
+    not(vm, currentInstruction);
+    DISPATCH();
+  OP_BR:
+    branch(vm, currentInstruction);
+    // A taken backward branch closes a loop, which may be an idiom
+    if ((currentInstruction & 0x100) && ((currentInstruction >> 9) & vm->registers[R_COND])) {
+      executed += idiom_run(vm, currentInstruction, budget - executed);
+    }
+    DISPATCH();
+  OP_JMP:
+    jump(vm, currentInstruction);
+    DISPATCH();
+  OP_JSR:
+    jumpToSubroutine(vm, currentInstruction);
+    DISPATCH();
+  OP_LD:
+    load(vm, currentInstruction);
+    DISPATCH();
+  OP_LDI:
+    loadIndirect(vm, currentInstruction);
+    DISPATCH();
+  OP_LDR:
+    loadRegister(vm, currentInstruction);
+    DISPATCH();
+  OP_LEA:
+    loadEffectiveAddress(vm, currentInstruction);
+    DISPATCH();
+  OP_ST:
+    store(vm, currentInstruction);
+    DISPATCH();
+  OP_STI:
+    storeIndirect(vm, currentInstruction);
+    DISPATCH();
+  OP_STR:
+    storeRegister(vm, currentInstruction);
+    DISPATCH();
+  OP_TRAP:
+    trap(vm, currentInstruction);
+    DISPATCH();
+  OP_RES:
+    vm->status = VM_FAULT;
+    DISPATCH();
+  OP_RTI:
+    vm->status = VM_FAULT;
+    DISPATCH();
+
+  return executed;
+}
@@ -0,0 +1,13 @@
+#ifndef _FETCH_EXECUTE
+#define _FETCH_EXECUTE
+
+#include <stdint.h>
+
+#include "../core/core.h"
+
+void execute(lc3_vm* vm, uint16_t instruction);
+void fetchExecute(lc3_vm* vm);
+uint64_t fetchExecuteLoop(lc3_vm* vm, uint64_t budget);
+uint64_t fetchExecuteComputedGoto(lc3_vm* vm, uint64_t budget);
+
+#endif
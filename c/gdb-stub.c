@@ -0,0 +1,631 @@
+#include "gdb-stub.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include "../core/watch.h"
+
+#include "history.h"
+
+/* Stop signals reported to the debugger */
+enum {
+  GDB_SIGINT = 2,
+  GDB_SIGILL = 4,
+  GDB_SIGTRAP = 5
+};
+
+/* What the debugger asked for once it stops sending packets */
+enum {
+  GDB_CONTINUE,
+  GDB_STEP,
+  GDB_REVERSE_CONTINUE,
+  GDB_REVERSE_STEP,
+  GDB_DETACH,
+  GDB_KILL
+};
+
+enum { GDB_REGISTER_COUNT = R_COUNT };
+
+/* Register layout given to the debugger. PC is reported as a byte
+address like everything else, so it needs more than 16 bits */
+static const char target_xml[] =
+  "<?xml version=\"1.0\"?>"
+  "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+  "<target version=\"1.0\">"
+  "<feature name=\"org.lc3.core\">"
+  "<reg name=\"r0\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r1\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r2\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r3\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r4\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r5\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r6\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"r7\" bitsize=\"16\" type=\"int16\"/>"
+  "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+  "<reg name=\"cond\" bitsize=\"16\" type=\"int16\"/>"
+  "</feature>"
+  "</target>";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Parse hex digits up to the first non-hex character
+static uint32_t parse_hex(const char** text) {
+  uint32_t value = 0;
+  int digit;
+  while ((digit = hex_value(**text)) >= 0) {
+    value = (value << 4) | digit;
+    ++*text;
+  }
+  return value;
+}
+
+// Registers go over the wire little-endian, 16 bits each but the
+// PC, which is the byte address 2*PC in 32 bits (see target_xml)
+static int register_size(int number) {
+  return number == R_PC ? 4 : 2;
+}
+
+static char* put_register(char* out, lc3_vm* vm, int number) {
+  uint32_t value = vm->registers[number];
+  if (number == R_PC) {
+    value *= 2;
+  }
+  for (int i = 0; i < register_size(number); ++i, value >>= 8) {
+    *out++ = hex_digits[(value >> 4) & 0xF];
+    *out++ = hex_digits[value & 0xF];
+  }
+  return out;
+}
+
+// Parse register number's value without storing it
+static int get_register(const char** text, int number, uint16_t* value) {
+  const char* s = *text;
+  uint32_t bytes = 0;
+  for (int i = 0; i < register_size(number); ++i, s += 2) {
+    int high = hex_value(s[0]);
+    int low = high < 0 ? -1 : hex_value(s[1]);
+    if (low < 0) {
+      return 0;
+    }
+    bytes |= (uint32_t) (high << 4 | low) << (8 * i);
+  }
+  *value = (uint16_t) (number == R_PC ? bytes >> 1 : bytes);
+  *text = s;
+  return 1;
+}
+
+/* Guest memory as bytes, word w at 2w low byte first */
+static uint8_t read_byte_at(lc3_vm* vm, uint32_t address) {
+  uint16_t word = vm->memory[(uint16_t) (address >> 1)];
+  return address & 1 ? word >> 8 : word & 0xFF;
+}
+
+static void write_byte_at(lc3_vm* vm, uint32_t address, uint8_t value) {
+  uint16_t word_address = (uint16_t) (address >> 1);
+  uint16_t word = vm->memory[word_address];
+
+  word = address & 1 ? (word & 0x00FF) | (value << 8) : (word & 0xFF00) | value;
+  vm->memory[word_address] = word;
+  vm->dirty_pages |= 1ull << (word_address >> MEMORY_PAGE_SHIFT);
+}
+
+/* SOCKET I/O */
+static int poll_readable(int fd) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  return poll(&pfd, 1, 0) > 0;
+}
+
+static int write_all(gdb_stub* stub, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = send(stub->client_fd, data, length, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 0;
+    }
+    data += written;
+    length -= written;
+  }
+  return 1;
+}
+
+// Next byte from the debugger, or -1 when it has gone away
+static int read_char(gdb_stub* stub) {
+  unsigned char c;
+  ssize_t n;
+  do {
+    n = recv(stub->client_fd, &c, 1, 0);
+  } while (n < 0 && errno == EINTR);
+  return n == 1 ? c : -1;
+}
+
+/* PACKETS */
+static int send_packet(gdb_stub* stub, const char* data) {
+  char frame[GDB_PACKET_SIZE + 4];
+  size_t length = strlen(data);
+  uint8_t checksum = 0;
+
+  frame[0] = '$';
+  for (size_t i = 0; i < length; ++i) {
+    frame[i + 1] = data[i];
+    checksum += (uint8_t) data[i];
+  }
+  frame[length + 1] = '#';
+  frame[length + 2] = hex_digits[checksum >> 4];
+  frame[length + 3] = hex_digits[checksum & 0xF];
+
+  for (;;) {
+    if (!write_all(stub, frame, length + 4)) {
+      return 0;
+    }
+    if (stub->no_ack) {
+      return 1;
+    }
+
+    int c;
+    while ((c = read_char(stub)) != '+' && c != '-') {
+      if (c < 0) {
+        return 0;
+      }
+    }
+    if (c == '+') {
+      return 1;
+    }
+  }
+}
+
+// Read one packet into stub->packet. Stray acks and interrupts
+// while stopped are dropped. Returns 0 when the debugger has gone
+static int read_packet(gdb_stub* stub) {
+  for (;;) {
+    int c;
+    do {
+      if ((c = read_char(stub)) < 0) {
+        return 0;
+      }
+    } while (c != '$');
+
+    size_t length = 0;
+    int overflow = 0;
+    uint8_t checksum = 0;
+
+    while ((c = read_char(stub)) != '#') {
+      if (c < 0) {
+        return 0;
+      }
+      if (length == sizeof(stub->packet) - 1) {
+        overflow = 1;
+      }
+      else {
+        stub->packet[length++] = (char) c;
+      }
+      checksum += (uint8_t) c;
+    }
+    stub->packet[length] = 0;
+
+    int high = read_char(stub);
+    int low = read_char(stub);
+    if (high < 0 || low < 0) {
+      return 0;
+    }
+
+    int valid = !overflow && hex_value(high) >= 0 && hex_value(low) >= 0
+             && (hex_value(high) << 4 | hex_value(low)) == checksum;
+
+    // A valid packet is handled even if the debugger has already
+    // gone, so a final k is not lost with its ack
+    if (!stub->no_ack && !write_all(stub, valid ? "+" : "-", 1) && !valid) {
+      return 0;
+    }
+    if (valid) {
+      return 1;
+    }
+  }
+}
+
+/* STOP REPLIES */
+static void send_stop(gdb_stub* stub, int signal) {
+  lc3_vm* vm = stub->vm;
+  char reply[64];
+
+  if (vm->status == VM_HALTED) {
+    strcpy(reply, "W00");
+  }
+  else if (vm->status == VM_FAULT) {
+    sprintf(reply, "X%02x", GDB_SIGILL);
+  }
+  else if (vm->status == VM_BREAK && vm->debug) {
+    const watch_hit* hit = &vm->debug->hit;
+
+    if (hit->kind == WATCH_BREAKPOINT) {
+      sprintf(reply, "T%02xswbreak:;", GDB_SIGTRAP);
+    }
+    else {
+      sprintf(reply, "T%02x%s:%x;", GDB_SIGTRAP,
+              hit->kind == WATCH_READ ? "rwatch" : "watch", 2u * hit->address);
+    }
+  }
+  else {
+    sprintf(reply, "S%02x", signal);
+  }
+  send_packet(stub, reply);
+}
+
+/* COMMANDS */
+static void read_registers(gdb_stub* stub, char* reply) {
+  for (int i = 0; i < GDB_REGISTER_COUNT; ++i) {
+    reply = put_register(reply, stub->vm, i);
+  }
+  *reply = 0;
+}
+
+static const char* write_registers(gdb_stub* stub, const char* args) {
+  uint16_t registers[GDB_REGISTER_COUNT];
+
+  for (int i = 0; i < GDB_REGISTER_COUNT; ++i) {
+    if (!get_register(&args, i, &registers[i])) {
+      return "E01";
+    }
+  }
+  memcpy(stub->vm->registers, registers, sizeof(registers));
+  history_diverge(stub->vm);
+  return "OK";
+}
+
+static void read_memory(gdb_stub* stub, const char* args, char* reply) {
+  uint32_t address = parse_hex(&args);
+  uint32_t length = *args == ',' ? (++args, parse_hex(&args)) : 0;
+
+  if (length > (GDB_PACKET_SIZE - 4) / 2) {
+    length = (GDB_PACKET_SIZE - 4) / 2;
+  }
+
+  for (uint32_t i = 0; i < length; ++i) {
+    uint8_t byte = read_byte_at(stub->vm, address + i);
+    *reply++ = hex_digits[byte >> 4];
+    *reply++ = hex_digits[byte & 0xF];
+  }
+  *reply = 0;
+}
+
+static const char* write_memory(gdb_stub* stub, const char* args) {
+  uint32_t address = parse_hex(&args);
+  if (*args++ != ',') {
+    return "E01";
+  }
+  uint32_t length = parse_hex(&args);
+  if (*args++ != ':' || strlen(args) != 2 * (size_t) length) {
+    return "E01";
+  }
+
+  for (uint32_t i = 0; i < length; ++i) {
+    int high = hex_value(args[2 * i]);
+    int low = hex_value(args[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return "E01";
+    }
+    write_byte_at(stub->vm, address + i, (uint8_t) (high << 4 | low));
+  }
+  history_diverge(stub->vm);
+  return "OK";
+}
+
+// Z/z type,address,kind
+static const char* change_point(gdb_stub* stub, const char* args, int insert) {
+  uint32_t type = parse_hex(&args);
+  if (*args++ != ',') {
+    return "E01";
+  }
+  uint32_t address = parse_hex(&args);
+  uint32_t length = *args == ',' ? (++args, parse_hex(&args)) : 1;
+
+  uint16_t first = (uint16_t) (address >> 1);
+  uint16_t last = (uint16_t) ((address + (length ? length : 1) - 1) >> 1);
+  int kind;
+
+  switch (type) {
+    case 0:
+    case 1:
+      return (insert ? break_add(stub->vm, first) : break_remove(stub->vm, first)) ? "OK" : "E01";
+    case 2: kind = WATCH_WRITE; break;
+    case 3: kind = WATCH_READ; break;
+    case 4: kind = WATCH_ACCESS; break;
+    default: return "";
+  }
+
+  if (first > last) {
+    return "E01";
+  }
+  if (insert) {
+    return watch_add(stub->vm, first, last, kind) >= 0 ? "OK" : "E01";
+  }
+  return watch_remove(stub->vm, first, last, kind) ? "OK" : "E01";
+}
+
+// qXfer:features:read:annex:offset,length
+static void read_features(const char* args, char* reply) {
+  const char* annex = "target.xml:";
+  if (strncmp(args, annex, strlen(annex))) {
+    strcpy(reply, "E00");
+    return;
+  }
+  args += strlen(annex);
+  uint32_t offset = parse_hex(&args);
+  uint32_t length = *args == ',' ? (++args, parse_hex(&args)) : 0;
+
+  size_t size = sizeof(target_xml) - 1;
+  if (offset > size) {
+    strcpy(reply, "E01");
+    return;
+  }
+  if (length > GDB_PACKET_SIZE - 2) {
+    length = GDB_PACKET_SIZE - 2;
+  }
+  if (length > size - offset) {
+    length = (uint32_t) (size - offset);
+  }
+  // The document needs no escaping: it has no $, #, } or *
+  reply[0] = offset + length < size ? 'm' : 'l';
+  memcpy(reply + 1, target_xml + offset, length);
+  reply[length + 1] = 0;
+}
+
+static void query(const char* packet, char* reply) {
+  const char* features = "qXfer:features:read:";
+
+  if (!strncmp(packet, "qSupported", 10)) {
+    sprintf(reply, "PacketSize=%x;swbreak+;QStartNoAckMode+;qXfer:features:read+%s",
+            GDB_PACKET_SIZE, history_active() ? ";ReverseStep+;ReverseContinue+" : "");
+  }
+  else if (!strncmp(packet, features, strlen(features))) {
+    read_features(packet + strlen(features), reply);
+  }
+  else if (!strcmp(packet, "qAttached")) {
+    strcpy(reply, "1");
+  }
+  else if (!strcmp(packet, "qC")) {
+    strcpy(reply, "QC1");
+  }
+  else if (!strcmp(packet, "qfThreadInfo")) {
+    strcpy(reply, "m1");
+  }
+  else if (!strcmp(packet, "qsThreadInfo")) {
+    strcpy(reply, "l");
+  }
+  else {
+    *reply = 0;
+  }
+}
+
+// Serve packets while the guest is stopped, until the debugger
+// resumes it, detaches or goes away
+static int serve(gdb_stub* stub) {
+  lc3_vm* vm = stub->vm;
+  char reply[GDB_PACKET_SIZE];
+
+  while (read_packet(stub)) {
+    const char* packet = stub->packet;
+    const char* args = packet + 1;
+    uint32_t number;
+    uint16_t value;
+
+    reply[0] = 0;
+
+    switch (packet[0]) {
+      case '?':
+        send_stop(stub, GDB_SIGTRAP);
+        continue;
+      case 'g':
+        read_registers(stub, reply);
+        break;
+      case 'G':
+        strcpy(reply, write_registers(stub, args));
+        break;
+      case 'p':
+        number = parse_hex(&args);
+        if (number < GDB_REGISTER_COUNT) {
+          *put_register(reply, vm, (int) number) = 0;
+        }
+        else {
+          strcpy(reply, "E01");
+        }
+        break;
+      case 'P':
+        number = parse_hex(&args);
+        if (number < GDB_REGISTER_COUNT && *args++ == '='
+            && get_register(&args, (int) number, &value)) {
+          vm->registers[number] = value;
+          history_diverge(vm);
+          strcpy(reply, "OK");
+        }
+        else {
+          strcpy(reply, "E01");
+        }
+        break;
+      case 'm':
+        read_memory(stub, args, reply);
+        break;
+      case 'M':
+        strcpy(reply, write_memory(stub, args));
+        break;
+      case 'c':
+      case 's':
+        if (*args) {
+          vm->registers[R_PC] = (uint16_t) (parse_hex(&args) >> 1);
+          history_diverge(vm);
+        }
+        return packet[0] == 'c' ? GDB_CONTINUE : GDB_STEP;
+      case 'b':
+        // Reverse execution, when recording
+        if (history_active() && (!strcmp(packet, "bc") || !strcmp(packet, "bs"))) {
+          return packet[1] == 'c' ? GDB_REVERSE_CONTINUE : GDB_REVERSE_STEP;
+        }
+        break;
+      case 'Z':
+      case 'z':
+        strcpy(reply, change_point(stub, args, packet[0] == 'Z'));
+        break;
+      case 'D':
+        send_packet(stub, "OK");
+        return GDB_DETACH;
+      case 'k':
+        return GDB_KILL;
+      case 'H':
+      case 'T':
+        strcpy(reply, "OK");
+        break;
+      case 'q':
+        query(packet, reply);
+        break;
+      case 'Q':
+        if (!strcmp(packet, "QStartNoAckMode")) {
+          send_packet(stub, "OK");
+          stub->no_ack = 1;
+          continue;
+        }
+        break;
+      case 'v':
+        if (!strcmp(packet, "vKill;1")) {
+          send_packet(stub, "OK");
+          return GDB_KILL;
+        }
+        break;
+    }
+    send_packet(stub, reply);
+  }
+  return GDB_DETACH;
+}
+
+static void drop_client(gdb_stub* stub) {
+  close(stub->client_fd);
+  stub->client_fd = -1;
+}
+
+// Run attached until the guest stops. Returns 0 if the debugger went away
+static int run_attached(gdb_stub* stub, int step) {
+  lc3_vm* vm = stub->vm;
+
+  // Resuming always runs the instruction at PC, even if a
+  // breakpoint was inserted there while stopped
+  vm_resume(vm);
+  break_step_over(vm);
+
+  if (step) {
+    stub->run(vm, 1);
+    send_stop(stub, GDB_SIGTRAP);
+    return 1;
+  }
+
+  while (vm->status == VM_RUNNING) {
+    stub->run(vm, GDB_STUB_CHUNK);
+
+    if (poll_readable(stub->client_fd)) {
+      int c = read_char(stub);
+      if (c < 0) {
+        return 0;
+      }
+      if (c == 0x03) {
+        send_stop(stub, GDB_SIGINT);
+        return 1;
+      }
+    }
+  }
+  send_stop(stub, GDB_SIGTRAP);
+  return 1;
+}
+
+// Go back until a breakpoint or watchpoint, or one instruction
+static void run_backwards(gdb_stub* stub, int step) {
+  lc3_vm* vm = stub->vm;
+  int moved = step ? history_reverse_step(vm) : history_reverse_continue(vm);
+
+  if (!moved) {
+    char reply[32];
+    sprintf(reply, "T%02xreplaylog:begin;", GDB_SIGTRAP);
+    send_packet(stub, reply);
+    return;
+  }
+  send_stop(stub, GDB_SIGTRAP);
+}
+
+void gdb_stub_run(gdb_stub* stub) {
+  lc3_vm* vm = stub->vm;
+
+  for (;;) {
+    if (stub->client_fd < 0) {
+      while (vm->status == VM_RUNNING && !poll_readable(stub->listen_fd)) {
+        stub->run(vm, GDB_STUB_CHUNK);
+      }
+      if (vm->status != VM_RUNNING) {
+        return;
+      }
+
+      stub->client_fd = accept(stub->listen_fd, NULL, NULL);
+      stub->no_ack = 0;
+      continue;
+    }
+
+    switch (serve(stub)) {
+      case GDB_CONTINUE:
+      case GDB_STEP:
+        if (!run_attached(stub, stub->packet[0] == 's')) {
+          drop_client(stub);
+        }
+        else if (vm->status == VM_HALTED || vm->status == VM_FAULT) {
+          drop_client(stub);
+          return;
+        }
+        break;
+      case GDB_REVERSE_CONTINUE:
+      case GDB_REVERSE_STEP:
+        run_backwards(stub, stub->packet[1] == 's');
+        break;
+      case GDB_DETACH:
+        drop_client(stub);
+        vm_resume(vm);
+        break;
+      case GDB_KILL:
+        drop_client(stub);
+        vm->status = VM_HALTED;
+        return;
+    }
+  }
+}
+
+int gdb_stub_listen(gdb_stub* stub, lc3_vm* vm, engine_run run, const char* address) {
+  memset(stub, 0, sizeof(*stub));
+  stub->vm = vm;
+  stub->run = run;
+  stub->client_fd = -1;
+
+  stub->listen_fd = listen_address(address, 1, stub->socket_path);
+  return stub->listen_fd >= 0;
+}
+
+void gdb_stub_close(gdb_stub* stub) {
+  if (stub->client_fd >= 0) {
+    drop_client(stub);
+  }
+  if (stub->listen_fd >= 0) {
+    close(stub->listen_fd);
+    stub->listen_fd = -1;
+  }
+  if (stub->socket_path[0]) {
+    unlink(stub->socket_path);
+    stub->socket_path[0] = 0;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef _GDB_STUB
+#define _GDB_STUB
+
+#include <stdint.h>
+
+#include "../core/core.h"
+#include "../core/engine.h"
+
+#include "listen.h"
+
+/* GDB remote serial protocol stub
+
+The guest runs at full speed in chunks of GDB_STUB_CHUNK instructions.
+Between chunks the stub polls its sockets, so attaching (or ^C from
+an attached debugger) stops the guest within one chunk. Breakpoints
+and watchpoints are the ones in watch.h, so the engine itself does no
+debugger work.
+
+Registers are R0-R7, PC and COND, described to the debugger by
+target.xml. GDB addresses bytes: word w is at byte address 2w, low
+byte first, and the PC is reported the same way, as 2*PC in 32 bits.
+The rest are 16 bits.
+*/
+enum { GDB_STUB_CHUNK = 1 << 20 };
+
+enum { GDB_PACKET_SIZE = 4096 };
+
+typedef struct gdb_stub {
+  lc3_vm* vm;
+  engine_run run;
+  int listen_fd;
+  int client_fd;
+  int no_ack;
+  char socket_path[LISTEN_PATH_SIZE]; /* Unix socket to unlink, if any */
+  char packet[GDB_PACKET_SIZE];
+} gdb_stub;
+
+/* Listen on address: [host]:port for TCP (loopback by default)
+or a path for a Unix socket. Returns 0 on failure */
+int gdb_stub_listen(gdb_stub* stub, lc3_vm* vm, engine_run run, const char* address);
+
+/* Run the guest, serving any debugger that attaches. Returns when
+the machine stops with no debugger attached: halted, faulted, or
+on a watchpoint armed outside the debugger (status VM_BREAK) */
+void gdb_stub_run(gdb_stub* stub);
+
+void gdb_stub_close(gdb_stub* stub);
+
+#endif
@@ -0,0 +1,507 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/watch.h"
+
+enum { PAGE_BYTES = MEMORY_PAGE_WORDS * sizeof(uint16_t) };
+
+#define ALL_PAGES UINT64_MAX
+
+/* Console answers in the input log */
+enum {
+  INPUT_KEY_READY,
+  INPUT_GET_CHAR
+};
+
+/* count equal answers in a row */
+typedef struct input_event {
+  int16_t value;      /* 0 or 1 for a key ready, the character or EOF */
+  uint8_t kind;
+  uint32_t count;
+} input_event;
+
+/* A place in the log: answers already given from one event */
+typedef struct input_position {
+  uint64_t event;     /* counted from the start of the recording */
+  uint32_t used;
+} input_position;
+
+/* Registers and where the input was at a snapshot. Memory is kept
+per page, as the versions the snapshots took */
+typedef struct snapshot {
+  uint64_t time;
+  uint16_t registers[R_COUNT];
+  input_position input;
+  uint64_t pages;     /* pages that changed since the previous one */
+} snapshot;
+
+/* A page's contents from time on */
+typedef struct page_version {
+  uint64_t time;
+  uint16_t* words;
+} page_version;
+
+typedef struct page_history {
+  page_version* versions;
+  size_t count;
+  size_t capacity;
+} page_history;
+
+/* A breakpoint or watchpoint hit found while going back */
+typedef struct history_stop {
+  uint64_t time;
+  watch_hit hit;
+} history_stop;
+
+static int recording;
+static engine_run history_run;
+static uint64_t history_interval;
+
+static uint64_t now;
+static uint64_t end;
+static int replaying;         /* now < end: input comes from the log */
+
+static snapshot* snapshots;
+static size_t snapshot_count;
+static size_t snapshot_capacity;
+static size_t stored_pages;
+
+static page_history page_histories[MEMORY_PAGE_COUNT];
+static uint64_t recheck_pages; /* pages changed behind dirty_pages' back */
+
+static input_event* input_log;
+static size_t log_length;
+static size_t log_capacity;
+static uint64_t log_first;    /* events before it were folded away */
+static input_position cursor; /* next answer to replay */
+
+static lc3_console live_console;
+
+/* INPUT LOG */
+static input_position log_end() {
+  input_position position = { log_first + log_length, 0 };
+  if (log_length) {
+    position.event = log_first + log_length - 1;
+    position.used = input_log[log_length - 1].count;
+  }
+  return position;
+}
+
+static void log_answer(int kind, int value) {
+  input_event* last = log_length ? &input_log[log_length - 1] : NULL;
+
+  if (last && last->kind == kind && last->value == value && last->count < UINT32_MAX) {
+    ++last->count;
+    return;
+  }
+  if (log_length == log_capacity) {
+    size_t capacity = log_capacity ? 2 * log_capacity : 1024;
+    input_event* grown = (input_event*) realloc(input_log, capacity * sizeof(input_event));
+    if (!grown) {
+      return;
+    }
+    input_log = grown;
+    log_capacity = capacity;
+  }
+  input_log[log_length++] = (input_event) { (int16_t) value, (uint8_t) kind, 1 };
+}
+
+// The answer the live console gave at this point
+static int replay_answer(int kind) {
+  while (cursor.event - log_first < log_length && cursor.used == input_log[cursor.event - log_first].count) {
+    ++cursor.event;
+    cursor.used = 0;
+  }
+  if (cursor.event - log_first >= log_length || input_log[cursor.event - log_first].kind != kind) {
+    // Replay is deterministic, so this only happens on a broken log
+    return kind == INPUT_KEY_READY ? 0 : EOF;
+  }
+  ++cursor.used;
+  return input_log[cursor.event - log_first].value;
+}
+
+static int recorded_key_ready(void* context) {
+  (void) context;
+  if (replaying) {
+    return replay_answer(INPUT_KEY_READY);
+  }
+  int ready = live_console.key_ready(live_console.context) != 0;
+  log_answer(INPUT_KEY_READY, ready);
+  return ready;
+}
+
+static int recorded_get_char(void* context) {
+  (void) context;
+  if (replaying) {
+    return replay_answer(INPUT_GET_CHAR);
+  }
+  int c = live_console.get_char(live_console.context);
+  log_answer(INPUT_GET_CHAR, c);
+  return c;
+}
+
+// Output already happened the first time through
+static void recorded_put_char(int c, void* context) {
+  (void) context;
+  if (!replaying) {
+    live_console.put_char(c, live_console.context);
+  }
+}
+
+static void recorded_flush(void* context) {
+  (void) context;
+  if (!replaying) {
+    live_console.flush(live_console.context);
+  }
+}
+
+/* SNAPSHOTS */
+// The last version of page at or before time
+static const uint16_t* page_at(int page, uint64_t time) {
+  const page_history* h = &page_histories[page];
+  size_t low = 0;
+  size_t high = h->count;
+
+  while (high - low > 1) {
+    size_t middle = (low + high) / 2;
+    if (h->versions[middle].time <= time) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return h->versions[low].words;
+}
+
+static void rebuild_memory(uint64_t time, uint16_t* memory) {
+  for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+    memcpy(memory + page * MEMORY_PAGE_WORDS, page_at(page, time), PAGE_BYTES);
+  }
+}
+
+static void drop_versions(page_history* h, size_t first, size_t count) {
+  for (size_t i = first; i < first + count; ++i) {
+    free(h->versions[i].words);
+  }
+  memmove(h->versions + first, h->versions + first + count, (h->count - first - count) * sizeof(page_version));
+  h->count -= count;
+  stored_pages -= count;
+}
+
+// The oldest snapshot after the first folds into it
+static void fold_oldest() {
+  snapshot* first = &snapshots[0];
+  snapshot* next = &snapshots[1];
+
+  // Pages it changed lose their version from before
+  for (uint64_t pages = next->pages; pages; pages &= pages - 1) {
+    drop_versions(&page_histories[__builtin_ctzll(pages)], 0, 1);
+  }
+  first->time = next->time;
+  memcpy(first->registers, next->registers, sizeof(first->registers));
+  first->input = next->input;
+
+  memmove(next, next + 1, (snapshot_count - 2) * sizeof(snapshot));
+  --snapshot_count;
+
+  // Answers before the first snapshot can no longer be replayed
+  size_t dropped = first->input.event - log_first;
+  memmove(input_log, input_log + dropped, (log_length - dropped) * sizeof(input_event));
+  log_length -= dropped;
+  log_first = first->input.event;
+}
+
+static int add_version(int page, const uint16_t* words) {
+  page_history* h = &page_histories[page];
+
+  if (h->count == h->capacity) {
+    size_t capacity = h->capacity ? 2 * h->capacity : 16;
+    page_version* grown = (page_version*) realloc(h->versions, capacity * sizeof(page_version));
+    if (!grown) {
+      return 0;
+    }
+    h->versions = grown;
+    h->capacity = capacity;
+  }
+
+  page_version* v = &h->versions[h->count];
+  v->words = (uint16_t*) malloc(PAGE_BYTES);
+  if (!v->words) {
+    return 0;
+  }
+  v->time = now;
+  memcpy(v->words, words, PAGE_BYTES);
+  ++h->count;
+  ++stored_pages;
+  return 1;
+}
+
+// Snapshot the machine, keeping the pages given that differ from
+// their last version
+static int take_snapshot(lc3_vm* vm, uint64_t candidates) {
+  if (snapshot_count == snapshot_capacity) {
+    size_t capacity = snapshot_capacity ? 2 * snapshot_capacity : 64;
+    snapshot* grown = (snapshot*) realloc(snapshots, capacity * sizeof(snapshot));
+    if (!grown) {
+      return 0;
+    }
+    snapshots = grown;
+    snapshot_capacity = capacity;
+  }
+
+  snapshot* s = &snapshots[snapshot_count];
+  s->time = now;
+  memcpy(s->registers, vm->registers, sizeof(s->registers));
+  s->input = log_end();
+  s->pages = 0;
+
+  for (uint64_t p = candidates; p; p &= p - 1) {
+    int page = __builtin_ctzll(p);
+    const uint16_t* words = vm->memory + page * MEMORY_PAGE_WORDS;
+    const page_history* h = &page_histories[page];
+
+    if (!h->count || memcmp(words, h->versions[h->count - 1].words, PAGE_BYTES)) {
+      if (!add_version(page, words)) {
+        return 0;
+      }
+      s->pages |= 1ull << page;
+    }
+  }
+  ++snapshot_count;
+  recheck_pages = 0;
+
+  while (stored_pages > HISTORY_MAX_PAGES && snapshot_count > 2) {
+    fold_oldest();
+  }
+  return 1;
+}
+
+// Last snapshot at or before time
+static size_t snapshot_before(uint64_t time) {
+  size_t k = snapshot_count - 1;
+  while (k > 0 && snapshots[k].time > time) {
+    --k;
+  }
+  return k;
+}
+
+static void restore(lc3_vm* vm, size_t k) {
+  const snapshot* s = &snapshots[k];
+
+  rebuild_memory(s->time, vm->memory);
+  memcpy(vm->registers, s->registers, sizeof(vm->registers));
+  vm->status = VM_RUNNING;
+  if (vm->debug) {
+    vm->debug->resume_pc = -1;
+  }
+
+  now = s->time;
+  cursor = s->input;
+  replaying = now < end;
+  recheck_pages = ALL_PAGES;
+}
+
+/* RUNNING */
+// Run at most budget instructions, keeping time. Returns what the
+// engine counted
+static uint64_t advance(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = history_run(vm, budget);
+  uint64_t counted = executed;
+
+  if (vm->status == VM_BREAK && vm->debug->hit.kind == WATCH_BREAKPOINT) {
+    --counted;
+  }
+  now += counted;
+  if (now >= end) {
+    end = now;
+    replaying = 0;
+  }
+  return executed;
+}
+
+// Replay up to time with nothing armed
+static void replay_to(lc3_vm* vm, uint64_t time) {
+  uint64_t watched = vm->watched_pages;
+  uint64_t breaks = vm->break_pages;
+
+  vm->watched_pages = 0;
+  vm->break_pages = 0;
+  while (now < time && vm->status == VM_RUNNING) {
+    advance(vm, time - now);
+  }
+  vm->watched_pages = watched;
+  vm->break_pages = breaks;
+}
+
+// Replay up to time, keeping the last hit that stops going backwards
+// before it
+static int last_stop(lc3_vm* vm, uint64_t time, history_stop* stop) {
+  int found = 0;
+
+  while (now < time && vm->status == VM_RUNNING) {
+    advance(vm, time - now);
+
+    if (vm->status == VM_BREAK) {
+      // Backwards, a watchpoint stops before the access
+      uint64_t at = vm->debug->hit.kind == WATCH_BREAKPOINT ? now : now - 1;
+      if (at < time) {
+        stop->time = at;
+        stop->hit = vm->debug->hit;
+        found = 1;
+      }
+      vm_resume(vm);
+    }
+  }
+  return found;
+}
+
+int history_start(lc3_vm* vm, engine_run run, uint64_t interval) {
+  history_run = run;
+  history_interval = interval ? interval : HISTORY_INTERVAL;
+  now = 0;
+  end = 0;
+  replaying = 0;
+  if (!take_snapshot(vm, ALL_PAGES)) {
+    return 0;
+  }
+
+  live_console = vm->console;
+  vm->console.get_char = recorded_get_char;
+  vm->console.key_ready = recorded_key_ready;
+  vm->console.put_char = recorded_put_char;
+  vm->console.flush = recorded_flush;
+  recording = 1;
+  return 1;
+}
+
+// In the past the recording is replayed up to its end; live, a slice
+// ends at the next snapshot
+uint64_t run_recorded(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint64_t next = snapshots[snapshot_count - 1].time + history_interval;
+
+    if (!replaying && now == next) {
+      take_snapshot(vm, vm->dirty_pages | recheck_pages);
+      next += history_interval;
+    }
+
+    uint64_t slice = (replaying ? end : next) - now;
+    executed += advance(vm, slice < budget - executed ? slice : budget - executed);
+  }
+  return executed;
+}
+
+int history_active() {
+  return recording;
+}
+
+uint64_t history_now() {
+  return now;
+}
+
+uint64_t history_end() {
+  return end;
+}
+
+int history_seek(lc3_vm* vm, uint64_t time) {
+  if (time < snapshots[0].time || time > now) {
+    return 0;
+  }
+  restore(vm, snapshot_before(time));
+  replay_to(vm, time);
+  return 1;
+}
+
+int history_reverse_step(lc3_vm* vm) {
+  return now > snapshots[0].time && history_seek(vm, now - 1);
+}
+
+// Search backwards one snapshot interval at a time
+int history_reverse_continue(lc3_vm* vm) {
+  uint64_t until = now;
+  history_stop stop;
+
+  if (vm->debug) {
+    for (size_t k = snapshot_before(until); until > snapshots[0].time; --k) {
+      restore(vm, k);
+      if (last_stop(vm, until, &stop)) {
+        history_seek(vm, stop.time);
+        vm->debug->hit = stop.hit;
+        vm->status = VM_BREAK;
+        return 1;
+      }
+      until = snapshots[k].time;
+      if (k == 0) {
+        break;
+      }
+    }
+  }
+
+  restore(vm, 0);
+  return 0;
+}
+
+void history_diverge(lc3_vm* vm) {
+  if (!recording) {
+    return;
+  }
+
+  // Drop the answers after now
+  if (replaying) {
+    log_length = cursor.event - log_first;
+    if (cursor.used) {
+      input_log[log_length++].count = cursor.used;
+    }
+  }
+
+  // and every snapshot from now on, which may not hold the change
+  while (snapshot_count > 1 && snapshots[snapshot_count - 1].time >= now) {
+    --snapshot_count;
+  }
+  for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+    page_history* h = &page_histories[page];
+    size_t keep = h->count;
+    while (keep > 1 && h->versions[keep - 1].time >= now) {
+      --keep;
+    }
+    drop_versions(h, keep, h->count - keep);
+  }
+
+  end = now;
+  replaying = 0;
+  recheck_pages = ALL_PAGES;
+
+  if (snapshots[0].time == now) {
+    // Nothing left before now: start over from here
+    for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+      drop_versions(&page_histories[page], 0, page_histories[page].count);
+    }
+    snapshot_count = 0;
+    log_first += log_length;
+    log_length = 0;
+    take_snapshot(vm, ALL_PAGES);
+  }
+}
+
+void history_free() {
+  for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+    page_history* h = &page_histories[page];
+    drop_versions(h, 0, h->count);
+    free(h->versions);
+    h->versions = NULL;
+    h->capacity = 0;
+  }
+  free(snapshots);
+  free(input_log);
+  snapshots = NULL;
+  input_log = NULL;
+  snapshot_count = snapshot_capacity = 0;
+  log_length = log_capacity = 0;
+  recording = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef _HISTORY
+#define _HISTORY
+
+#include <stdint.h>
+
+#include "../core/core.h"
+#include "../core/engine.h"
+
+/* Execution history, for running backwards
+
+The recording engine runs the inner engine in slices and, every
+interval instructions, snapshots the registers and the memory pages
+that changed since the previous snapshot (found through dirty_pages,
+compared against a copy of the last snapshot). The console is wrapped
+so every answer it gives the guest, key ready or character read, is
+logged, run-length encoded so polling loops stay small.
+
+Going back to an earlier instruction restores the last snapshot at or
+before it and replays forward from there at full speed, with
+breakpoints and watchpoints off, input from the log and output
+dropped. Running forward from the past replays the same way, with
+breakpoints on, until it reaches the end of the recording, and then
+continues live.
+
+Time is the count of instructions executed since recording started;
+breakpoint stops, which engines count as one, do not count. When the
+snapshots hold more than HISTORY_MAX_PAGES pages the oldest are folded
+into the first, so the history slides forward.
+*/
+enum {
+  HISTORY_INTERVAL = 1 << 20,
+  HISTORY_MAX_PAGES = 1 << 15   /* 64 MiB of snapshots */
+};
+
+/* Start recording vm from its current state. run is the engine to
+record and replay with; interval is in instructions, 0 for the
+default. Returns 0 on failure */
+int history_start(lc3_vm* vm, engine_run run, uint64_t interval);
+
+/* Engine that records, or replays while in the past */
+uint64_t run_recorded(lc3_vm* vm, uint64_t budget);
+
+/* Non-zero while recording */
+int history_active();
+
+/* Instructions since recording started, at the current point and at
+the end of the recording */
+uint64_t history_now();
+uint64_t history_end();
+
+/* Go back to time. Returns 0 if it is before the history or later
+than now */
+int history_seek(lc3_vm* vm, uint64_t time);
+
+/* Go back one instruction. Returns 0 at the start of the history */
+int history_reverse_step(lc3_vm* vm);
+
+/* Go back to the last breakpoint or watchpoint hit before now, and
+stop there with VM_BREAK as if it had just been hit; a watchpoint
+stops before the instruction that made the access. Without one, go
+to the start of the history and return 0 */
+int history_reverse_continue(lc3_vm* vm);
+
+/* The machine was changed from outside (a debugger wrote registers or
+memory): the recording after now no longer happens and is dropped */
+void history_diverge(lc3_vm* vm);
+
+void history_free();
+
+#endif
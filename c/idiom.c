@@ -0,0 +1,285 @@
+#include "idiom.h"
+
+#include <string.h>
+
+#include "../core/bit-utilities.h"
+#include "../core/opcodes.h"
+
+#include "instruction-set.h"
+
+/* What is known about a loop */
+enum {
+  LOOP_UNKNOWN = 0,   /* not hot yet */
+  LOOP_NONE,          /* not an idiom */
+  LOOP_AFFINE,        /* ADDs only, solved in closed form */
+  LOOP_BODY           /* straight-line body, run by the handlers */
+};
+
+/* How an affine loop moves a register each trip */
+enum {
+  STEP_NONE = 0,
+  STEP_IMMEDIATE,     /* by a constant */
+  STEP_REGISTER,      /* by a register the loop does not write */
+  STEP_DOUBLE         /* by itself */
+};
+
+typedef void (*idiom_handler)(lc3_vm* vm, uint16_t instruction);
+
+typedef struct idiom_loop {
+  uint16_t branch;                          /* address of the BR */
+  uint16_t branch_word;
+  uint16_t head;
+  uint16_t length;                          /* the BR included */
+  uint16_t hits;
+  uint8_t kind;
+  uint8_t counter;                          /* affine: the register the BR tests */
+  uint16_t words[IDIOM_MAX_LENGTH];
+  idiom_handler handlers[IDIOM_MAX_LENGTH];
+  uint8_t step_kinds[8];
+  uint16_t steps[8];                        /* the constant, or the register */
+} idiom_loop;
+
+static __thread idiom_loop loops[IDIOM_CACHE_SIZE];
+
+static idiom_handler body_handler(uint16_t instruction) {
+  switch (instruction >> 12) {
+    case OP_ADD: return add;
+    case OP_AND: return and;
+    case OP_NOT: return not;
+    case OP_LD: return load;
+    case OP_LDI: return loadIndirect;
+    case OP_LDR: return loadRegister;
+    case OP_LEA: return loadEffectiveAddress;
+    case OP_ST: return store;
+    case OP_STR: return storeRegister;
+    default: return NULL;   // control flow, traps and STI, whose target is not known
+  }
+}
+
+// Classify the ADDs of an all-ADD body, LOOP_AFFINE if each register
+// is written once, by a step the closed form handles
+static int analyze_affine(idiom_loop* loop) {
+  int body = loop->length - 1;
+  unsigned written = 0;
+
+  memset(loop->step_kinds, STEP_NONE, sizeof(loop->step_kinds));
+  for (int i = 0; i < body; ++i) {
+    uint16_t word = loop->words[i];
+    unsigned destination = (word >> 9) & 0x7;
+    unsigned source1 = (word >> 6) & 0x7;
+    unsigned source2 = word & 0x7;
+
+    if ((word >> 12) != OP_ADD || (written & (1u << destination))) {
+      return LOOP_BODY;
+    }
+    written |= 1u << destination;
+
+    if (word & 0x20) {
+      if (source1 != destination) {
+        return LOOP_BODY;
+      }
+      loop->step_kinds[destination] = STEP_IMMEDIATE;
+      loop->steps[destination] = sign_extend(word & 0x1F, 5);
+    }
+    else if (source1 == destination && source2 == destination) {
+      loop->step_kinds[destination] = STEP_DOUBLE;
+    }
+    else if (source1 == destination || source2 == destination) {
+      loop->step_kinds[destination] = STEP_REGISTER;
+      loop->steps[destination] = source1 == destination ? source2 : source1;
+    }
+    else {
+      return LOOP_BODY;
+    }
+  }
+
+  for (int r = 0; r < 8; ++r) {
+    if (loop->step_kinds[r] == STEP_REGISTER && (written & (1u << loop->steps[r]))) {
+      return LOOP_BODY;
+    }
+  }
+
+  // The BR tests the flags of the last ADD
+  loop->counter = (loop->words[body - 1] >> 9) & 0x7;
+  return loop->step_kinds[loop->counter] == STEP_DOUBLE ? LOOP_BODY : LOOP_AFFINE;
+}
+
+static void analyze(const lc3_vm* vm, idiom_loop* loop) {
+  uint16_t offset = sign_extend(loop->branch_word & 0x1FF, 9);
+  uint16_t head = loop->branch + 1 + offset;
+  uint32_t length = (uint32_t) loop->branch - head + 1;
+
+  loop->kind = LOOP_NONE;
+  if (head > loop->branch || length < 2 || length > IDIOM_MAX_LENGTH || loop->branch >= MR_KBSR) {
+    return;
+  }
+  loop->head = head;
+  loop->length = (uint16_t) length;
+  memcpy(loop->words, vm->memory + head, length * sizeof(uint16_t));
+
+  for (uint32_t i = 0; i + 1 < length; ++i) {
+    uint16_t word = loop->words[i];
+    if (!(loop->handlers[i] = body_handler(word))) {
+      return;
+    }
+    // A store into the loop itself is self-modifying code
+    if ((word >> 12) == OP_ST) {
+      uint16_t address = head + i + 1 + sign_extend(word & 0x1FF, 9);
+      if (address >= head && address <= loop->branch) {
+        return;
+      }
+    }
+  }
+  loop->kind = analyze_affine(loop);
+}
+
+static int flags_of(uint16_t value) {
+  return value == 0 ? FL_ZRO : value >> 15 ? FL_NEG : FL_POS;
+}
+
+// Trips the loop makes from here, until the branch on the counter is
+// not taken; 0 if the direction of the step never gets it there
+static uint64_t affine_trips(int16_t value, int32_t step, unsigned mask) {
+  if (!(flags_of((uint16_t) value) & mask)) {
+    return 0;
+  }
+  if (step < 0 && mask == FL_POS) {
+    return ((int64_t) value - step - 1) / -step;
+  }
+  if (step < 0 && mask == (FL_ZRO | FL_POS)) {
+    return (int64_t) value / -step + 1;
+  }
+  if (step > 0 && mask == FL_NEG) {
+    return (-(int64_t) value + step - 1) / step;
+  }
+  if (step > 0 && mask == (FL_NEG | FL_ZRO)) {
+    return -(int64_t) value / step + 1;
+  }
+  return 0;
+}
+
+static uint64_t run_affine(lc3_vm* vm, const idiom_loop* loop, uint64_t budget) {
+  uint16_t* registers = vm->registers;
+  unsigned counter = loop->counter;
+  int32_t step = (int16_t) (loop->step_kinds[counter] == STEP_IMMEDIATE ? loop->steps[counter]
+                                                                         : registers[loop->steps[counter]]);
+
+  uint64_t trips = affine_trips((int16_t) registers[counter], step, (loop->branch_word >> 9) & 0x7);
+  if (!trips) {
+    return 0;
+  }
+  int finished = 1;
+  if (trips > budget / loop->length) {
+    trips = budget / loop->length;
+    finished = 0;
+  }
+  if (!trips) {
+    return 0;
+  }
+
+  // Steps by register read the sources first; the loop does not write them
+  uint16_t sources[8];
+  for (int r = 0; r < 8; ++r) {
+    sources[r] = loop->step_kinds[r] == STEP_REGISTER ? registers[loop->steps[r]] : loop->steps[r];
+  }
+  for (int r = 0; r < 8; ++r) {
+    switch (loop->step_kinds[r]) {
+      case STEP_IMMEDIATE:
+      case STEP_REGISTER:
+        registers[r] = (uint16_t) (registers[r] + trips * sources[r]);
+        break;
+      case STEP_DOUBLE:
+        registers[r] = trips >= 16 ? 0 : (uint16_t) (registers[r] << trips);
+        break;
+    }
+  }
+
+  update_flags(vm, counter);
+  registers[R_PC] = finished ? loop->branch + 1 : loop->head;
+  return trips * loop->length;
+}
+
+static uint64_t run_body(lc3_vm* vm, const idiom_loop* loop, uint64_t budget) {
+  uint16_t* registers = vm->registers;
+  unsigned mask = (loop->branch_word >> 9) & 0x7;
+  int body = loop->length - 1;
+  uint64_t executed = 0;
+
+  // Other vCPUs may rewrite the loop while it runs (see core/smp.h),
+  // so each word is checked where the interpreter would fetch it
+  const uint16_t* shared = vm->cpu ? vm->memory + loop->head : NULL;
+
+  while (budget - executed >= loop->length) {
+    for (int i = 0; i < body; ++i) {
+      uint16_t word = loop->words[i];
+      uint16_t address = 0;
+
+      if (shared && shared[i] != word) {
+        registers[R_PC] = loop->head + i;
+        return executed + i;
+      }
+
+      if ((word >> 12) == OP_STR) {
+        address = registers[(word >> 6) & 0x7] + sign_extend(word & 0x3F, 6);
+      }
+      registers[R_PC] = loop->head + i + 1;
+      loop->handlers[i](vm, word);
+
+      if (vm->status != VM_RUNNING || (address >= loop->head && address <= loop->branch)) {
+        return executed + i + 1;
+      }
+    }
+    if (shared && shared[body] != loop->branch_word) {
+      registers[R_PC] = loop->branch;
+      return executed + body;
+    }
+    executed += loop->length;
+
+    if (!(registers[R_COND] & mask)) {
+      registers[R_PC] = loop->branch + 1;
+      return executed;
+    }
+  }
+  registers[R_PC] = loop->head;
+  return executed;
+}
+
+uint64_t idiom_run(lc3_vm* vm, uint16_t instruction, uint64_t budget) {
+  if (vm->watched_pages | vm->break_pages) {
+    return 0;
+  }
+
+  uint16_t branch = vm->registers[R_PC] - 1 - sign_extend(instruction & 0x1FF, 9);
+  idiom_loop* loop = &loops[(branch ^ (branch >> 8)) % IDIOM_CACHE_SIZE];
+
+  if (loop->branch != branch || loop->branch_word != instruction) {
+    memset(loop, 0, sizeof(*loop));
+    loop->branch = branch;
+    loop->branch_word = instruction;
+  }
+
+  switch (loop->kind) {
+    case LOOP_UNKNOWN:
+      if (++loop->hits < IDIOM_HOT) {
+        return 0;
+      }
+      analyze(vm, loop);
+      break;
+    case LOOP_NONE:
+      return 0;
+    default:
+      if (memcmp(loop->words, vm->memory + loop->head, (loop->length - 1) * sizeof(uint16_t))) {
+        analyze(vm, loop);
+      }
+      break;
+  }
+
+  uint64_t executed = 0;
+  if (loop->kind == LOOP_AFFINE) {
+    executed = run_affine(vm, loop, budget);
+  }
+  if (!executed && loop->kind != LOOP_NONE) {
+    executed = run_body(vm, loop, budget);
+  }
+  return executed;
+}
@@ -0,0 +1,47 @@
+#ifndef _IDIOM
+#define _IDIOM
+
+#include <stdint.h>
+
+#include "../core/core.h"
+
+/* Idiom recognition
+Guest code multiplies, divides, shifts, copies and fills memory with
+short loops of ADD/AND/LDR/STR closed by a backward BR. The computed
+goto engine passes every taken backward branch here; once a loop is
+hot (IDIOM_HOT trips) its body is checked, and a straight-line body
+that only computes and moves data is run natively:
+
+- A body of ADDs that each step one register by a constant, by a
+  register the loop leaves alone, or by itself (doubling), with the
+  branch testing the last of them, is solved in closed form: the trip
+  count comes from the counter and every register moves by that many
+  steps at once. This covers multiply by repeated addition, divide
+  by repeated subtraction and shift left.
+
+- Any other body (memcpy and memset loops) runs through the handlers
+  in instruction-set.c without fetch, dispatch or PC updates, and
+  leaves the fast path at the exact instruction where a load changes
+  the machine status or a store hits the loop itself.
+
+Either way the registers, flags, memory and instruction count end as
+the interpreter would leave them, and no more of the budget is used.
+Loops are cached per thread by address and checked against memory
+every time, so rewritten code is analyzed again; on a vCPU, whose
+memory others write (see core/smp.h), a body run by the handlers is
+also checked word by word as it runs. VMs with
+watchpoints or breakpoints are always interpreted.
+*/
+enum {
+  IDIOM_MAX_LENGTH = 8,       /* instructions in a loop, the BR included */
+  IDIOM_CACHE_SIZE = 256,     /* loops remembered per thread */
+  IDIOM_HOT = 16              /* trips before a loop is analyzed */
+};
+
+/* Called once the backward BR instruction has been taken, with the PC
+at the loop head. Runs the loop natively if it is a known idiom, using
+at most budget instructions, and returns the instructions it stands
+for; 0 leaves the machine untouched for the interpreter */
+uint64_t idiom_run(lc3_vm* vm, uint16_t instruction, uint64_t budget);
+
+#endif
@@ -7,7 +7,7 @@
 #include <stdlib.h>
 
 /* INSTRUCTIONS */
-void add(uint16_t instruction) {
+void add(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction format:
     Register mode (Mode bit 0):
@@ -46,18 +46,18 @@ void add(uint16_t instruction) {
     // Sign extend the immediate value
     uint16_t immediateValue = instruction & 0x1F;
     uint16_t signExtendedImmediateValue = sign_extend(immediateValue, 5);
-    registers[destination] = registers[sourceRegister1] + signExtendedImmediateValue;
+    vm->registers[destination] = vm->registers[sourceRegister1] + signExtendedImmediateValue;
   }
   else {
     uint16_t sourceRegister2 = instruction & 0x7;
-    registers[destination] = registers[sourceRegister1] + registers[sourceRegister2];
+    vm->registers[destination] = vm->registers[sourceRegister1] + vm->registers[sourceRegister2];
   }
 
   // Update the flags
-  update_flags(destination);
+  update_flags(vm, destination);
 }
 
-void and(uint16_t instruction) {
+void and(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction format:
   
@@ -97,15 +97,18 @@ void and(uint16_t instruction) {
     // Sign extend the immediate value
     uint16_t immediateValue = instruction & 0x1F;
     uint16_t signExtendedImmediateValue = sign_extend(immediateValue, 5);
-    registers[destination] = registers[sourceRegister1] & signExtendedImmediateValue;
+    vm->registers[destination] = vm->registers[sourceRegister1] & signExtendedImmediateValue;
   }
   else {
     uint16_t sourceRegister2 = instruction & 0x7;
-    registers[destination] = registers[sourceRegister1] & registers[sourceRegister2];
+    vm->registers[destination] = vm->registers[sourceRegister1] & vm->registers[sourceRegister2];
   }
+
+  // Update the flags
+  update_flags(vm, destination);
 }
 
-void branch(uint16_t instruction) {
+void branch(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Flags   PCOffset9               0
@@ -132,13 +135,13 @@ void branch(uint16_t instruction) {
 
   // Get the flags
   uint16_t conditionalFlags = (instruction >> 9) & 0x7;
-  if (conditionalFlags & registers[R_COND]) {
+  if (conditionalFlags & vm->registers[R_COND]) {
     // If the branch conditions are met, branch
-    registers[R_PC] += signExtendedPCOffset;
+    vm->registers[R_PC] += signExtendedPCOffset;
   }
 }
 
-void jump(uint16_t instruction) {
+void jump(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
   JMP mode:
@@ -161,10 +164,10 @@ void jump(uint16_t instruction) {
 
   // Get the base register
   uint16_t baseRegister = (instruction >> 6) & 0x7;
-  registers[R_PC] = registers[baseRegister];
+  vm->registers[R_PC] = vm->registers[baseRegister];
 }
 
-void jumpToSubroutine(uint16_t instruction) {
+void jumpToSubroutine(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
   JSR mode:
@@ -191,19 +194,19 @@ void jumpToSubroutine(uint16_t instruction) {
   uint16_t longFlag = (instruction >> 11) & 1;
 
   // Store the current PC value into R7
-  registers[R_R7] = registers[R_PC];
+  vm->registers[R_R7] = vm->registers[R_PC];
 
   if (longFlag) {
     // JSR
-    registers[R_PC] += signExtendedPCOffset;
+    vm->registers[R_PC] += signExtendedPCOffset;
   }
   else {
     // JSRR
-    registers[R_PC] = registers[baseRegister];
+    vm->registers[R_PC] = vm->registers[baseRegister];
   }
 }
 
-void load(uint16_t instruction) {
+void load(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Dest   PCOffset9                0
@@ -224,14 +227,14 @@ void load(uint16_t instruction) {
   uint16_t pcOffset9 = instruction & 0x1FF;
   uint16_t signExtendedPCOffset = sign_extend(pcOffset9, 9);
 
-  uint16_t value = mem_read(registers[R_PC] + signExtendedPCOffset);
-  registers[destination] = value;
+  uint16_t value = mem_read(vm, vm->registers[R_PC] + signExtendedPCOffset);
+  vm->registers[destination] = value;
 
   // Update the flags
-  update_flags(destination);
+  update_flags(vm, destination);
 }
 
-void loadIndirect(uint16_t instruction) {
+void loadIndirect(lc3_vm* vm, uint16_t instruction) {
   
   /* Instruction Format:
     15          Dest   PCOffset9                0
@@ -256,22 +259,22 @@ void loadIndirect(uint16_t instruction) {
   uint16_t signExtendedPCOffset = sign_extend(pcOffset9, 9);
 
   // Add the current PC value
-  uint16_t pointerLocation = registers[R_PC] + signExtendedPCOffset;
+  uint16_t pointerLocation = vm->registers[R_PC] + signExtendedPCOffset;
 
   // Read the pointer
-  uint16_t pointer = mem_read(pointerLocation);
+  uint16_t pointer = mem_read(vm, pointerLocation);
 
   // Read the value referred to by the pointer
-  uint16_t value = mem_read(pointer);
+  uint16_t value = mem_read(vm, pointer);
 
   // Write the value to the register
-  registers[destination] = value;
+  vm->registers[destination] = value;
 
   // Update the flags
-  update_flags(destination);
+  update_flags(vm, destination);
 }
 
-void loadRegister(uint16_t instruction) {
+void loadRegister(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Dest   Base     Offset6         0
@@ -297,15 +300,15 @@ void loadRegister(uint16_t instruction) {
   uint16_t offset = instruction & 0x3F;
   uint16_t signExtendedOffset = sign_extend(offset, 6);
 
-  uint16_t value = mem_read(registers[baseRegister] + signExtendedOffset);
+  uint16_t value = mem_read(vm, vm->registers[baseRegister] + signExtendedOffset);
 
-  registers[destination] = value;
+  vm->registers[destination] = value;
 
   // Update the flags
-  update_flags(destination);
+  update_flags(vm, destination);
 }
 
-void loadEffectiveAddress(uint16_t instruction) {
+void loadEffectiveAddress(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Dest   PCOffset9                0
@@ -326,13 +329,13 @@ void loadEffectiveAddress(uint16_t instruction) {
   uint16_t pcOffset9 = instruction & 0x1FF;
   uint16_t signExtendedPCOffset = sign_extend(pcOffset9, 9);
 
-  registers[destination] = registers[R_PC] + signExtendedPCOffset;
+  vm->registers[destination] = vm->registers[R_PC] + signExtendedPCOffset;
 
   // Update the flags
-  update_flags(destination);
+  update_flags(vm, destination);
 }
 
-void not(uint16_t instruction) {
+void not(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Dest    Src    Mode             0
@@ -349,13 +352,13 @@ void not(uint16_t instruction) {
   // Get the source 1 register
   uint16_t sourceRegister = (instruction >> 6) & 0x7;
 
-  registers[destination] = ~registers[sourceRegister];
+  vm->registers[destination] = ~vm->registers[sourceRegister];
 
   // Update the flags
-  update_flags(destination);
+  update_flags(vm, destination);
 }
 
-void store(uint16_t instruction) {
+void store(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Src    PCOffset9                0
@@ -377,10 +380,10 @@ void store(uint16_t instruction) {
   uint16_t pcOffset9 = instruction & 0x1FF;
   uint16_t signExtendedPCOffset = sign_extend(pcOffset9, 9);
 
-  mem_write(registers[R_PC] + signExtendedPCOffset, registers[source]);
+  mem_write(vm, vm->registers[R_PC] + signExtendedPCOffset, vm->registers[source]);
 }
 
-void storeIndirect(uint16_t instruction) {
+void storeIndirect(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Src    PCOffset9                0
@@ -402,12 +405,12 @@ void storeIndirect(uint16_t instruction) {
   uint16_t pcOffset9 = instruction & 0x1FF;
   uint16_t signExtendedPCOffset = sign_extend(pcOffset9, 9);
 
-  uint16_t address = mem_read(registers[R_PC] + signExtendedPCOffset);
+  uint16_t address = mem_read(vm, vm->registers[R_PC] + signExtendedPCOffset);
 
-  mem_write(address, registers[source]);
+  mem_write(vm, address, vm->registers[source]);
 }
 
-void storeRegister(uint16_t instruction) {
+void storeRegister(lc3_vm* vm, uint16_t instruction) {
 
   /* Instruction Format:
     15          Src    Base     Offset6         0
@@ -433,79 +436,91 @@ void storeRegister(uint16_t instruction) {
   uint16_t offset = instruction & 0x3F;
   uint16_t signExtendedOffset = sign_extend(offset, 6);
 
-  uint16_t address = registers[baseRegister] + signExtendedOffset;
+  uint16_t address = vm->registers[baseRegister] + signExtendedOffset;
 
-  mem_write(address, registers[source]);
+  mem_write(vm, address, vm->registers[source]);
 }
 
 /* TRAP functions */
-void trapGetC() {
-  registers[R_R0] = (uint16_t) getchar();
+void trapGetC(lc3_vm* vm) {
+  if (vm_wait_input(vm)) {
+    return;
+  }
+  vm->registers[R_R0] = (uint16_t) vm->console.get_char(vm->console.context);
 }
 
-void trapHalt() {
-  puts("HALT");
-  fflush(stdout);
-  exit(0);
+void trapHalt(lc3_vm* vm) {
+  console_print(&vm->console, "HALT\n");
+  vm->console.flush(vm->console.context);
+  vm->status = VM_HALTED;
 }
 
-void trapIn() {
-  printf("Enter a character: ");
-  registers[R_R0] = (uint16_t) getchar();
+void trapIn(lc3_vm* vm) {
+  // The prompt is not printed again when a wait for input ends
+  if (!vm->console.waiting) {
+    console_print(&vm->console, "Enter a character: ");
+  }
+  if (vm_wait_input(vm)) {
+    return;
+  }
+  vm->registers[R_R0] = (uint16_t) vm->console.get_char(vm->console.context);
 }
 
-void trapOut() {
-  putc((char)registers[R_R0], stdout);
-  fflush(stdout);
+void trapOut(lc3_vm* vm) {
+  vm->console.put_char((char)vm->registers[R_R0], vm->console.context);
+  vm->console.flush(vm->console.context);
 }
 
-void trapPuts() {
-  uint16_t* character = memory + registers[R_R0];
-  while (*character) {
-    putc((char)*character, stdout);
-    ++character;
+void trapPuts(lc3_vm* vm) {
+  /* The address wraps around the end of memory, and an
+  unterminated string stops after one pass over memory
+  */
+  uint16_t address = vm->registers[R_R0];
+  for (uint32_t count = 0; count < MEMORY_SIZE && vm->memory[address]; ++count) {
+    vm->console.put_char((char)vm->memory[address], vm->console.context);
+    ++address;
   }
-  fflush(stdout);
+  vm->console.flush(vm->console.context);
 }
 
-void trapPutSP() {
+void trapPutSP(lc3_vm* vm) {
   /* One char per byte (two bytes per word)
   Convert to Big Endian format
    */
-  uint16_t* character = memory + registers[R_R0];
-  while (*character)
+  uint16_t address = vm->registers[R_R0];
+  for (uint32_t count = 0; count < MEMORY_SIZE && vm->memory[address]; ++count)
   {
-      char char1 = (*character) & 0xFF;
-      putc(char1, stdout);
+      char char1 = vm->memory[address] & 0xFF;
+      vm->console.put_char(char1, vm->console.context);
 
-      char char2 = (*character) >> 8;
-      if (char2) putc(char2, stdout);
-      ++character;
+      char char2 = vm->memory[address] >> 8;
+      if (char2) vm->console.put_char(char2, vm->console.context);
+      ++address;
   }
-  fflush(stdout);
+  vm->console.flush(vm->console.context);
 }
 
-void trap(uint16_t instruction) {
+void trap(lc3_vm* vm, uint16_t instruction) {
   uint16_t trapCode = instruction & 0xFF;
 
   switch(trapCode) {
     case TRAP_GETC:
-      trapGetC();
+      trapGetC(vm);
       break;
     case TRAP_OUT:
-      trapOut();
+      trapOut(vm);
       break;
     case TRAP_PUTS:
-      trapPuts();
+      trapPuts(vm);
       break;
     case TRAP_IN:
-      trapIn();
+      trapIn(vm);
       break;
     case TRAP_PUTSP:
-      trapPutSP();
+      trapPutSP(vm);
       break;
     case TRAP_HALT:
-      trapHalt();
+      trapHalt(vm);
       break;
   }
 }
\ No newline at end of file
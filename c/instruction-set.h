@@ -3,27 +3,28 @@
 
 #include <stdint.h>
 
+#include "../core/core.h"
 #include "../core/opcodes.h"
 
-void add(uint16_t instruction);
-void and(uint16_t instruction);
-void branch(uint16_t instruction);
-void jump(uint16_t instruction);
-void jumpToSubroutine(uint16_t instruction);
-void load(uint16_t instruction);
-void loadIndirect(uint16_t instruction);
-void loadRegister(uint16_t instruction);
-void loadEffectiveAddress(uint16_t instruction);
-void not(uint16_t instruction);
-void store(uint16_t instruction);
-void storeIndirect(uint16_t instruction);
-void storeRegister(uint16_t instruction);
-void trapGetC();
-void trapHalt();
-void trapIn();
-void trapOut();
-void trapPuts();
-void trapPutSP();
-void trap(uint16_t instruction);
+void add(lc3_vm* vm, uint16_t instruction);
+void and(lc3_vm* vm, uint16_t instruction);
+void branch(lc3_vm* vm, uint16_t instruction);
+void jump(lc3_vm* vm, uint16_t instruction);
+void jumpToSubroutine(lc3_vm* vm, uint16_t instruction);
+void load(lc3_vm* vm, uint16_t instruction);
+void loadIndirect(lc3_vm* vm, uint16_t instruction);
+void loadRegister(lc3_vm* vm, uint16_t instruction);
+void loadEffectiveAddress(lc3_vm* vm, uint16_t instruction);
+void not(lc3_vm* vm, uint16_t instruction);
+void store(lc3_vm* vm, uint16_t instruction);
+void storeIndirect(lc3_vm* vm, uint16_t instruction);
+void storeRegister(lc3_vm* vm, uint16_t instruction);
+void trapGetC(lc3_vm* vm);
+void trapHalt(lc3_vm* vm);
+void trapIn(lc3_vm* vm);
+void trapOut(lc3_vm* vm);
+void trapPuts(lc3_vm* vm);
+void trapPutSP(lc3_vm* vm);
+void trap(lc3_vm* vm, uint16_t instruction);
 
 #endif
\ No newline at end of file
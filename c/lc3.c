@@ -6,214 +6,413 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <getopt.h>
+#include <time.h>
 
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/termios.h>
 #include <sys/mman.h>
 
+#include "../core/assembler.h"
 #include "../core/bit-utilities.h"
 #include "../core/core.h"
+#include "../core/disassembler.h"
 #include "../core/input-buffering.h"
-#include "../core/read-image.h"
-
-#include "instruction-set.h"
-
-// Standard fetch/execute cycle using switch statement
-void fetchExecute() {
-  /* FETCH */
-  uint16_t instruction = mem_read(registers[R_PC]++);
-  uint16_t opcode = instruction >> 12;
-
-  switch (opcode) {
-  case OP_ADD:
-    add(instruction);      
-    break;
-  case OP_AND:
-    and(instruction);
-    break;
-  case OP_NOT:
-    not(instruction);
-    break;
-  case OP_BR:
-    branch(instruction);
-    break;
-  case OP_JMP:
-    jump(instruction);
-    break;
-  case OP_JSR:
-    jumpToSubroutine(instruction);
-    break;
-  case OP_LD:
-    load(instruction);
-    break;
-  case OP_LDI:
-    loadIndirect(instruction);
-    break;
-  case OP_LDR:
-    loadRegister(instruction);
-    break;
-  case OP_LEA:
-    loadEffectiveAddress(instruction);
-    break;
-  case OP_ST:
-    store(instruction);
-    break;
-  case OP_STI:
-    storeIndirect(instruction);
-    break;
-  case OP_STR:
-    storeRegister(instruction);
-    break;
-  case OP_TRAP:
-    trap(instruction);
-    break;
-  case OP_RES:
-    abort();
-    break;
-  case OP_RTI:
-    abort();
-    break;
-  default:
-    // Bad opcode
-    printf("BAD OPCODE\n");
-    break;
+#include "../core/loader.h"
+#include "../core/engine.h"
+#include "../core/watch.h"
+
+#include "fetch-execute.h"
+#include "gdb-stub.h"
+#include "history.h"
+#include "profile.h"
+#include "stats.h"
+#include "threaded.h"
+#include "trace.h"
+
+/* The machine */
+static lc3_vm vm;
+
+/* Debugger connection, when listening */
+static gdb_stub stub;
+
+/* Engines -e can pick, the default first */
+static const lc3_engine engines[] = {
+  { "goto", fetchExecuteComputedGoto },
+  { "switch", fetchExecuteLoop },
+  { "threaded", fetchExecuteThreaded }
+};
+
+static const lc3_engine* find_engine(const char* name) {
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+    if (!strcmp(engines[i].name, name)) {
+      return &engines[i];
+    }
   }
+  return NULL;
 }
 
-// Alternate fetch/execute using computed GOTO
-// This method supposedly uses less branching by
-// eliminating the outer while loop
-// Each instruction should use only one JMP instruction
-// instead of two, which should make the execution faster
-// However, compiler optimizations may make the 
-// execution times of both approaches approximately the same.
-// I have not personally instrumented the code to determine
-// if the computed GOTO method offers any advantages
-// See: https://eli.thegreenplace.net/2012/07/12/computed-goto-for-efficient-dispatch-tables
-// Also: https://news.ycombinator.com/item?id=18678699
-#define DISPATCH() {\
-  currentInstruction = mem_read(registers[R_PC]++);\
-  uint16_t opcode = currentInstruction >> 12;\
-  goto *dispatch_table[opcode];\
+/* Labels for traces and reports */
+static lc3_symbols symbols;
+
+/* Run report, if asked for */
+static const char* report_path;
+static double load_seconds;
+static double run_start;
+static double run_seconds;
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
 }
 
-void fetchExecuteComputedGoto() {
-
-  // NOTE: THE ORDER OF THIS TABLE
-  // MUST MATCH THE ORDER OF THE INSTRUCTIONS
-  // IN instruction-set.h
-  // i.e. OP_BR must be at index 0 etc.
-  static void *dispatch_table[] = {
-    &&OP_BR, 
-    &&OP_ADD, 
-    &&OP_LD, 
-    &&OP_ST,
-    &&OP_JSR, 
-    &&OP_AND, 
-    &&OP_LDR, 
-    &&OP_STR,
-    &&OP_RTI, 
-    &&OP_NOT, 
-    &&OP_LDI, 
-    &&OP_STI, 
-    &&OP_JMP, 
-    &&OP_RES, 
-    &&OP_LEA, 
-    &&OP_TRAP
-  };
-
-  uint16_t currentInstruction;
-
-  DISPATCH();
-
-  OP_ADD:
-    add(currentInstruction);
-    DISPATCH();
-  OP_AND:
-    and(currentInstruction);
-    DISPATCH();
-  OP_NOT:
-    not(currentInstruction);
-    DISPATCH();
-  OP_BR:
-    branch(currentInstruction);
-    DISPATCH();
-  OP_JMP:
-    jump(currentInstruction);
-    DISPATCH();
-  OP_JSR:
-    jumpToSubroutine(currentInstruction);
-    DISPATCH();
-  OP_LD:
-    load(currentInstruction);
-    DISPATCH();
-  OP_LDI:
-    loadIndirect(currentInstruction);
-    DISPATCH();
-  OP_LDR:
-    loadRegister(currentInstruction);
-    DISPATCH();
-  OP_LEA:
-    loadEffectiveAddress(currentInstruction);
-    DISPATCH();
-  OP_ST:
-    store(currentInstruction);
-    DISPATCH();
-  OP_STI:
-    storeIndirect(currentInstruction);
-    DISPATCH();
-  OP_STR:
-    storeRegister(currentInstruction);
-    DISPATCH();
-  OP_TRAP:
-    trap(currentInstruction);
-    DISPATCH();
-  OP_RES:
-    abort();
-    DISPATCH();
-  OP_RTI:
-    abort();
-    DISPATCH();
+// Written at exit, so an interrupted run is reported too
+static void write_report() {
+  if (!report_path) {
+    return;
+  }
+
+  FILE* out = strcmp(report_path, "-") ? fopen(report_path, "w") : stderr;
+  if (!out) {
+    fprintf(stderr, "failed to write report: %s\n", report_path);
+    return;
+  }
+  if (run_start && !run_seconds) {
+    run_seconds = now() - run_start;
+  }
+  stats_report_json(out, &vm, load_seconds, run_seconds);
+  if (out != stderr) {
+    fclose(out);
+  }
+  report_path = NULL;
+}
+
+// Parse an address in C (0x3000) or LC-3 (x3000) notation
+static int parse_address(const char* text, uint16_t* address, char** end) {
+  if (*text == 'x' || *text == 'X') {
+    ++text;
+    *address = (uint16_t) strtoul(text, end, 16);
+  }
+  else {
+    *address = (uint16_t) strtoul(text, end, 0);
+  }
+  return *end != text;
+}
+
+// Arm a watchpoint given as first[-last][:r|w|a]
+static int parse_watchpoint(const char* text) {
+  uint16_t first;
+  uint16_t last;
+  int kind = WATCH_WRITE;
+  char* end;
+
+  if (!parse_address(text, &first, &end)) {
+    return 0;
+  }
+  last = first;
+
+  if (*end == '-' && !parse_address(end + 1, &last, &end)) {
+    return 0;
+  }
+
+  if (*end == ':') {
+    switch (end[1]) {
+      case 'r': kind = WATCH_READ; break;
+      case 'w': kind = WATCH_WRITE; break;
+      case 'a': kind = WATCH_ACCESS; break;
+      default: return 0;
+    }
+    end += 2;
+  }
+  return *end == 0 && watch_add(&vm, first, last, kind) >= 0;
 }
 
+// Log a watchpoint or breakpoint hit
+static void report_hit(const lc3_vm* vm) {
+  const watch_hit* hit = &vm->debug->hit;
+  char line[DISASSEMBLY_LINE_MAX];
+
+  disassemble_line(hit->pc, vm->memory[hit->pc], &symbols, line);
+
+  if (hit->kind == WATCH_BREAKPOINT) {
+    fprintf(stderr, "break: %s\n", line);
+  }
+  else {
+    fprintf(stderr, "watch: %s x%04X = x%04X by %s\n",
+            hit->kind == WATCH_READ ? "read" : "write", hit->address, hit->value, line);
+  }
+}
+
+// Show where the machine faulted and its registers
+static void report_fault(const lc3_vm* vm) {
+  uint16_t pc = vm->registers[R_PC] - 1;
+  char line[DISASSEMBLY_LINE_MAX];
+
+  disassemble_line(pc, vm->memory[pc], &symbols, line);
+  fprintf(stderr, "fault: %s\n", line);
+
+  for (int r = R_R0; r <= R_R7; ++r) {
+    fprintf(stderr, "  R%d x%04X", r, vm->registers[r]);
+  }
+  fprintf(stderr, "\n  PC x%04X  COND x%04X\n", vm->registers[R_PC], vm->registers[R_COND]);
+}
+
+// Assemble a source file into an image file
+static int write_image(const char* path, const char* output_path) {
+  asm_result result;
+
+  if (!assemble_file(path, vm.memory, NULL, &result)) {
+    if (result.error_line) {
+      printf("%s:%d: %s\n", path, result.error_line, result.error);
+    }
+    else {
+      printf("%s: %s\n", path, result.error);
+    }
+    return 0;
+  }
+
+  if (result.segment_count != 1) {
+    printf("%s: an image holds one .ORIG block, found %d\n", path, result.segment_count);
+    return 0;
+  }
+
+  uint8_t* image = (uint8_t*) malloc(2 * (result.segments[0].length + 1));
+  FILE* file = fopen(output_path, "wb");
+  size_t length = image ? asm_segment_image(vm.memory, &result.segments[0], image) : 0;
+  int written = image && file && fwrite(image, 1, length, file) == length;
+
+  if (file && fclose(file) != 0) {
+    written = 0;
+  }
+  if (!written) {
+    printf("failed to write image: %s\n", output_path);
+  }
+  free(image);
+  return written;
+}
+
+static void usage() {
+  printf("lc3 [-e goto|switch|threaded] [-g [host]:port|socket-path [-R interval]] [-w first[-last][:r|w|a]]\n"
+         "    [-b address] [-s symbol-file] [-t trace-file] [-p] [-m] [-r report-file] [image-file1] ...\n");
+  printf("lc3 --asm [options] source-file1 ...\n");
+  printf("lc3 --asm -o image-file source-file\n");
+  exit(2);
+}
+
+static const struct option long_options[] = {
+  { "asm", no_argument, NULL, 'a' },
+  { NULL, 0, NULL, 0 }
+};
+
 /* MAIN */
-int main(int argc, const char* argv[]) {
+int main(int argc, char* argv[]) {
+
+  if (!vm_init(&vm)) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+
+  const lc3_engine* engine = &engines[0];
+  int engine_chosen = 0;
+  const char* gdb_address = NULL;
+  const char* output_path = NULL;
+  const char* trace_path = NULL;
+  int assemble_sources = 0;
+  int profile = 0;
+  int show_segments = 0;
+  int record = 0;
+  uint64_t history_interval = 0;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "e:g:R:w:b:o:s:t:pmr:", long_options, NULL)) != -1) {
+    uint16_t address;
+    char* end;
+
+    switch (option) {
+      case 'a':
+        assemble_sources = 1;
+        break;
+      case 'e':
+        if (!(engine = find_engine(optarg))) {
+          printf("unknown engine: %s\n", optarg);
+          exit(2);
+        }
+        engine_chosen = 1;
+        break;
+      case 'R':
+        record = 1;
+        history_interval = strtoull(optarg, NULL, 0);
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'g':
+        gdb_address = optarg;
+        break;
+      case 's':
+        if (!symbols_load(&symbols, optarg)) {
+          printf("failed to load symbols: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case 't':
+        trace_path = optarg;
+        break;
+      case 'p':
+        profile = 1;
+        break;
+      case 'm':
+        show_segments = 1;
+        break;
+      case 'r':
+        report_path = optarg;
+        break;
+      case 'w':
+        if (!parse_watchpoint(optarg)) {
+          printf("bad watchpoint: %s\n", optarg);
+          exit(2);
+        }
+        break;
+      case 'b':
+        if (!parse_address(optarg, &address, &end) || *end || !break_add(&vm, address)) {
+          printf("bad breakpoint: %s\n", optarg);
+          exit(2);
+        }
+        break;
+      default:
+        usage();
+    }
+  }
 
-  if (argc < 2) {
+  if (optind >= argc || (output_path && (!assemble_sources || argc - optind != 1))) {
     /* show usage string */
-    printf("lc3 [image-file1] ...\n");
+    usage();
+  }
+
+  if (output_path) {
+    exit(write_image(argv[optind], output_path) ? 0 : 1);
+  }
+
+  // Counting steps the switch engine, so a report cannot time another
+  if (report_path && engine_chosen) {
+    printf("-r counts with the switch engine and cannot be combined with -e\n");
     exit(2);
   }
 
-  for (int j = 1; j < argc; ++j) {
-    if (!read_image(argv[j], memory)) {
-      printf("failed to load image: %s\n", argv[j]);
+  // Read everything first, so overlapping images are caught before
+  // any of them is loaded
+  double load_start = now();
+  lc3_loader loader;
+  loader_init(&loader);
+
+  for (int j = optind; j < argc; ++j) {
+    int loaded = assemble_sources ? loader_add_source(&loader, argv[j], &symbols)
+                                  : loader_add_image(&loader, argv[j]);
+    if (!loaded) {
+      printf("failed to load: %s\n", loader.error);
       exit(1);
     }
   }
 
+  if (show_segments) {
+    loader_print(&loader, stderr);
+  }
+  loader_install(&loader, &vm);
+  load_seconds = now() - load_start;
+
+  // Tracing and profiling wrap the engine; profiling both samples
+  // the traced run
+  engine_run run = engine->run;
+  FILE* trace_file = NULL;
+
+  if (report_path) {
+    stats_start(&vm);
+    run = run_counted;
+    atexit(write_report);
+  }
+
+  if (trace_path) {
+    trace_file = strcmp(trace_path, "-") ? fopen(trace_path, "w") : stderr;
+    if (!trace_file) {
+      printf("failed to open trace file: %s\n", trace_path);
+      exit(1);
+    }
+    trace_start(trace_file, run, &symbols);
+    run = run_traced;
+  }
+  if (profile) {
+    profile_start(run);
+    run = run_profiled;
+  }
+
+  // Recording is outermost, so replay goes through the same engine
+  if (record) {
+    if (!history_start(&vm, run, history_interval)) {
+      printf("failed to allocate history\n");
+      exit(1);
+    }
+    run = run_recorded;
+  }
+
+  if (gdb_address) {
+    if (!gdb_stub_listen(&stub, &vm, run, gdb_address)) {
+      printf("failed to listen for gdb on %s\n", gdb_address);
+      exit(1);
+    }
+    fprintf(stderr, "gdb: listening on %s\n", gdb_address);
+  }
+
   signal(SIGINT, handle_interrupt);
   disable_input_buffering();
-
-  /* Set the Program Counter to the default address:
-  0x3000
-  
-  Lower addresses are left empty to leave space 
-  for trap routines
-  */
-  enum { PC_START = 0x3000 };
-  registers[R_PC] = PC_START;
+  run_start = now();
 
   // Fetch/Execute using switch statements
   /*
-  while (1) {
-    fetchExecute();
-  }// end while
+  while (fetchExecuteLoop(&vm, RUN_FOREVER), vm.status == VM_BREAK) {
+    report_hit(&vm);
+    vm_resume(&vm);
+  }
   //*/
 
   // Fetch/Execute using computed GOTO
-  fetchExecuteComputedGoto();
+  // Watchpoint and breakpoint hits are logged and execution continues
+  if (gdb_address) {
+    while (gdb_stub_run(&stub), vm.status == VM_BREAK) {
+      report_hit(&vm);
+      vm_resume(&vm);
+    }
+    gdb_stub_close(&stub);
+  }
+  else {
+    while (run(&vm, RUN_FOREVER), vm.status == VM_BREAK) {
+      report_hit(&vm);
+      vm_resume(&vm);
+    }
+  }
 
+  run_seconds = now() - run_start;
   restore_input_buffering();
+
+  if (trace_file && trace_file != stderr) {
+    fclose(trace_file);
+  }
+  if (profile) {
+    profile_report(stderr, &vm, &symbols, &loader, 20);
+    profile_free();
+  }
+
+  if (vm.status == VM_FAULT) {
+    report_fault(&vm);
+    write_report();
+    abort();
+  }
+  if (record) {
+    history_free();
+  }
+  loader_free(&loader);
+  symbols_free(&symbols);
+  vm_free(&vm);
+  return 0;
 }
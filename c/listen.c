@@ -0,0 +1,89 @@
+#include "listen.h"
+
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+_Static_assert(LISTEN_PATH_SIZE == sizeof(((struct sockaddr_un*) 0)->sun_path), "socket path size");
+
+static int listen_unix(const char* path, int backlog) {
+  struct sockaddr_un address;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  unlink(path);
+  if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(fd, backlog) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int listen_tcp(const char* address, int backlog) {
+  const char* colon = strrchr(address, ':');
+  char host[256] = "127.0.0.1";
+  const char* port = colon ? colon + 1 : address;
+
+  if (colon && colon != address) {
+    size_t length = colon - address;
+    if (length >= sizeof(host)) {
+      return -1;
+    }
+    memcpy(host, address, length);
+    host[length] = 0;
+  }
+
+  struct addrinfo hints;
+  struct addrinfo* results;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  if (getaddrinfo(host, port, &hints, &results) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, backlog) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(results);
+  return fd;
+}
+
+int listen_address(const char* address, int backlog, char socket_path[LISTEN_PATH_SIZE]) {
+  socket_path[0] = 0;
+  if (!strchr(address, '/')) {
+    return listen_tcp(address, backlog);
+  }
+
+  int fd = listen_unix(address, backlog);
+  if (fd >= 0) {
+    strcpy(socket_path, address);
+  }
+  return fd;
+}
@@ -0,0 +1,13 @@
+#ifndef _LISTEN
+#define _LISTEN
+
+/* Size of a Unix socket path, terminator included */
+enum { LISTEN_PATH_SIZE = 108 };
+
+/* Listen on address: [host]:port for TCP (loopback by default) or a
+path for a Unix socket. For a Unix socket the path is copied to
+socket_path, for the caller to unlink when done; otherwise
+socket_path is left empty. Returns the socket, or -1 on failure */
+int listen_address(const char* address, int backlog, char socket_path[LISTEN_PATH_SIZE]);
+
+#endif
@@ -0,0 +1,416 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../core/bit-utilities.h"
+#include "../core/core.h"
+#include "../core/opcodes.h"
+
+#include "fetch-execute.h"
+#include "instruction-set.h"
+#include "lockstep.h"
+
+/* One register of every lane. GCC and Clang vector extensions: a
+single AVX2 instruction where the CPU has it, two SSE2 ones otherwise */
+typedef uint16_t lane_vector __attribute__((vector_size(LOCKSTEP_LANES * sizeof(uint16_t))));
+typedef int16_t signed_lane_vector __attribute__((vector_size(LOCKSTEP_LANES * sizeof(uint16_t))));
+
+typedef uint32_t lane_set;   /* bit i: lane i */
+
+typedef struct lockstep_group {
+  lane_vector registers[R_COUNT];   /* the PC too: lanes may wait at different PCs */
+  lane_vector executed;             /* per lane, this slice */
+  lc3_vm* vms[LOCKSTEP_LANES];
+  lane_set active;
+  lane_set fell;
+  int count;
+} lockstep_group;
+
+_Static_assert(LOCKSTEP_LANES <= 16, "lane masks are built from 16-bit lane bits");
+_Static_assert(LOCKSTEP_SLICE < 1 << 16, "per lane counts are 16-bit");
+
+static const lane_vector lane_bits = {
+  1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7,
+  1 << 8, 1 << 9, 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, 1 << 15
+};
+
+#define FOR_EACH_LANE(i, set) \
+  for (lane_set lanes_ = (set), i = 0; lanes_ && (i = __builtin_ctz(lanes_), 1); lanes_ &= lanes_ - 1)
+
+/* Vectors are passed by pointer: by value, their ABI depends on AVX */
+#define BROADCAST(value) ((lane_vector) {} + (uint16_t) (value))
+
+/* All ones in the lanes of set */
+#define LANE_MASK(set) ((lane_vector) ((lane_bits & (uint16_t) (set)) != 0))
+
+/* a in the lanes of mask, b elsewhere */
+#define SELECT(mask, a, b) (((a) & (mask)) | ((b) & ~(mask)))
+
+// Write a register in the running lanes and set their flags from it
+static inline void set_register(lane_vector* registers, unsigned r, const lane_vector* value, const lane_vector* mask) {
+  lane_vector zero = (lane_vector) (*value == 0);
+  lane_vector negative = (lane_vector) ((signed_lane_vector) *value < 0);
+  lane_vector flags = (zero & FL_ZRO) | (negative & FL_NEG) | (~(zero | negative) & FL_POS);
+
+  registers[r] = SELECT(*mask, *value, registers[r]);
+  registers[R_COND] = SELECT(*mask, flags, registers[R_COND]);
+}
+
+static inline int all_zero(const lane_vector* value) {
+  uint64_t words[sizeof(lane_vector) / sizeof(uint64_t)];
+  uint64_t any = 0;
+
+  memcpy(words, value, sizeof(words));
+  for (size_t k = 0; k < sizeof(words) / sizeof(uint64_t); ++k) {
+    any |= words[k];
+  }
+  return !any;
+}
+
+// Lanes of set whose element of value is not the one given
+static inline lane_set lanes_not_equal(const lane_vector* value, uint16_t expected, lane_set set) {
+  lane_set differ = 0;
+  FOR_EACH_LANE(i, set) {
+    if ((*value)[i] != expected) {
+      differ |= 1u << i;
+    }
+  }
+  return differ;
+}
+
+// Copy lanes back to their VMs and take them out of the group
+static void leave(lockstep_group* group, lane_set lanes) {
+  FOR_EACH_LANE(i, lanes) {
+    lc3_vm* vm = group->vms[i];
+    for (int r = 0; r < R_COUNT; ++r) {
+      vm->registers[r] = group->registers[r][i];
+    }
+  }
+  group->active &= ~lanes;
+}
+
+// A lane's VM, its PC past the instruction as a memory access or trap
+// may read it
+static inline lc3_vm* lane_vm(lockstep_group* group, int i, uint16_t next) {
+  lc3_vm* vm = group->vms[i];
+  vm->registers[R_PC] = next;
+  return vm;
+}
+
+// The lane's bit if its VM stopped, waiting on a device register or
+// for input, halting or hitting a watchpoint
+static inline lane_set lane_stopped(const lc3_vm* vm, int i) {
+  return vm->status != VM_RUNNING ? 1u << i : 0;
+}
+
+// Lanes that cannot run with the group, left to run alone
+static void fall_out(lockstep_group* group, lane_set lanes) {
+  leave(group, lanes);
+  group->fell |= lanes;
+}
+
+// Run a group of lanes for at most slice steps. Each step, the lanes
+// at the lowest PC execute and the others wait for them: after a
+// forward branch splits the group, the lanes that did not jump catch
+// up with the ones that did and the group runs as one again.
+// Returns the steps taken
+__attribute__((target_clones("avx2", "default")))
+static uint64_t run_group(lockstep_group* group, uint64_t slice) {
+  lane_vector* registers = group->registers;
+  uint64_t step = 0;
+
+  // While every lane is at the same PC, there is no need to search
+  int converged = 1;
+
+  for (; step < slice && group->active; ++step) {
+    lane_set active = group->active;
+    lane_set run = active;
+    uint16_t pc = registers[R_PC][__builtin_ctz(active)];
+
+    if (!converged) {
+      pc = UINT16_MAX;
+      FOR_EACH_LANE(i, active) {
+        if (registers[R_PC][i] < pc) {
+          pc = registers[R_PC][i];
+        }
+      }
+      run = active & ~lanes_not_equal(&registers[R_PC], pc, active);
+      converged = run == active;
+    }
+
+    // The keyboard status register is read on fetch; let the lanes do that alone
+    if (pc == MR_KBSR) {
+      fall_out(group, run);
+      continue;
+    }
+
+    // FETCH: lanes whose code differs here fall out before executing
+    uint16_t instruction = group->vms[__builtin_ctz(run)]->memory[pc];
+    lane_set differ = 0;
+    FOR_EACH_LANE(i, run) {
+      if (group->vms[i]->memory[pc] != instruction) {
+        differ |= 1u << i;
+      }
+    }
+    fall_out(group, differ);
+    run &= ~differ;
+
+    const lane_vector mask = LANE_MASK(run);
+    uint16_t next = pc + 1;
+    unsigned r0 = (instruction >> 9) & 0x7;
+    unsigned r1 = (instruction >> 6) & 0x7;
+    uint16_t pcPlusOffset = next + sign_extend(instruction & 0x1FF, 9);
+    lane_vector value;
+    lane_set stopped = 0;
+
+    registers[R_PC] = SELECT(mask, BROADCAST(next), registers[R_PC]);
+    group->executed += mask & 1;
+
+    switch (instruction >> 12) {
+      case OP_ADD:
+        value = registers[r1] + (instruction & 0x20 ? BROADCAST(sign_extend(instruction & 0x1F, 5))
+                                                    : registers[instruction & 0x7]);
+        set_register(registers, r0, &value, &mask);
+        break;
+
+      case OP_AND:
+        value = registers[r1] & (instruction & 0x20 ? BROADCAST(sign_extend(instruction & 0x1F, 5))
+                                                    : registers[instruction & 0x7]);
+        set_register(registers, r0, &value, &mask);
+        break;
+
+      case OP_NOT:
+        value = ~registers[r1];
+        set_register(registers, r0, &value, &mask);
+        break;
+
+      case OP_LEA:
+        value = BROADCAST(pcPlusOffset);
+        set_register(registers, r0, &value, &mask);
+        break;
+
+      case OP_BR: {
+        lane_vector taken = mask & (lane_vector) ((registers[R_COND] & (uint16_t) r0) != 0);
+        lane_vector not_taken = taken ^ mask;
+        registers[R_PC] = SELECT(taken, BROADCAST(pcPlusOffset), registers[R_PC]);
+        converged = converged && (all_zero(&taken) || all_zero(&not_taken));
+        break;
+      }
+
+      case OP_JMP: {
+        lane_vector apart = (registers[r1] ^ BROADCAST(registers[r1][__builtin_ctz(run)])) & mask;
+        registers[R_PC] = SELECT(mask, registers[r1], registers[R_PC]);
+        converged = converged && all_zero(&apart);
+        break;
+      }
+
+      case OP_JSR: {
+        // Read the target before R7 is written: JSRR R7 jumps to the old R7
+        lane_vector target = instruction & 0x0800 ? BROADCAST(next + sign_extend(instruction & 0x7FF, 11))
+                                                  : registers[r1];
+        lane_vector apart = (target ^ BROADCAST(target[__builtin_ctz(run)])) & mask;
+        registers[R_R7] = SELECT(mask, BROADCAST(next), registers[R_R7]);
+        registers[R_PC] = SELECT(mask, target, registers[R_PC]);
+        converged = converged && all_zero(&apart);
+        break;
+      }
+
+      // Loads and stores may stop a lane (a KBSR or mailbox status
+      // read on a non-blocking console), which then leaves
+      case OP_LD:
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          value[i] = mem_read(vm, pcPlusOffset);
+          stopped |= lane_stopped(vm, i);
+        }
+        set_register(registers, r0, &value, &mask);
+        break;
+
+      case OP_LDI:
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          value[i] = mem_read(vm, mem_read(vm, pcPlusOffset));
+          stopped |= lane_stopped(vm, i);
+        }
+        set_register(registers, r0, &value, &mask);
+        break;
+
+      case OP_LDR: {
+        lane_vector address = registers[r1] + BROADCAST(sign_extend(instruction & 0x3F, 6));
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          value[i] = mem_read(vm, address[i]);
+          stopped |= lane_stopped(vm, i);
+        }
+        set_register(registers, r0, &value, &mask);
+        break;
+      }
+
+      case OP_ST:
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          mem_write(vm, pcPlusOffset, registers[r0][i]);
+          stopped |= lane_stopped(vm, i);
+        }
+        break;
+
+      case OP_STI:
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          mem_write(vm, mem_read(vm, pcPlusOffset), registers[r0][i]);
+          stopped |= lane_stopped(vm, i);
+        }
+        break;
+
+      case OP_STR: {
+        lane_vector address = registers[r1] + BROADCAST(sign_extend(instruction & 0x3F, 6));
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          mem_write(vm, address[i], registers[r0][i]);
+          stopped |= lane_stopped(vm, i);
+        }
+        break;
+      }
+
+      case OP_TRAP:
+        // Each lane has its own console; lanes that halt or wait
+        // for input (with the PC back on the TRAP) leave
+        FOR_EACH_LANE(i, run) {
+          lc3_vm* vm = lane_vm(group, i, next);
+          vm->registers[R_R0] = registers[R_R0][i];
+          trap(vm, instruction);
+          registers[R_R0][i] = vm->registers[R_R0];
+          registers[R_PC][i] = vm->registers[R_PC];
+          stopped |= lane_stopped(vm, i);
+        }
+        break;
+
+      default:
+        // RTI and RES
+        FOR_EACH_LANE(i, run) {
+          group->vms[i]->status = VM_FAULT;
+        }
+        leave(group, run);
+        break;
+    }
+    leave(group, stopped);
+  }
+
+  leave(group, group->active);
+  return step;
+}
+
+/* SCHEDULING */
+/* Lanes are grouped by PC and the instruction there, so lanes whose
+code was patched differently do not share a group */
+typedef struct lane_entry {
+  uint32_t key;         /* PC << 16 | instruction */
+  int index;
+} lane_entry;
+
+static int compare_key(const void* a, const void* b) {
+  const lane_entry* x = (const lane_entry*) a;
+  const lane_entry* y = (const lane_entry*) b;
+  if (x->key != y->key) {
+    return x->key < y->key ? -1 : 1;
+  }
+  return x->index - y->index;
+}
+
+// A VM on its own, through the fastest scalar engine
+static uint64_t run_alone(lc3_vm* vm, uint64_t* remaining, uint64_t slice) {
+  uint64_t executed = fetchExecuteComputedGoto(vm, slice < *remaining ? slice : *remaining);
+  *remaining -= executed;
+  return executed;
+}
+
+uint64_t lockstep_run(lc3_vm* vms[], int count, uint64_t budget, lockstep_stats* stats) {
+  uint64_t* remaining = (uint64_t*) malloc(count * sizeof(uint64_t));
+  lane_entry* order = (lane_entry*) malloc(count * sizeof(lane_entry));
+  lockstep_stats totals = { 0, 0, 0, 0 };
+  lockstep_group group;
+
+  if (!remaining || !order) {
+    free(remaining);
+    free(order);
+    return 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    remaining[i] = budget;
+  }
+
+  for (;;) {
+    // Regroup the running VMs by PC and instruction
+    int running = 0;
+    for (int i = 0; i < count; ++i) {
+      if (vms[i]->status == VM_RUNNING && remaining[i]) {
+        uint16_t pc = vms[i]->registers[R_PC];
+        order[running].key = (uint32_t) pc << 16 | vms[i]->memory[pc];
+        order[running].index = i;
+        ++running;
+      }
+    }
+    if (!running) {
+      break;
+    }
+    qsort(order, running, sizeof(lane_entry), compare_key);
+
+    for (int start = 0, end; start < running; start = end) {
+      int lane_index[LOCKSTEP_LANES];
+      uint64_t slice = LOCKSTEP_SLICE;
+
+      group.count = 0;
+      for (end = start; end < running && order[end].key == order[start].key && group.count < LOCKSTEP_LANES; ++end) {
+        int i = order[end].index;
+        lc3_vm* vm = vms[i];
+
+        if (vm->watched_pages | vm->break_pages) {
+          totals.alone += run_alone(vm, &remaining[i], LOCKSTEP_SLICE);
+          continue;
+        }
+        for (int r = 0; r < R_COUNT; ++r) {
+          group.registers[r][group.count] = vm->registers[r];
+        }
+        lane_index[group.count] = i;
+        group.vms[group.count++] = vm;
+        if (remaining[i] < slice) {
+          slice = remaining[i];
+        }
+      }
+
+      if (group.count == 1) {
+        totals.alone += run_alone(group.vms[0], &remaining[lane_index[0]], LOCKSTEP_SLICE);
+      }
+      if (group.count <= 1) {
+        continue;
+      }
+
+      group.executed = BROADCAST(0);
+      group.active = (1u << group.count) - 1;
+      group.fell = 0;
+      totals.issued += run_group(&group, slice);
+
+      // Lanes that fell out finish the slice alone
+      for (int k = 0; k < group.count; ++k) {
+        int i = lane_index[k];
+        remaining[i] -= group.executed[k];
+        totals.lockstep += group.executed[k];
+
+        if (group.fell & (1u << k)) {
+          ++totals.falls;
+          if (vms[i]->status == VM_RUNNING) {
+            totals.alone += run_alone(vms[i], &remaining[i], slice - group.executed[k]);
+          }
+        }
+      }
+    }
+  }
+
+  free(remaining);
+  free(order);
+
+  if (stats) {
+    *stats = totals;
+  }
+  return totals.lockstep + totals.alone;
+}
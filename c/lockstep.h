@@ -0,0 +1,41 @@
+#ifndef _LOCKSTEP
+#define _LOCKSTEP
+
+#include <stdint.h>
+
+#include "../core/core.h"
+
+/* Lockstep engine
+Runs many VMs that execute the same code, for batch runs of one image
+over many inputs. VMs at the same PC are grouped, LOCKSTEP_LANES at a
+time, and each instruction is executed once for the whole group: the
+registers are kept as one vector per register (a lane per VM), so
+ADD, AND, NOT and the flag updates are single vector operations.
+Memory accesses and traps stay per lane, on each VM's own memory and
+console.
+
+When a branch splits a group, the lanes at the lowest PC run while
+the others wait, so lanes that skipped ahead are caught up with and
+the group reconverges. A lane falls out of its group, and runs alone
+for the rest of the slice, only when its instruction word differs
+from the group's. Groups are formed again every slice.
+
+VMs with watchpoints or breakpoints always run alone.
+*/
+enum {
+  LOCKSTEP_LANES = 16,      /* 16-bit registers in a 256-bit vector */
+  LOCKSTEP_SLICE = 1 << 14  /* instructions between regrouping */
+};
+
+typedef struct lockstep_stats {
+  uint64_t lockstep;    /* lane instructions executed in a group of two or more */
+  uint64_t issued;      /* group steps; lockstep / issued is the lanes per step */
+  uint64_t alone;       /* lane instructions executed alone */
+  uint64_t falls;       /* lanes that fell out of a group */
+} lockstep_stats;
+
+/* Run every VM for at most budget instructions each, until it stops.
+Returns the instructions executed by all VMs; stats may be NULL */
+uint64_t lockstep_run(lc3_vm* vms[], int count, uint64_t budget, lockstep_stats* stats);
+
+#endif
@@ -0,0 +1,24 @@
+#include "metrics.h"
+
+#include <sys/resource.h>
+
+void metric_sample(FILE* out, const char* name, const char* labels, double value) {
+  if (labels) {
+    fprintf(out, "%s{%s} %.17g\n", name, labels, value);
+  }
+  else {
+    fprintf(out, "%s %.17g\n", name, value);
+  }
+}
+
+void metric_write(FILE* out, const char* name, const char* type, const char* help,
+                  const char* labels, double value) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  metric_sample(out, name, labels, value);
+}
+
+double metric_peak_resident_bytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss * 1024.0;
+}
@@ -0,0 +1,18 @@
+#ifndef _METRICS
+#define _METRICS
+
+#include <stdio.h>
+
+/* Prometheus text format
+One metric family per call: its HELP and TYPE lines, then a sample.
+labels, if not NULL, is the inside of the braces, e.g. reason="halted";
+metric_sample adds further samples to the family just written.
+*/
+void metric_write(FILE* out, const char* name, const char* type, const char* help,
+                  const char* labels, double value);
+void metric_sample(FILE* out, const char* name, const char* labels, double value);
+
+/* Peak resident memory of this process, in bytes */
+double metric_peak_resident_bytes();
+
+#endif
@@ -0,0 +1,129 @@
+/* Multiprocessor runner
+
+Runs the images on several vCPUs sharing one memory (see smp.h), each
+on a thread of its own. Every vCPU starts at PC_START with the same
+code; a guest tells them apart by MR_CPID.
+
+The vCPUs share the terminal as keyboard and display. A vCPU that
+halts stops alone; the run ends when every vCPU has stopped, failing
+if any faulted.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <pthread.h>
+
+#include "../core/core.h"
+#include "../core/engine.h"
+#include "../core/input-buffering.h"
+#include "../core/loader.h"
+#include "../core/smp.h"
+
+#include "fetch-execute.h"
+#include "threaded.h"
+
+/* Engines -e can pick, the default first */
+static const lc3_engine engines[] = {
+  { "goto", fetchExecuteComputedGoto },
+  { "switch", fetchExecuteLoop },
+  { "threaded", fetchExecuteThreaded }
+};
+
+static const lc3_engine* find_engine(const char* name) {
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+    if (!strcmp(engines[i].name, name)) {
+      return &engines[i];
+    }
+  }
+  return NULL;
+}
+
+static const lc3_engine* engine = &engines[0];
+
+static void* cpu_main(void* argument) {
+  lc3_vm* vm = (lc3_vm*) argument;
+  engine->run(vm, RUN_FOREVER);
+  return NULL;
+}
+
+static void usage() {
+  printf("lc3-smp [-e goto|switch|threaded] [-n cpus] image-file1 ...\n");
+  exit(2);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  int cpu_count = 2;
+
+  int option;
+  while ((option = getopt(argc, argv, "e:n:")) != -1) {
+    switch (option) {
+      case 'e':
+        if (!(engine = find_engine(optarg))) {
+          printf("unknown engine: %s\n", optarg);
+          exit(2);
+        }
+        break;
+      case 'n':
+        cpu_count = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (optind >= argc || cpu_count < 1 || cpu_count > SMP_MAX_CPUS) {
+    usage();
+  }
+
+  lc3_smp* smp = smp_create(cpu_count);
+  if (!smp) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+
+  // Memory is shared, so the images go in once
+  lc3_loader loader;
+  loader_init(&loader);
+  for (int j = optind; j < argc; ++j) {
+    if (!loader_add_image(&loader, argv[j])) {
+      printf("failed to load: %s\n", loader.error);
+      exit(1);
+    }
+  }
+  loader_install(&loader, &smp->cpus[0].vm);
+  loader_free(&loader);
+
+  signal(SIGINT, handle_interrupt);
+  disable_input_buffering();
+
+  pthread_t threads[SMP_MAX_CPUS];
+  for (int i = 0; i < cpu_count; ++i) {
+    if (pthread_create(&threads[i], NULL, cpu_main, &smp->cpus[i].vm) != 0) {
+      restore_input_buffering();
+      printf("failed to start vCPU threads\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < cpu_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  restore_input_buffering();
+
+  int faulted = 0;
+  for (int i = 0; i < cpu_count; ++i) {
+    lc3_vm* vm = &smp->cpus[i].vm;
+    if (vm->status == VM_FAULT) {
+      fprintf(stderr, "vCPU %d: fault at x%04X\n", i, (uint16_t) (vm->registers[R_PC] - 1));
+      faulted = 1;
+    }
+  }
+  smp_destroy(smp);
+  return faulted ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+/* Pipeline runner
+
+Runs one VM per stage, each loaded with its own images, connected by
+mailboxes (see mailbox.h) and spread over a few threads, each thread
+a scheduler (see scheduler.h). A stage is named by its image files,
+joined with commas when there are several.
+
+By default stage i sends to stage i + 1, its only outbox. With -a
+every stage can send to every stage, its outbox number being the
+stage number, so inboxes take words from many senders.
+
+The first stage reads standard input as its keyboard; every stage
+writes to standard output. A stage that halts or faults closes its
+port, so the next stage sees its inbox end once it is empty. The run
+ends when every stage has stopped, failing if any faulted.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/loader.h"
+#include "../core/mailbox.h"
+
+#include "fetch-execute.h"
+#include "scheduler.h"
+
+/* One stage and its guest */
+typedef struct stage {
+  lc3_guest guest;
+  fd_console console;
+  int id;
+} stage;
+
+static int faulted;
+
+static void stage_end(lc3_guest* guest) {
+  stage* s = (stage*) guest->context;
+  lc3_vm* vm = guest->vm;
+
+  if (vm->status == VM_FAULT) {
+    console_print(&vm->console, "\nFAULT\n");
+    __atomic_store_n(&faulted, 1, __ATOMIC_RELAXED);
+  }
+  vm->console.flush(vm->console.context);
+  if (vm->status != VM_HALTED) {
+    fprintf(stderr, "stage %d: %s\n", s->id, vm->status == VM_FAULT ? "fault" : "input ended");
+  }
+  mailbox_close(vm->mailbox);
+}
+
+static void* worker_main(void* argument) {
+  lc3_scheduler* scheduler = (lc3_scheduler*) argument;
+  if (!scheduler_run(scheduler)) {
+    perror("scheduler");
+    exit(1);
+  }
+  return NULL;
+}
+
+// Load the comma separated images of one stage
+static int stage_load(lc3_vm* vm, const char* images) {
+  char* paths = strdup(images);
+  char* rest = paths;
+  char* path;
+  lc3_loader loader;
+  int ok = 1;
+
+  loader_init(&loader);
+  while (ok && (path = strsep(&rest, ","))) {
+    if (*path && !loader_add_image(&loader, path)) {
+      printf("failed to load: %s\n", loader.error);
+      ok = 0;
+    }
+  }
+  if (ok) {
+    loader_install(&loader, vm);
+  }
+  loader_free(&loader);
+  free(paths);
+  return ok;
+}
+
+static void usage() {
+  printf("lc3-pipeline [-j threads] [-q mailbox-words] [-a] stage-images1 stage-images2 ...\n");
+  exit(2);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int thread_count = 0;
+  int capacity = 1024;
+  int all_to_all = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "j:q:a")) != -1) {
+    switch (option) {
+      case 'j':
+        thread_count = atoi(optarg);
+        break;
+      case 'q':
+        capacity = atoi(optarg);
+        break;
+      case 'a':
+        all_to_all = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  int stage_count = argc - optind;
+  if (stage_count < 1 || stage_count > MAILBOX_MAX_PORTS || thread_count < 0 || capacity < 1) {
+    usage();
+  }
+  if (!thread_count) {
+    thread_count = cpus > 0 && cpus < stage_count ? (int) cpus : stage_count;
+  }
+  if (thread_count > stage_count) {
+    thread_count = stage_count;
+  }
+
+  mailbox_network* network = mailbox_network_create(stage_count, (uint32_t) capacity);
+  stage* stages = (stage*) calloc(stage_count, sizeof(stage));
+  lc3_scheduler* workers = (lc3_scheduler*) calloc(thread_count, sizeof(lc3_scheduler));
+  if (!network || !stages || !workers) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+
+  for (int i = 0; i < stage_count; ++i) {
+    for (int j = 0; j < stage_count; ++j) {
+      if (all_to_all || j == i + 1) {
+        mailbox_connect(network, i, j);
+      }
+    }
+  }
+
+  for (int i = 0; i < thread_count; ++i) {
+    if (!scheduler_init(&workers[i], fetchExecuteComputedGoto)) {
+      printf("failed to start worker threads\n");
+      exit(1);
+    }
+  }
+
+  for (int i = 0; i < stage_count; ++i) {
+    stage* s = &stages[i];
+    lc3_vm* vm = vm_create();
+    if (!vm) {
+      printf("failed to allocate memory\n");
+      exit(1);
+    }
+    if (!stage_load(vm, argv[optind + i])) {
+      exit(1);
+    }
+
+    s->id = i;
+    vm->console = fd_console_make(&s->console, i == 0 ? STDIN_FILENO : -1, STDOUT_FILENO);
+    mailbox_attach(vm, &network->ports[i]);
+    s->guest.vm = vm;
+    s->guest.input_fd = i == 0 ? STDIN_FILENO : -1;
+    s->guest.wake_fd = network->ports[i].wake_fd;
+    s->guest.stopped = stage_end;
+    s->guest.context = s;
+    if (!scheduler_add(&workers[i % thread_count], &s->guest)) {
+      printf("failed to start stage %d\n", i);
+      exit(1);
+    }
+  }
+
+  pthread_t* threads = (pthread_t*) calloc(thread_count, sizeof(pthread_t));
+  for (int i = 0; i < thread_count; ++i) {
+    if (!threads || pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+      printf("failed to start worker threads\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < thread_count; ++i) {
+    scheduler_free(&workers[i]);
+  }
+  for (int i = 0; i < stage_count; ++i) {
+    vm_destroy(stages[i].guest.vm);
+  }
+  mailbox_network_free(network);
+  free(threads);
+  free(workers);
+  free(stages);
+  return faulted ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#include "profile.h"
+
+#include <stdlib.h>
+
+static engine_run profile_run;
+static uint64_t* samples;
+static uint64_t sample_count;
+static uint32_t random_state = 0x9E3779B9;
+
+void profile_start(engine_run run) {
+  profile_run = run;
+  samples = (uint64_t*) calloc(MEMORY_SIZE, sizeof(uint64_t));
+  sample_count = 0;
+}
+
+// xorshift32
+static uint32_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+uint64_t run_profiled(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint64_t chunk = PROFILE_INTERVAL / 2 + next_random() % PROFILE_INTERVAL;
+    if (chunk > budget - executed) {
+      chunk = budget - executed;
+    }
+
+    executed += profile_run(vm, chunk);
+
+    if (samples && vm->status == VM_RUNNING) {
+      ++samples[vm->registers[R_PC]];
+      ++sample_count;
+    }
+  }
+  return executed;
+}
+
+void profile_report(FILE* out, const lc3_vm* vm, const lc3_symbols* symbols,
+                    const lc3_loader* loader, int top) {
+  char line[DISASSEMBLY_LINE_MAX];
+
+  if (!samples || !sample_count) {
+    return;
+  }
+
+  fprintf(out, "profile: %llu samples\n", (unsigned long long) sample_count);
+
+  // Samples by segment; the rest ran from memory no image loaded
+  uint64_t outside = sample_count;
+  for (int i = 0; i < loader->segment_count; ++i) {
+    const lc3_segment* segment = &loader->segments[i];
+    uint64_t count = 0;
+
+    for (uint32_t address = segment->origin; address < segment->origin + segment->length; ++address) {
+      count += samples[address];
+    }
+    outside -= count;
+
+    fprintf(out, "%6.2f%%  x%04X-x%04X  %s\n", 100.0 * count / sample_count,
+            segment->origin, segment->origin + segment->length - 1, segment->source);
+  }
+  if (outside) {
+    fprintf(out, "%6.2f%%  outside loaded segments\n", 100.0 * outside / sample_count);
+  }
+
+  // Repeatedly take the hottest address; top is small
+  for (int i = 0; i < top; ++i) {
+    uint32_t hottest = 0;
+    for (uint32_t address = 1; address < MEMORY_SIZE; ++address) {
+      if (samples[address] > samples[hottest]) {
+        hottest = address;
+      }
+    }
+    if (!samples[hottest]) {
+      break;
+    }
+
+    uint16_t offset = 0;
+    const char* name = symbols_nearest(symbols, (uint16_t) hottest, &offset);
+
+    disassemble_line((uint16_t) hottest, vm->memory[hottest], symbols, line);
+    if (name && offset) {
+      fprintf(out, "%6.2f%%  %s  (%s+%u)\n", 100.0 * samples[hottest] / sample_count, line, name, offset);
+    }
+    else {
+      fprintf(out, "%6.2f%%  %s\n", 100.0 * samples[hottest] / sample_count, line);
+    }
+    samples[hottest] = 0;
+  }
+}
+
+void profile_free() {
+  free(samples);
+  samples = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef _PROFILE
+#define _PROFILE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../core/core.h"
+#include "../core/disassembler.h"
+#include "../core/engine.h"
+#include "../core/loader.h"
+
+/* Sampling profiler
+Runs the inner engine at full speed in chunks of randomized length
+(PROFILE_INTERVAL instructions on average, so loops do not alias with
+the sampling) and counts the PC at the end of each chunk.
+*/
+enum { PROFILE_INTERVAL = 4096 };
+
+void profile_start(engine_run run);
+
+/* Engine that samples */
+uint64_t run_profiled(lc3_vm* vm, uint64_t budget);
+
+/* Share of samples per loaded segment (and outside them), then the
+top hottest addresses. Consumes the samples */
+void profile_report(FILE* out, const lc3_vm* vm, const lc3_symbols* symbols,
+                    const lc3_loader* loader, int top);
+
+void profile_free();
+
+#endif
@@ -0,0 +1,404 @@
+#include "scheduler.h"
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "../core/hibernate.h"
+#include "../core/mailbox.h"
+
+enum { SCHEDULER_EVENTS = 64 };
+
+static uint64_t now_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static void enqueue(lc3_scheduler* scheduler, lc3_guest* guest) {
+  guest->next = NULL;
+  if (scheduler->tail) {
+    scheduler->tail->next = guest;
+  }
+  else {
+    scheduler->head = guest;
+  }
+  scheduler->tail = guest;
+}
+
+static lc3_guest* dequeue(lc3_scheduler* scheduler) {
+  lc3_guest* guest = scheduler->head;
+  scheduler->head = guest->next;
+  if (!scheduler->head) {
+    scheduler->tail = NULL;
+  }
+  return guest;
+}
+
+int scheduler_init(lc3_scheduler* scheduler, engine_run run) {
+  scheduler->run = run;
+  scheduler->head = NULL;
+  scheduler->tail = NULL;
+  scheduler->polling = NULL;
+  scheduler->poll_deadline = 0;
+  scheduler->idle_head = NULL;
+  scheduler->idle_tail = NULL;
+  scheduler->hibernate_ms = 0;
+  scheduler->guest_count = 0;
+  scheduler->hibernated_count = 0;
+  scheduler->hibernated_bytes = 0;
+  scheduler->instructions = 0;
+  scheduler->posted = NULL;
+  pthread_mutex_init(&scheduler->lock, NULL);
+  scheduler->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  scheduler->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = scheduler;
+  if (scheduler->epoll_fd < 0 || scheduler->event_fd < 0
+      || epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_ADD, scheduler->event_fd, &event) != 0) {
+    scheduler_free(scheduler);
+    return 0;
+  }
+  return 1;
+}
+
+void scheduler_free(lc3_scheduler* scheduler) {
+  pthread_mutex_destroy(&scheduler->lock);
+  if (scheduler->epoll_fd >= 0) {
+    close(scheduler->epoll_fd);
+  }
+  if (scheduler->event_fd >= 0) {
+    close(scheduler->event_fd);
+  }
+  scheduler->epoll_fd = -1;
+  scheduler->event_fd = -1;
+}
+
+int scheduler_add(lc3_scheduler* scheduler, lc3_guest* guest) {
+  // Edge triggered: a guest only waits after its console found the
+  // descriptor empty, so the next input to arrive is a new edge
+  if (guest->input_fd >= 0) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = guest;
+    if (epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_ADD, guest->input_fd, &event) != 0) {
+      // Regular files cannot be watched, but never block either
+      if (errno != EPERM) {
+        return 0;
+      }
+      guest->input_fd = -1;
+    }
+  }
+  if (guest->wake_fd >= 0) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = guest;
+    if (epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_ADD, guest->wake_fd, &event) != 0) {
+      if (guest->input_fd >= 0) {
+        epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_DEL, guest->input_fd, NULL);
+      }
+      return 0;
+    }
+  }
+
+  guest->waiting = 0;
+  guest->polling = 0;
+  guest->idle = 0;
+  guest->hung_up = 0;
+  enqueue(scheduler, guest);
+  ++scheduler->guest_count;
+  return 1;
+}
+
+static void idle_add(lc3_scheduler* scheduler, lc3_guest* guest) {
+  guest->idle = 1;
+  guest->idle_since = now_ms();
+  guest->next_idle = NULL;
+  guest->previous_idle = scheduler->idle_tail;
+  if (scheduler->idle_tail) {
+    scheduler->idle_tail->next_idle = guest;
+  }
+  else {
+    scheduler->idle_head = guest;
+  }
+  scheduler->idle_tail = guest;
+}
+
+static void idle_remove(lc3_scheduler* scheduler, lc3_guest* guest) {
+  if (!guest->idle) {
+    return;
+  }
+  guest->idle = 0;
+  if (guest->previous_idle) {
+    guest->previous_idle->next_idle = guest->next_idle;
+  }
+  else {
+    scheduler->idle_head = guest->next_idle;
+  }
+  if (guest->next_idle) {
+    guest->next_idle->previous_idle = guest->previous_idle;
+  }
+  else {
+    scheduler->idle_tail = guest->previous_idle;
+  }
+}
+
+static void count_hibernated(lc3_scheduler* scheduler, lc3_vm* vm, int sign) {
+  __atomic_add_fetch(&scheduler->hibernated_count, sign, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&scheduler->hibernated_bytes, sign * (int64_t) vm_hibernated_size(vm), __ATOMIC_RELAXED);
+}
+
+// Before a guest runs again, or leaves
+static int wake_memory(lc3_scheduler* scheduler, lc3_guest* guest) {
+  lc3_vm* vm = guest->vm;
+  if (!vm->hibernated) {
+    return 1;
+  }
+  count_hibernated(scheduler, vm, -1);
+  if (!vm_wake(vm)) {
+    count_hibernated(scheduler, vm, 1);
+    return 0;
+  }
+  return 1;
+}
+
+void scheduler_remove(lc3_scheduler* scheduler, lc3_guest* guest) {
+  if (guest->input_fd >= 0) {
+    epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_DEL, guest->input_fd, NULL);
+  }
+  if (guest->wake_fd >= 0) {
+    epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_DEL, guest->wake_fd, NULL);
+  }
+
+  idle_remove(scheduler, guest);
+  if (guest->vm->hibernated) {
+    count_hibernated(scheduler, guest->vm, -1);
+  }
+
+  if (guest->polling) {
+    lc3_guest** link = &scheduler->polling;
+    while (*link != guest) {
+      link = &(*link)->next_polling;
+    }
+    *link = guest->next_polling;
+  }
+
+  lc3_guest** link = &scheduler->head;
+  lc3_guest* previous = NULL;
+  while (*link && *link != guest) {
+    previous = *link;
+    link = &previous->next;
+  }
+  if (*link) {
+    *link = guest->next;
+    if (scheduler->tail == guest) {
+      scheduler->tail = previous;
+    }
+  }
+  --scheduler->guest_count;
+}
+
+int scheduler_post(lc3_scheduler* scheduler, lc3_guest* guest) {
+  pthread_mutex_lock(&scheduler->lock);
+  guest->next = scheduler->posted;
+  scheduler->posted = guest;
+  pthread_mutex_unlock(&scheduler->lock);
+
+  uint64_t one = 1;
+  return write(scheduler->event_fd, &one, sizeof(one)) == sizeof(one);
+}
+
+static void stop(lc3_scheduler* scheduler, lc3_guest* guest) {
+  scheduler_remove(scheduler, guest);
+  if (guest->stopped) {
+    guest->stopped(guest);
+  }
+}
+
+static void resume(lc3_scheduler* scheduler, lc3_guest* guest) {
+  guest->waiting = 0;
+  guest->vm->status = VM_RUNNING;
+  enqueue(scheduler, guest);
+}
+
+static void add_posted(lc3_scheduler* scheduler) {
+  uint64_t count;
+  while (read(scheduler->event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+
+  pthread_mutex_lock(&scheduler->lock);
+  lc3_guest* posted = scheduler->posted;
+  scheduler->posted = NULL;
+  pthread_mutex_unlock(&scheduler->lock);
+
+  while (posted) {
+    lc3_guest* guest = posted;
+    posted = guest->next;
+    if (!scheduler_add(scheduler, guest)) {
+      guest->hung_up = 1;
+      if (guest->stopped) {
+        guest->stopped(guest);
+      }
+    }
+  }
+}
+
+// Milliseconds until deadline, at most timeout_ms unless that is -1
+static int until(uint64_t deadline, int timeout_ms) {
+  uint64_t now = now_ms();
+  int due = now < deadline ? (int) (deadline - now) : 0;
+  return timeout_ms < 0 || due < timeout_ms ? due : timeout_ms;
+}
+
+// Hibernate the guests that have had no input for long enough. One
+// taking its poll turn just now is looked at again later
+static void hibernate_idle(lc3_scheduler* scheduler) {
+  uint64_t now = now_ms();
+
+  while (scheduler->idle_head && now - scheduler->idle_head->idle_since >= (uint64_t) scheduler->hibernate_ms) {
+    lc3_guest* guest = scheduler->idle_head;
+    idle_remove(scheduler, guest);
+    if (!guest->waiting) {
+      idle_add(scheduler, guest);
+    }
+    else if (vm_hibernate(guest->vm)) {
+      count_hibernated(scheduler, guest->vm, 1);
+    }
+  }
+}
+
+// Queue the waiting guests whose input arrived or whose poll is due
+static int wake(lc3_scheduler* scheduler, int timeout_ms) {
+  if (scheduler->polling) {
+    timeout_ms = until(scheduler->poll_deadline, timeout_ms);
+  }
+  if (scheduler->idle_head) {
+    timeout_ms = until(scheduler->idle_head->idle_since + scheduler->hibernate_ms, timeout_ms);
+  }
+
+  struct epoll_event events[SCHEDULER_EVENTS];
+  int count = epoll_wait(scheduler->epoll_fd, events, SCHEDULER_EVENTS, timeout_ms);
+  if (count < 0 && errno != EINTR) {
+    return 0;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (events[i].data.ptr == scheduler) {
+      add_posted(scheduler);
+      continue;
+    }
+
+    lc3_guest* guest = (lc3_guest*) events[i].data.ptr;
+    if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
+      guest->hung_up = 1;
+    }
+    if (guest->wake_fd >= 0) {
+      char drained[64];
+      while (read(guest->wake_fd, drained, sizeof(drained)) > 0) {
+      }
+    }
+    idle_remove(scheduler, guest);
+    if (guest->waiting) {
+      resume(scheduler, guest);
+    }
+  }
+
+  if (scheduler->polling && now_ms() >= scheduler->poll_deadline) {
+    while (scheduler->polling) {
+      lc3_guest* guest = scheduler->polling;
+      scheduler->polling = guest->next_polling;
+      guest->polling = 0;
+      // A hibernated guest polls again once its input arrives
+      if (guest->waiting && !guest->vm->hibernated) {
+        resume(scheduler, guest);
+      }
+    }
+  }
+
+  if (scheduler->idle_head) {
+    hibernate_idle(scheduler);
+  }
+  return 1;
+}
+
+static void park(lc3_scheduler* scheduler, lc3_guest* guest) {
+  guest->waiting = 1;
+
+  // Quiet from the first wait since the last input
+  if (scheduler->hibernate_ms && !guest->idle) {
+    idle_add(scheduler, guest);
+  }
+
+  // GETC and IN wait for input; a KBSR poll is also retried
+  if (!guest->vm->console.waiting && !guest->polling) {
+    if (!scheduler->polling) {
+      scheduler->poll_deadline = now_ms() + SCHEDULER_POLL_MS;
+    }
+    guest->polling = 1;
+    guest->next_polling = scheduler->polling;
+    scheduler->polling = guest;
+  }
+}
+
+static void turn(lc3_scheduler* scheduler, lc3_guest* guest) {
+  lc3_vm* vm = guest->vm;
+
+  if (!wake_memory(scheduler, guest)) {
+    guest->hung_up = 1;
+    stop(scheduler, guest);
+    return;
+  }
+  __atomic_add_fetch(&scheduler->instructions, scheduler->run(vm, SCHEDULER_SLICE), __ATOMIC_RELAXED);
+
+  switch (vm->status) {
+    case VM_RUNNING:
+      enqueue(scheduler, guest);
+      break;
+    case VM_WAIT:
+      // Hung up input ends a guest waiting for it, not for its mailbox
+      if (guest->hung_up && (vm->console.waiting || !(vm->mailbox && vm->mailbox->waiting))) {
+        stop(scheduler, guest);
+      }
+      else if (guest->input_fd >= 0 || guest->wake_fd >= 0) {
+        park(scheduler, guest);
+      }
+      else {
+        vm->status = VM_RUNNING;
+        enqueue(scheduler, guest);
+      }
+      break;
+    default:
+      stop(scheduler, guest);
+      break;
+  }
+}
+
+int scheduler_step(lc3_scheduler* scheduler, int timeout_ms) {
+  if (!wake(scheduler, scheduler->head ? 0 : timeout_ms)) {
+    return 0;
+  }
+
+  // Guests queued during this pass wait for the next one
+  lc3_guest* last = scheduler->tail;
+  while (scheduler->head) {
+    lc3_guest* guest = dequeue(scheduler);
+    turn(scheduler, guest);
+    if (guest == last) {
+      break;
+    }
+  }
+  return 1;
+}
+
+int scheduler_run(lc3_scheduler* scheduler) {
+  while (scheduler->guest_count) {
+    if (!scheduler_step(scheduler, -1)) {
+      return 0;
+    }
+  }
+  return 1;
+}
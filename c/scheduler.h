@@ -0,0 +1,109 @@
+#ifndef _SCHEDULER
+#define _SCHEDULER
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "../core/core.h"
+#include "../core/engine.h"
+
+/* Scheduler
+Runs many guests on one host thread. Runnable guests take turns,
+SCHEDULER_SLICE instructions at a time. A guest on a non-blocking
+console (fd_console in console.h) stops with VM_WAIT when it reads
+input that has not arrived yet: GETC and IN leave the PC on the TRAP,
+so the VM itself is the suspended coroutine and the engines need no
+stack switching. The guest is parked until its input descriptor is
+readable, and when every guest waits the thread sleeps in epoll_wait.
+
+A guest waiting for its mailbox (see mailbox.h) is parked until its
+wake_fd is readable, which the scheduler then drains.
+
+A guest that found KBSR empty is parked too, but also runs again
+every SCHEDULER_POLL_MS, so programs that poll the keyboard while
+doing other work still see time pass. A guest whose input hangs up
+ends once it waits for input with none left.
+
+A guest that has waited for input, for GETC, IN or a KBSR poll, for
+longer than hibernate_ms (if not 0) since its last input is hibernated
+(see hibernate.h). It gives back the memory it wrote and is not run,
+polls included, until its input arrives; it is woken before its
+next turn.
+
+Each scheduler belongs to one thread; other threads hand it guests
+with scheduler_post.
+*/
+enum {
+  SCHEDULER_SLICE = 1 << 16,
+  SCHEDULER_POLL_MS = 10
+};
+
+typedef struct lc3_guest lc3_guest;
+
+struct lc3_guest {
+  lc3_vm* vm;
+  int input_fd;                      /* woken on when readable, -1 if none */
+  int wake_fd;                       /* also woken on when readable, e.g. a
+                                        mailbox port's, -1 if none */
+  void (*stopped)(lc3_guest* guest); /* the guest stopped or hung up and has
+                                        left the scheduler; may be NULL */
+  void* context;
+
+  /* Owned by the scheduler */
+  lc3_guest* next;                   /* run queue or posted list */
+  lc3_guest* next_polling;
+  lc3_guest* next_idle;              /* guests without input, oldest first */
+  lc3_guest* previous_idle;
+  uint64_t idle_since;               /* first wait since the last input, ms */
+  int idle;
+  int waiting;
+  int polling;
+  int hung_up;
+};
+
+typedef struct lc3_scheduler {
+  engine_run run;
+  int epoll_fd;
+  lc3_guest* head;          /* runnable guests, in turn order */
+  lc3_guest* tail;
+  lc3_guest* polling;       /* guests that found KBSR empty */
+  uint64_t poll_deadline;   /* when they run again, in ms */
+  lc3_guest* idle_head;     /* guests waiting without input, by age */
+  lc3_guest* idle_tail;
+  int hibernate_ms;         /* 0 never */
+  int guest_count;
+  int hibernated_count;     /* atomic */
+  uint64_t hibernated_bytes; /* held by hibernated guests; atomic */
+  uint64_t instructions;    /* executed by every guest so far; atomic */
+
+  /* Guests handed over by other threads */
+  int event_fd;
+  pthread_mutex_t lock;
+  lc3_guest* posted;
+} lc3_scheduler;
+
+/* Returns 0 on failure. Guests are never hibernated unless
+hibernate_ms is set afterwards */
+int scheduler_init(lc3_scheduler* scheduler, engine_run run);
+void scheduler_free(lc3_scheduler* scheduler);
+
+/* The guest runs from its next turn; input_fd and wake_fd are watched
+from now on.
+Returns 0 on failure */
+int scheduler_add(lc3_scheduler* scheduler, lc3_guest* guest);
+void scheduler_remove(lc3_scheduler* scheduler, lc3_guest* guest);
+
+/* scheduler_add from any thread: the guest is added on the
+scheduler's own thread at its next step, and its stopped callback
+is called there if it cannot be. Returns 0 on failure */
+int scheduler_post(lc3_scheduler* scheduler, lc3_guest* guest);
+
+/* Give every runnable guest one turn, first waiting up to timeout_ms
+(-1 for ever) for input or a posted guest if none can run. Returns
+0 on failure */
+int scheduler_step(lc3_scheduler* scheduler, int timeout_ms);
+
+/* Run until every guest has stopped. Returns 0 on failure */
+int scheduler_run(lc3_scheduler* scheduler);
+
+#endif
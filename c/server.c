@@ -0,0 +1,340 @@
+/* Console server
+
+Listens on a TCP or Unix socket and gives every connection a VM of
+its own, loaded with the same images: the connection is the guest's
+console, for the TRAP routines and KBSR/KBDR alike. Guests map the
+images copy-on-write (see shared-image.h), and a small pool of
+threads runs them, each thread a scheduler (see scheduler.h) that
+multiplexes its sessions on one epoll loop. A session ends when its
+guest halts or faults, or its client hangs up.
+
+With -H, a guest that has had no input for that long while waiting
+for it hibernates: its memory is compressed against the image, and it
+does not run, even to poll the keyboard, until input arrives (see
+scheduler.h and hibernate.h).
+
+With -M, metrics in the Prometheus text format are served over HTTP
+on a second address.
+
+The client terminal should be raw, as lc3 makes it for a local
+guest, e.g. socat -,raw,echo=0 tcp:localhost:4000
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/loader.h"
+#include "../core/shared-image.h"
+
+#include "fetch-execute.h"
+#include "listen.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+/* One connection and its guest */
+typedef struct session {
+  lc3_guest guest;
+  fd_console console;
+  int fd;
+  unsigned id;
+} session;
+
+static lc3_scheduler* workers;
+static int worker_count;
+
+static int session_count;           /* sessions open, across threads */
+static char socket_path[LISTEN_PATH_SIZE];
+static char metrics_path[LISTEN_PATH_SIZE];
+
+/* Counted across threads, for the metrics */
+static unsigned sessions_started;
+static uint64_t sessions_halted;
+static uint64_t sessions_faulted;
+static uint64_t sessions_hung_up;
+static double start_time;
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void session_end(lc3_guest* guest) {
+  session* s = (session*) guest->context;
+  lc3_vm* vm = guest->vm;
+
+  const char* reason = guest->hung_up ? "hung up"
+                     : vm->status == VM_HALTED ? "halted"
+                     : vm->status == VM_FAULT ? "fault" : "stopped";
+  __atomic_add_fetch(guest->hung_up ? &sessions_hung_up
+                     : vm->status == VM_FAULT ? &sessions_faulted : &sessions_halted, 1, __ATOMIC_RELAXED);
+  if (vm->status == VM_FAULT) {
+    console_print(&vm->console, "\nFAULT\n");
+  }
+  vm->console.flush(vm->console.context);
+  fprintf(stderr, "session %u: %s\n", s->id, reason);
+
+  close(s->fd);
+  vm_destroy(vm);
+  free(s);
+  __atomic_sub_fetch(&session_count, 1, __ATOMIC_RELAXED);
+}
+
+static void* worker_main(void* argument) {
+  lc3_scheduler* scheduler = (lc3_scheduler*) argument;
+  while (scheduler_step(scheduler, -1)) {
+  }
+  perror("scheduler");
+  exit(1);
+}
+
+static void session_start(int fd, shared_image* image, int max_sessions) {
+  static const char full[] = "server full\n";
+
+  if (__atomic_load_n(&session_count, __ATOMIC_RELAXED) >= max_sessions) {
+    if (write(fd, full, sizeof(full) - 1) < 0) {
+      // Dropping the connection says as much
+    }
+    close(fd);
+    return;
+  }
+
+  session* s = (session*) calloc(1, sizeof(session));
+  lc3_vm* vm = s ? vm_create_image(image) : NULL;
+  if (!vm) {
+    free(s);
+    close(fd);
+    return;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  s->fd = fd;
+  s->id = __atomic_add_fetch(&sessions_started, 1, __ATOMIC_RELAXED);
+  vm->console = fd_console_make(&s->console, fd, fd);
+  s->guest.vm = vm;
+  s->guest.input_fd = fd;
+  s->guest.wake_fd = -1;
+  s->guest.stopped = session_end;
+  s->guest.context = s;
+
+  __atomic_add_fetch(&session_count, 1, __ATOMIC_RELAXED);
+  fprintf(stderr, "session %u: started\n", s->id);
+  if (!scheduler_post(&workers[s->id % worker_count], &s->guest)) {
+    s->guest.hung_up = 1;
+    session_end(&s->guest);
+  }
+}
+
+static void write_metrics(FILE* out) {
+  uint64_t instructions = 0;
+  uint64_t hibernated = 0;
+  uint64_t hibernated_bytes = 0;
+  for (int i = 0; i < worker_count; ++i) {
+    instructions += __atomic_load_n(&workers[i].instructions, __ATOMIC_RELAXED);
+    hibernated += __atomic_load_n(&workers[i].hibernated_count, __ATOMIC_RELAXED);
+    hibernated_bytes += __atomic_load_n(&workers[i].hibernated_bytes, __ATOMIC_RELAXED);
+  }
+
+  metric_write(out, "lc3_sessions_started_total", "counter", "Connections given a guest.",
+               NULL, __atomic_load_n(&sessions_started, __ATOMIC_RELAXED));
+  metric_write(out, "lc3_sessions_active", "gauge", "Sessions open now.",
+               NULL, __atomic_load_n(&session_count, __ATOMIC_RELAXED));
+  metric_write(out, "lc3_sessions_ended_total", "counter", "Sessions ended, by reason.",
+               "reason=\"halted\"", __atomic_load_n(&sessions_halted, __ATOMIC_RELAXED));
+  metric_sample(out, "lc3_sessions_ended_total", "reason=\"fault\"",
+                __atomic_load_n(&sessions_faulted, __ATOMIC_RELAXED));
+  metric_sample(out, "lc3_sessions_ended_total", "reason=\"hung_up\"",
+                __atomic_load_n(&sessions_hung_up, __ATOMIC_RELAXED));
+  metric_write(out, "lc3_sessions_hibernated", "gauge", "Sessions whose memory is compressed.",
+               NULL, hibernated);
+  metric_write(out, "lc3_hibernated_bytes", "gauge", "Memory held by hibernated sessions.",
+               NULL, hibernated_bytes);
+  metric_write(out, "lc3_instructions_total", "counter", "Instructions executed by all guests.",
+               NULL, instructions);
+  metric_write(out, "lc3_worker_threads", "gauge", "Threads running guests.", NULL, worker_count);
+  metric_write(out, "lc3_uptime_seconds", "gauge", "Time since the server started.",
+               NULL, now() - start_time);
+  metric_write(out, "lc3_peak_resident_bytes", "gauge", "Peak resident memory of the server.",
+               NULL, metric_peak_resident_bytes());
+}
+
+// Answer every request on the metrics address with the metrics; the
+// request itself is not looked at
+static void* metrics_main(void* argument) {
+  int listen_fd = (int) (intptr_t) argument;
+
+  for (;;) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+
+    struct timeval timeout = { 1, 0 };
+    char request[4096];
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    recv(fd, request, sizeof(request), 0);
+
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    if (out) {
+      write_metrics(out);
+      fclose(out);
+
+      char header[128];
+      int header_length = snprintf(header, sizeof(header),
+                                   "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                   "Content-Length: %zu\r\n\r\n", length);
+      if (send(fd, header, header_length, MSG_NOSIGNAL) == header_length) {
+        send(fd, body, length, MSG_NOSIGNAL);
+      }
+      free(body);
+    }
+    close(fd);
+  }
+  return NULL;
+}
+
+static void handle_signal(int signal) {
+  (void) signal;
+  if (socket_path[0]) {
+    unlink(socket_path);
+  }
+  if (metrics_path[0]) {
+    unlink(metrics_path);
+  }
+  _exit(0);
+}
+
+static void usage() {
+  printf("lc3-server [-j threads] [-n max-sessions] [-H idle-ms] [-M metrics-address] [host]:port|socket-path image-file1 ...\n");
+  exit(2);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_sessions = 4096;
+  const char* metrics_address = NULL;
+  int hibernate_ms = 0;
+  worker_count = cpus > 0 ? (int) cpus : 1;
+
+  int option;
+  while ((option = getopt(argc, argv, "j:n:H:M:")) != -1) {
+    switch (option) {
+      case 'j':
+        worker_count = atoi(optarg);
+        break;
+      case 'n':
+        max_sessions = atoi(optarg);
+        break;
+      case 'H':
+        hibernate_ms = atoi(optarg);
+        break;
+      case 'M':
+        metrics_address = optarg;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (argc - optind < 2 || worker_count < 1 || max_sessions < 1 || hibernate_ms < 0) {
+    usage();
+  }
+  const char* address = argv[optind];
+
+  lc3_loader loader;
+  loader_init(&loader);
+  for (int j = optind + 1; j < argc; ++j) {
+    if (!loader_add_image(&loader, argv[j])) {
+      printf("failed to load: %s\n", loader.error);
+      exit(1);
+    }
+  }
+
+  shared_image* image = shared_image_create(&loader);
+  if (!image) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+  loader_free(&loader);
+
+  int listen_fd = listen_address(address, SOMAXCONN, socket_path);
+  if (listen_fd < 0) {
+    printf("failed to listen on %s\n", address);
+    exit(1);
+  }
+
+  int metrics_fd = -1;
+  if (metrics_address && (metrics_fd = listen_address(metrics_address, 16, metrics_path)) < 0) {
+    printf("failed to listen on %s\n", metrics_address);
+    exit(1);
+  }
+
+  // Clients that go away must not take the server with them
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  workers = (lc3_scheduler*) calloc(worker_count, sizeof(lc3_scheduler));
+  for (int i = 0; i < worker_count; ++i) {
+    pthread_t thread;
+    int started = workers && scheduler_init(&workers[i], fetchExecuteComputedGoto);
+    if (started) {
+      workers[i].hibernate_ms = hibernate_ms;
+      started = pthread_create(&thread, NULL, worker_main, &workers[i]) == 0;
+    }
+    if (!started) {
+      printf("failed to start worker threads\n");
+      exit(1);
+    }
+  }
+  start_time = now();
+  if (metrics_fd >= 0) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, metrics_main, (void*) (intptr_t) metrics_fd) != 0) {
+      printf("failed to start the metrics thread\n");
+      exit(1);
+    }
+    fprintf(stderr, "metrics on %s\n", metrics_address);
+  }
+  fprintf(stderr, "listening on %s with %d threads\n", address, worker_count);
+
+  for (;;) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd >= 0) {
+      session_start(fd, image, max_sessions);
+    }
+    else if (errno == EMFILE || errno == ENFILE) {
+      // Out of descriptors until sessions end
+      usleep(100000);
+    }
+    else if (errno != EINTR && errno != ECONNABORTED) {
+      perror("accept");
+      break;
+    }
+  }
+
+  if (socket_path[0]) {
+    unlink(socket_path);
+  }
+  if (metrics_path[0]) {
+    unlink(metrics_path);
+  }
+  return 1;
+}
@@ -0,0 +1,111 @@
+#include "stats.h"
+
+#include <string.h>
+#include <sys/resource.h>
+
+#include "fetch-execute.h"
+
+static run_stats stats;
+
+/* The console being counted */
+static lc3_console counted_console;
+
+static const char* opcode_names[16] = {
+  "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+  "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+static const char* trap_names[STATS_TRAP_VECTORS + 1] = {
+  "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT", "other"
+};
+
+static const char* exit_reasons[] = { "interrupted", "halted", "fault", "break", "waiting" };
+
+static int counted_get_char(void* context) {
+  (void) context;
+  return counted_console.get_char(counted_console.context);
+}
+
+// Memory reads of KBSR ask the console whether a key is ready
+static int counted_key_ready(void* context) {
+  (void) context;
+  ++stats.kbsr_polls;
+  return counted_console.key_ready(counted_console.context);
+}
+
+static void counted_put_char(int c, void* context) {
+  (void) context;
+  counted_console.put_char(c, counted_console.context);
+}
+
+static void counted_flush(void* context) {
+  (void) context;
+  counted_console.flush(counted_console.context);
+}
+
+void stats_start(lc3_vm* vm) {
+  memset(&stats, 0, sizeof(stats));
+
+  counted_console = vm->console;
+  vm->console.get_char = counted_get_char;
+  vm->console.key_ready = counted_key_ready;
+  vm->console.put_char = counted_put_char;
+  vm->console.flush = counted_flush;
+}
+
+uint64_t run_counted(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint16_t instruction = vm->memory[vm->registers[R_PC]];
+    uint16_t opcode = instruction >> 12;
+
+    ++stats.instructions;
+    ++stats.opcodes[opcode];
+    if (opcode == OP_TRAP) {
+      unsigned vector = (instruction & 0xFF) - TRAP_GETC;
+      ++stats.traps[vector < STATS_TRAP_VECTORS ? vector : STATS_TRAP_VECTORS];
+    }
+    fetchExecute(vm);
+    ++executed;
+  }
+  return executed;
+}
+
+const run_stats* stats_get() {
+  return &stats;
+}
+
+void stats_report_json(FILE* out, const lc3_vm* vm, double load_seconds, double run_seconds) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  uint64_t traps = 0;
+  for (int i = 0; i <= STATS_TRAP_VECTORS; ++i) {
+    traps += stats.traps[i];
+  }
+
+  // The counts and MIPS are run_counted's, whatever engine an
+  // uncounted run would use
+  fprintf(out, "{\n  \"engine\": \"switch (counting)\",\n");
+  fprintf(out, "  \"exit_reason\": \"%s\",\n", exit_reasons[vm->status]);
+  fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long) stats.instructions);
+
+  fprintf(out, "  \"opcodes\": {");
+  for (int i = 0; i < 16; ++i) {
+    fprintf(out, "%s\"%s\": %llu", i ? ", " : "", opcode_names[i], (unsigned long long) stats.opcodes[i]);
+  }
+  fprintf(out, "},\n");
+
+  fprintf(out, "  \"traps\": %llu,\n  \"traps_by_vector\": {", (unsigned long long) traps);
+  for (int i = 0; i <= STATS_TRAP_VECTORS; ++i) {
+    fprintf(out, "%s\"%s\": %llu", i ? ", " : "", trap_names[i], (unsigned long long) stats.traps[i]);
+  }
+  fprintf(out, "},\n");
+
+  fprintf(out, "  \"kbsr_polls\": %llu,\n", (unsigned long long) stats.kbsr_polls);
+  fprintf(out, "  \"load_seconds\": %.6f,\n", load_seconds);
+  fprintf(out, "  \"run_seconds\": %.6f,\n", run_seconds);
+  fprintf(out, "  \"mips\": %.3f,\n", run_seconds > 0 ? stats.instructions / run_seconds / 1e6 : 0.0);
+  fprintf(out, "  \"peak_rss_kib\": %ld\n}\n", usage.ru_maxrss);
+}
@@ -0,0 +1,38 @@
+#ifndef _STATS
+#define _STATS
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../core/core.h"
+#include "../core/opcodes.h"
+
+/* Run statistics
+Counts what a run did, for a machine-readable report. The counting
+engine steps the switch engine and counts every instruction by opcode
+and every TRAP by vector, so a counted run is somewhat slower than an
+uncounted one. KBSR polls are counted at the console.
+*/
+enum { STATS_TRAP_VECTORS = TRAP_HALT - TRAP_GETC + 1 };
+
+typedef struct run_stats {
+  uint64_t instructions;
+  uint64_t opcodes[16];
+  uint64_t traps[STATS_TRAP_VECTORS + 1];   /* GETC..HALT, then any other vector */
+  uint64_t kbsr_polls;
+} run_stats;
+
+/* Count from now on; vm's console is wrapped to count polls */
+void stats_start(lc3_vm* vm);
+
+/* Engine that counts */
+uint64_t run_counted(lc3_vm* vm, uint64_t budget);
+
+const run_stats* stats_get();
+
+/* The report as one JSON object: the engine measured (always the
+counting one), the counts, the given load and run times, MIPS, the peak resident memory of the process, and why
+the run ended (halted, fault, break or interrupted) */
+void stats_report_json(FILE* out, const lc3_vm* vm, double load_seconds, double run_seconds);
+
+#endif
@@ -0,0 +1,233 @@
+#include "threaded.h"
+
+#include "../core/opcodes.h"
+
+#include "fetch-execute.h"
+#include "instruction-set.h"
+
+#ifdef THREADED_MUSTTAIL
+#define MUSTTAIL __attribute__((musttail))
+#else
+#define MUSTTAIL
+#endif
+
+// Every handler has the same signature, so every call between them
+// can be a tail call. Returns the budget left when the chain stops
+typedef uint64_t (*threaded_handler)(lc3_vm* vm, uint16_t* reg, uint16_t pc,
+                                     uint16_t instruction, uint64_t remaining);
+
+#define HANDLER(name) \
+  static uint64_t name(lc3_vm* vm, uint16_t* reg, uint16_t pc, uint16_t instruction, uint64_t remaining)
+
+HANDLER(op_br);
+HANDLER(op_add);
+HANDLER(op_ld);
+HANDLER(op_st);
+HANDLER(op_jsr);
+HANDLER(op_and);
+HANDLER(op_ldr);
+HANDLER(op_str);
+HANDLER(op_fault);
+HANDLER(op_not);
+HANDLER(op_ldi);
+HANDLER(op_sti);
+HANDLER(op_jmp);
+HANDLER(op_lea);
+HANDLER(op_trap);
+HANDLER(fetch_slow);
+
+// Indexed by opcode, in the order of opcodes.h
+static const threaded_handler handlers[16] = {
+  op_br, op_add, op_ld, op_st, op_jsr, op_and, op_ldr, op_str,
+  op_fault, op_not, op_ldi, op_sti, op_jmp, op_fault, op_lea, op_trap
+};
+
+// Fetches that go through mem_fetch: breakpoint pages and KBSR
+static inline int slow_fetch(const lc3_vm* vm, uint16_t pc) {
+  return ((vm->break_pages >> (pc >> MEMORY_PAGE_SHIFT)) & 1) || pc == MR_KBSR;
+}
+
+// Fetch the instruction at pc and tail call its handler. Fetches
+// through mem_fetch go to their own handler, so the others make no
+// calls besides the tail call and need no stack frame
+#define DISPATCH() { \
+  if (!remaining) { \
+    reg[R_PC] = pc; \
+    return 0; \
+  } \
+  --remaining; \
+  if (slow_fetch(vm, pc)) { \
+    MUSTTAIL return fetch_slow(vm, reg, pc, instruction, remaining); \
+  } \
+  instruction = vm->memory[pc++]; \
+  MUSTTAIL return handlers[instruction >> 12](vm, reg, pc, instruction, remaining); \
+}
+
+// A fetch that stops the machine (a breakpoint, or a KBSR poll) runs
+// the instruction it returned through the switch engine and ends the
+// chain
+HANDLER(fetch_slow) {
+  reg[R_PC] = pc + 1;
+  instruction = mem_fetch(vm, pc);
+  if (vm->status != VM_RUNNING) {
+    execute(vm, instruction);
+    return remaining;
+  }
+  pc = reg[R_PC];
+  MUSTTAIL return handlers[instruction >> 12](vm, reg, pc, instruction, remaining);
+}
+
+// End the chain if a memory access or trap stopped the machine;
+// the PC has been written back
+#define STOP_IF_NOT_RUNNING() { \
+  if (vm->status != VM_RUNNING) { \
+    return remaining; \
+  } \
+}
+
+#define DR ((instruction >> 9) & 0x7)
+#define SR1 ((instruction >> 6) & 0x7)
+#define PC_OFFSET9 ((uint16_t) (pc + sext(instruction, 9)))
+#define BASE_OFFSET6 ((uint16_t) (reg[SR1] + sext(instruction, 6)))
+
+// sign_extend of the low bits of x, inlined so handlers stay leaves
+static inline uint16_t sext(uint16_t x, int bit_count) {
+  return (uint16_t) ((int16_t) (x << (16 - bit_count)) >> (16 - bit_count));
+}
+
+static inline void set_flags(uint16_t* reg, uint16_t value) {
+  reg[R_COND] = value == 0 ? FL_ZRO : (value >> 15) ? FL_NEG : FL_POS;
+}
+
+// Operand 2 of ADD and AND: a register or a 5-bit immediate
+static inline uint16_t operand2(const uint16_t* reg, uint16_t instruction) {
+  return (instruction & 0x20) ? sext(instruction, 5) : reg[instruction & 0x7];
+}
+
+HANDLER(op_br) {
+  if ((instruction >> 9) & reg[R_COND]) {
+    pc = PC_OFFSET9;
+  }
+  DISPATCH();
+}
+
+HANDLER(op_add) {
+  uint16_t value = reg[SR1] + operand2(reg, instruction);
+  reg[DR] = value;
+  set_flags(reg, value);
+  DISPATCH();
+}
+
+HANDLER(op_and) {
+  uint16_t value = reg[SR1] & operand2(reg, instruction);
+  reg[DR] = value;
+  set_flags(reg, value);
+  DISPATCH();
+}
+
+HANDLER(op_not) {
+  uint16_t value = ~reg[SR1];
+  reg[DR] = value;
+  set_flags(reg, value);
+  DISPATCH();
+}
+
+HANDLER(op_lea) {
+  uint16_t value = PC_OFFSET9;
+  reg[DR] = value;
+  set_flags(reg, value);
+  DISPATCH();
+}
+
+HANDLER(op_jmp) {
+  pc = reg[SR1];
+  DISPATCH();
+}
+
+HANDLER(op_jsr) {
+  // Link first: JSRR R7 jumps to the return address, as in the other engines
+  reg[R_R7] = pc;
+  pc = (instruction & 0x800) ? pc + sext(instruction, 11) : reg[SR1];
+  DISPATCH();
+}
+
+HANDLER(op_ld) {
+  reg[R_PC] = pc;
+  uint16_t value = mem_read(vm, PC_OFFSET9);
+  reg[DR] = value;
+  set_flags(reg, value);
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+HANDLER(op_ldi) {
+  reg[R_PC] = pc;
+  uint16_t value = mem_read(vm, mem_read(vm, PC_OFFSET9));
+  reg[DR] = value;
+  set_flags(reg, value);
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+HANDLER(op_ldr) {
+  reg[R_PC] = pc;
+  uint16_t value = mem_read(vm, BASE_OFFSET6);
+  reg[DR] = value;
+  set_flags(reg, value);
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+HANDLER(op_st) {
+  reg[R_PC] = pc;
+  mem_write(vm, PC_OFFSET9, reg[DR]);
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+HANDLER(op_sti) {
+  reg[R_PC] = pc;
+  mem_write(vm, mem_read(vm, PC_OFFSET9), reg[DR]);
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+HANDLER(op_str) {
+  reg[R_PC] = pc;
+  mem_write(vm, BASE_OFFSET6, reg[DR]);
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+HANDLER(op_trap) {
+  // GETC and IN move the PC back to wait for input
+  reg[R_PC] = pc;
+  trap(vm, instruction);
+  pc = reg[R_PC];
+  STOP_IF_NOT_RUNNING();
+  DISPATCH();
+}
+
+// RTI and RES
+HANDLER(op_fault) {
+  (void) instruction;
+  reg[R_PC] = pc;
+  vm->status = VM_FAULT;
+  return remaining;
+}
+
+// Start a chain at the VM's PC
+HANDLER(enter) {
+  DISPATCH();
+}
+
+// Run the tail-call threaded fetch/execute chain
+uint64_t fetchExecuteThreaded(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint64_t slice = budget - executed < THREADED_SLICE ? budget - executed : THREADED_SLICE;
+    executed += slice - enter(vm, vm->registers, vm->registers[R_PC], 0, slice);
+  }
+  return executed;
+}
@@ -0,0 +1,34 @@
+#ifndef _THREADED
+#define _THREADED
+
+#include <stdint.h>
+
+#include "../core/core.h"
+
+/* Tail-call threaded engine
+Every handler ends by fetching the next instruction and tail calling
+its handler, passing the PC, the register file and the instruction
+as arguments, so the PC stays in a host register along the chain and
+there is no dispatch loop. The PC is written back to the VM only
+before memory accesses and traps, which may read it.
+
+Tail calls are guaranteed with musttail (clang, GCC 15). Other
+compilers usually turn them into jumps at -O2 but need not, so there
+the chain returns to the loop every THREADED_SLICE instructions to
+bound the stack.
+*/
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define THREADED_MUSTTAIL 1
+#endif
+#endif
+
+#ifdef THREADED_MUSTTAIL
+#define THREADED_SLICE UINT64_MAX
+#else
+#define THREADED_SLICE 4096
+#endif
+
+uint64_t fetchExecuteThreaded(lc3_vm* vm, uint64_t budget);
+
+#endif
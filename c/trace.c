@@ -0,0 +1,30 @@
+#include "trace.h"
+
+static FILE* trace_out;
+static engine_run trace_run;
+static const lc3_symbols* trace_symbols;
+
+void trace_start(FILE* out, engine_run run, const lc3_symbols* symbols) {
+  // Lines are small and many: let stdio batch them
+  setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+  trace_out = out;
+  trace_run = run;
+  trace_symbols = symbols;
+}
+
+uint64_t run_traced(lc3_vm* vm, uint64_t budget) {
+  char line[DISASSEMBLY_LINE_MAX + 1];
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint16_t pc = vm->registers[R_PC];
+    size_t length = disassemble_line(pc, vm->memory[pc], trace_symbols, line);
+
+    line[length] = '\n';
+    fwrite(line, 1, length + 1, trace_out);
+
+    executed += trace_run(vm, 1);
+  }
+  return executed;
+}
@@ -0,0 +1,20 @@
+#ifndef _TRACE
+#define _TRACE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../core/core.h"
+#include "../core/disassembler.h"
+#include "../core/engine.h"
+
+/* Instruction trace
+Steps the inner engine one instruction at a time and writes a
+disassembled line per instruction, before it executes.
+*/
+void trace_start(FILE* out, engine_run run, const lc3_symbols* symbols);
+
+/* Engine that traces */
+uint64_t run_traced(lc3_vm* vm, uint64_t budget);
+
+#endif
@@ -0,0 +1,738 @@
+#include "assembler.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "opcodes.h"
+
+/* What a mnemonic or directive assembles to */
+enum {
+  K_ADD = 1,    /* ADD, AND: DR, SR1, SR2 or imm5 */
+  K_NOT,        /* DR, SR */
+  K_BR,         /* PCoffset9, flags in bits */
+  K_JMP,        /* BaseR */
+  K_RET,
+  K_JSR,        /* PCoffset11 */
+  K_JSRR,       /* BaseR */
+  K_PC9,        /* LD, LDI, LEA, ST, STI: DR/SR, PCoffset9 */
+  K_BASE6,      /* LDR, STR: DR/SR, BaseR, offset6 */
+  K_TRAP,       /* trapvect8 */
+  K_FIXED,      /* no operands: RTI, RES, trap aliases */
+  K_ORIG,
+  K_FILL,
+  K_BLKW,
+  K_STRINGZ,
+  K_END
+};
+
+typedef struct keyword {
+  const char* name;
+  uint8_t kind;
+  uint16_t bits;
+} keyword;
+
+static const keyword keywords[] = {
+  { "ADD", K_ADD, OP_ADD << 12 },
+  { "AND", K_ADD, OP_AND << 12 },
+  { "NOT", K_NOT, OP_NOT << 12 | 0x3F },
+  { "JMP", K_JMP, OP_JMP << 12 },
+  { "RET", K_RET, OP_JMP << 12 | 7 << 6 },
+  { "JSR", K_JSR, OP_JSR << 12 | 1 << 11 },
+  { "JSRR", K_JSRR, OP_JSR << 12 },
+  { "LD", K_PC9, OP_LD << 12 },
+  { "LDI", K_PC9, OP_LDI << 12 },
+  { "LEA", K_PC9, OP_LEA << 12 },
+  { "ST", K_PC9, OP_ST << 12 },
+  { "STI", K_PC9, OP_STI << 12 },
+  { "LDR", K_BASE6, OP_LDR << 12 },
+  { "STR", K_BASE6, OP_STR << 12 },
+  { "TRAP", K_TRAP, OP_TRAP << 12 },
+  { "RTI", K_FIXED, OP_RTI << 12 },
+  { "RES", K_FIXED, OP_RES << 12 },
+  { "GETC", K_FIXED, OP_TRAP << 12 | TRAP_GETC },
+  { "OUT", K_FIXED, OP_TRAP << 12 | TRAP_OUT },
+  { "PUTS", K_FIXED, OP_TRAP << 12 | TRAP_PUTS },
+  { "IN", K_FIXED, OP_TRAP << 12 | TRAP_IN },
+  { "PUTSP", K_FIXED, OP_TRAP << 12 | TRAP_PUTSP },
+  { "HALT", K_FIXED, OP_TRAP << 12 | TRAP_HALT },
+  { ".ORIG", K_ORIG, 0 },
+  { ".FILL", K_FILL, 0 },
+  { ".BLKW", K_BLKW, 0 },
+  { ".STRINGZ", K_STRINGZ, 0 },
+  { ".END", K_END, 0 }
+};
+
+enum { KEYWORD_COUNT = sizeof(keywords) / sizeof(keywords[0]) };
+
+/* A label defined in the source */
+typedef struct symbol {
+  const char* name;     /* NULL if the slot is empty */
+  uint32_t length;
+  uint32_t hash;
+  uint16_t address;
+} symbol;
+
+/* A reference to a label that was not defined yet */
+typedef struct fixup {
+  const char* name;
+  uint32_t length;
+  uint32_t hash;
+  uint16_t address;
+  uint8_t bits;         /* PC offset width, 0 for an absolute .FILL */
+  int line;
+} fixup;
+
+typedef struct token {
+  const char* s;
+  uint32_t length;
+} token;
+
+typedef struct assembler {
+  const char* p;
+  const char* end;
+  int line;
+
+  uint16_t* memory;
+  uint32_t address;
+  int in_segment;
+  asm_result* result;
+  lc3_symbols* labels;
+
+  uint64_t keys[KEYWORD_COUNT];
+
+  symbol* symbols;
+  uint32_t symbol_count;
+  uint32_t symbol_capacity;   /* power of two */
+
+  fixup* fixups;
+  uint32_t fixup_count;
+  uint32_t fixup_capacity;
+} assembler;
+
+static int fail(assembler* a, int line, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(a->result->error, sizeof(a->result->error), format, args);
+  va_end(args);
+  a->result->error_line = line;
+  return 0;
+}
+
+static int upper(int c) {
+  return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+// Up to 8 characters, upper-cased, packed into one word; 0 if longer
+static uint64_t pack(const char* s, uint32_t length) {
+  uint64_t key = 0;
+  if (length > 8) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < length; ++i) {
+    key |= (uint64_t) upper((unsigned char) s[i]) << (8 * i);
+  }
+  return key;
+}
+
+static uint32_t hash_name(const char* s, uint32_t length) {
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < length; ++i) {
+    hash = (hash ^ (unsigned char) s[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/* SYMBOL TABLE */
+static symbol* find_slot(symbol* table, uint32_t capacity, const char* name, uint32_t length, uint32_t hash) {
+  uint32_t i = hash & (capacity - 1);
+  while (table[i].name
+         && !(table[i].hash == hash && table[i].length == length && !memcmp(table[i].name, name, length))) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &table[i];
+}
+
+static symbol* lookup(assembler* a, const char* name, uint32_t length, uint32_t hash) {
+  symbol* slot = find_slot(a->symbols, a->symbol_capacity, name, length, hash);
+  return slot->name ? slot : NULL;
+}
+
+static int grow_symbols(assembler* a) {
+  uint32_t capacity = a->symbol_capacity * 2;
+  symbol* table = (symbol*) calloc(capacity, sizeof(symbol));
+  if (!table) {
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < a->symbol_capacity; ++i) {
+    symbol* s = &a->symbols[i];
+    if (s->name) {
+      *find_slot(table, capacity, s->name, s->length, s->hash) = *s;
+    }
+  }
+  free(a->symbols);
+  a->symbols = table;
+  a->symbol_capacity = capacity;
+  return 1;
+}
+
+/* LEXER */
+static int is_separator(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static int at_line_end(assembler* a) {
+  return a->p == a->end || *a->p == '\n' || *a->p == ';';
+}
+
+static void skip_separators(assembler* a) {
+  while (a->p < a->end && is_separator(*a->p)) {
+    ++a->p;
+  }
+}
+
+// Next operand or mnemonic on this line; 0 at the end of the line
+// Sets t even when there is none, to an empty token at the line's end
+static int next_token(assembler* a, token* t) {
+  skip_separators(a);
+  t->s = a->p;
+  t->length = 0;
+  if (at_line_end(a)) {
+    return 0;
+  }
+
+  while (a->p < a->end && !is_separator(*a->p) && *a->p != '\n' && *a->p != ';' && *a->p != '"') {
+    ++a->p;
+  }
+  t->length = (uint32_t) (a->p - t->s);
+  return t->length > 0;
+}
+
+static int digit_value(int c, int base) {
+  int value = c >= '0' && c <= '9' ? c - '0'
+            : upper(c) >= 'A' && upper(c) <= 'F' ? upper(c) - 'A' + 10
+            : 99;
+  return value < base ? value : -1;
+}
+
+// #decimal, decimal, xHEX or 0xHEX
+static int parse_number(const token* t, int32_t* value) {
+  const char* s = t->s;
+  const char* end = t->s + t->length;
+  int base = 10;
+  int negative = 0;
+
+  if (s < end && *s == '#') {
+    ++s;
+  }
+  else if (s < end && upper(*s) == 'X') {
+    ++s;
+    base = 16;
+  }
+  else if (end - s > 2 && s[0] == '0' && upper(s[1]) == 'X') {
+    s += 2;
+    base = 16;
+  }
+
+  if (s < end && *s == '-') {
+    negative = 1;
+    ++s;
+  }
+  if (s == end) {
+    return 0;
+  }
+
+  int32_t number = 0;
+  for (; s < end; ++s) {
+    int digit = digit_value((unsigned char) *s, base);
+    if (digit < 0 || number > 0x1FFFF) {
+      return 0;
+    }
+    number = number * base + digit;
+  }
+  *value = negative ? -number : number;
+  return 1;
+}
+
+static int is_label(const token* t) {
+  unsigned char c = t->s[0];
+  if (!(c == '_' || (upper(c) >= 'A' && upper(c) <= 'Z'))) {
+    return 0;
+  }
+  for (uint32_t i = 1; i < t->length; ++i) {
+    c = t->s[i];
+    if (!(c == '_' || (upper(c) >= 'A' && upper(c) <= 'Z') || (c >= '0' && c <= '9'))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Keyword kind and its fixed bits, or 0 if t is not a keyword
+static int classify(assembler* a, const token* t, uint16_t* bits) {
+  uint64_t key = pack(t->s, t->length);
+  if (!key) {
+    return 0;
+  }
+
+  // BR followed by n, z, p in that order; plain BR always branches
+  if ((key & 0xFFFF) == ('B' | 'R' << 8)) {
+    const char* flags = "NZP";
+    uint16_t nzp = 0;
+    for (uint32_t i = 2; i < t->length; ++i) {
+      while (*flags && *flags != upper(t->s[i])) {
+        ++flags;
+      }
+      if (!*flags) {
+        return 0;
+      }
+      nzp |= 1 << (2 - (flags - "NZP"));
+      ++flags;
+    }
+    *bits = OP_BR << 12 | (nzp ? nzp : 7) << 9;
+    return K_BR;
+  }
+
+  for (int i = 0; i < KEYWORD_COUNT; ++i) {
+    if (a->keys[i] == key) {
+      *bits = keywords[i].bits;
+      return keywords[i].kind;
+    }
+  }
+  return 0;
+}
+
+/* OPERANDS */
+static int expect_token(assembler* a, token* t, const char* what) {
+  if (!next_token(a, t)) {
+    return fail(a, a->line, "expected %s", what);
+  }
+  return 1;
+}
+
+static int parse_register(assembler* a, uint16_t* r) {
+  token t;
+  if (!expect_token(a, &t, "register")) {
+    return 0;
+  }
+  if (t.length != 2 || upper(t.s[0]) != 'R' || t.s[1] < '0' || t.s[1] > '7') {
+    return fail(a, a->line, "expected register, got '%.*s'", (int) t.length, t.s);
+  }
+  *r = t.s[1] - '0';
+  return 1;
+}
+
+static int in_range(int32_t value, int32_t low, int32_t high) {
+  return value >= low && value <= high;
+}
+
+static int parse_immediate(assembler* a, const token* t, int32_t low, int32_t high, int32_t* value) {
+  if (!parse_number(t, value)) {
+    return fail(a, a->line, "expected number, got '%.*s'", (int) t->length, t->s);
+  }
+  if (!in_range(*value, low, high)) {
+    return fail(a, a->line, "%d is out of range %d to %d", *value, low, high);
+  }
+  return 1;
+}
+
+static int add_fixup(assembler* a, const token* t, uint8_t bits) {
+  if (a->fixup_count == a->fixup_capacity) {
+    uint32_t capacity = a->fixup_capacity ? a->fixup_capacity * 2 : 256;
+    fixup* fixups = (fixup*) realloc(a->fixups, capacity * sizeof(fixup));
+    if (!fixups) {
+      return fail(a, a->line, "out of memory");
+    }
+    a->fixups = fixups;
+    a->fixup_capacity = capacity;
+  }
+
+  fixup* f = &a->fixups[a->fixup_count++];
+  f->name = t->s;
+  f->length = t->length;
+  f->hash = hash_name(t->s, t->length);
+  f->address = (uint16_t) a->address;
+  f->bits = bits;
+  f->line = a->line;
+  return 1;
+}
+
+// PC-relative operand: a number is the offset itself, a label is
+// resolved now if defined, otherwise patched at the end
+static int parse_target(assembler* a, int bits, uint16_t* field) {
+  token t;
+  int32_t offset;
+  int32_t limit = 1 << (bits - 1);
+
+  if (!expect_token(a, &t, "label or offset")) {
+    return 0;
+  }
+
+  if (parse_number(&t, &offset)) {
+    if (!in_range(offset, -limit, limit - 1)) {
+      return fail(a, a->line, "offset %d is out of range %d to %d", offset, -limit, limit - 1);
+    }
+  }
+  else if (!is_label(&t)) {
+    return fail(a, a->line, "expected label, got '%.*s'", (int) t.length, t.s);
+  }
+  else {
+    symbol* s = lookup(a, t.s, t.length, hash_name(t.s, t.length));
+    if (!s) {
+      *field = 0;
+      return add_fixup(a, &t, (uint8_t) bits);
+    }
+
+    offset = (int32_t) s->address - (int32_t) (a->address + 1);
+    if (!in_range(offset, -limit, limit - 1)) {
+      return fail(a, a->line, "label '%.*s' is out of range", (int) t.length, t.s);
+    }
+  }
+  *field = (uint16_t) offset & ((1 << bits) - 1);
+  return 1;
+}
+
+/* OUTPUT */
+static int emit(assembler* a, uint16_t word) {
+  if (a->address > 0xFFFF) {
+    return fail(a, a->line, "block runs past the end of memory");
+  }
+  a->memory[a->address++] = word;
+  a->result->segments[a->result->segment_count - 1].length++;
+  return 1;
+}
+
+static int define_label(assembler* a, token* t) {
+  if (t->length > 1 && t->s[t->length - 1] == ':') {
+    --t->length;
+  }
+
+  int32_t number;
+  if (!is_label(t) || parse_number(t, &number)
+      || (t->length == 2 && upper(t->s[0]) == 'R' && t->s[1] >= '0' && t->s[1] <= '7')) {
+    return fail(a, a->line, "unknown instruction '%.*s'", (int) t->length, t->s);
+  }
+  if (!a->in_segment) {
+    return fail(a, a->line, "label '%.*s' outside .ORIG block", (int) t->length, t->s);
+  }
+  if (a->address > 0xFFFF) {
+    return fail(a, a->line, "label '%.*s' past the end of memory", (int) t->length, t->s);
+  }
+
+  uint32_t hash = hash_name(t->s, t->length);
+  symbol* slot = find_slot(a->symbols, a->symbol_capacity, t->s, t->length, hash);
+  if (slot->name) {
+    return fail(a, a->line, "label '%.*s' already defined", (int) t->length, t->s);
+  }
+
+  slot->name = t->s;
+  slot->length = t->length;
+  slot->hash = hash;
+  slot->address = (uint16_t) a->address;
+
+  if (a->labels && !symbols_add(a->labels, slot->address, t->s, t->length)) {
+    return fail(a, a->line, "out of memory");
+  }
+
+  if (++a->symbol_count * 2 >= a->symbol_capacity && !grow_symbols(a)) {
+    return fail(a, a->line, "out of memory");
+  }
+  return 1;
+}
+
+static int parse_string(assembler* a) {
+  skip_separators(a);
+  if (a->p == a->end || *a->p != '"') {
+    return fail(a, a->line, "expected string");
+  }
+  ++a->p;
+
+  while (a->p < a->end && *a->p != '"' && *a->p != '\n') {
+    char c = *a->p++;
+    if (c == '\\' && a->p < a->end) {
+      switch (c = *a->p++) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'e': c = 27; break;
+        case '0': c = 0; break;
+      }
+    }
+    if (!emit(a, (uint8_t) c)) {
+      return 0;
+    }
+  }
+
+  if (a->p == a->end || *a->p != '"') {
+    return fail(a, a->line, "unterminated string");
+  }
+  ++a->p;
+  return emit(a, 0);
+}
+
+static int parse_statement(assembler* a, int kind, uint16_t bits) {
+  uint16_t r0, r1, field;
+  int32_t value;
+  token t;
+
+  if (kind == K_ORIG) {
+    if (!expect_token(a, &t, "origin") || !parse_immediate(a, &t, 0, 0xFFFF, &value)) {
+      return 0;
+    }
+    if (a->result->segment_count == ASM_MAX_SEGMENTS) {
+      return fail(a, a->line, "more than %d .ORIG blocks", ASM_MAX_SEGMENTS);
+    }
+    asm_segment* segment = &a->result->segments[a->result->segment_count++];
+    segment->origin = (uint16_t) value;
+    segment->length = 0;
+    a->address = (uint32_t) value;
+    a->in_segment = 1;
+    return 1;
+  }
+
+  if (!a->in_segment) {
+    return fail(a, a->line, "outside .ORIG block");
+  }
+
+  switch (kind) {
+    case K_ADD:
+      if (!parse_register(a, &r0) || !parse_register(a, &r1) || !expect_token(a, &t, "register or immediate")) {
+        return 0;
+      }
+      if (t.length == 2 && upper(t.s[0]) == 'R' && t.s[1] >= '0' && t.s[1] <= '7') {
+        return emit(a, bits | r0 << 9 | r1 << 6 | (t.s[1] - '0'));
+      }
+      if (!parse_immediate(a, &t, -16, 15, &value)) {
+        return 0;
+      }
+      return emit(a, bits | r0 << 9 | r1 << 6 | 1 << 5 | (value & 0x1F));
+
+    case K_NOT:
+      return parse_register(a, &r0) && parse_register(a, &r1) && emit(a, bits | r0 << 9 | r1 << 6);
+
+    case K_BR:
+      return parse_target(a, 9, &field) && emit(a, bits | field);
+
+    case K_JMP:
+    case K_JSRR:
+      return parse_register(a, &r1) && emit(a, bits | r1 << 6);
+
+    case K_RET:
+    case K_FIXED:
+      return emit(a, bits);
+
+    case K_JSR:
+      return parse_target(a, 11, &field) && emit(a, bits | field);
+
+    case K_PC9:
+      return parse_register(a, &r0) && parse_target(a, 9, &field) && emit(a, bits | r0 << 9 | field);
+
+    case K_BASE6:
+      if (!parse_register(a, &r0) || !parse_register(a, &r1)
+          || !expect_token(a, &t, "offset") || !parse_immediate(a, &t, -32, 31, &value)) {
+        return 0;
+      }
+      return emit(a, bits | r0 << 9 | r1 << 6 | (value & 0x3F));
+
+    case K_TRAP:
+      return expect_token(a, &t, "trap vector") && parse_immediate(a, &t, 0, 0xFF, &value)
+          && emit(a, bits | value);
+
+    case K_FILL:
+      if (!expect_token(a, &t, "value")) {
+        return 0;
+      }
+      if (parse_number(&t, &value)) {
+        if (!in_range(value, -0x8000, 0xFFFF)) {
+          return fail(a, a->line, "%d does not fit in a word", value);
+        }
+        return emit(a, (uint16_t) value);
+      }
+      if (!is_label(&t)) {
+        return fail(a, a->line, "expected value, got '%.*s'", (int) t.length, t.s);
+      }
+      {
+        symbol* s = lookup(a, t.s, t.length, hash_name(t.s, t.length));
+        if (s) {
+          return emit(a, s->address);
+        }
+      }
+      return add_fixup(a, &t, 0) && emit(a, 0);
+
+    case K_BLKW:
+      if (!expect_token(a, &t, "count") || !parse_immediate(a, &t, 1, MEMORY_SIZE, &value)) {
+        return 0;
+      }
+      if (a->address + value > MEMORY_SIZE) {
+        return fail(a, a->line, "block runs past the end of memory");
+      }
+      memset(a->memory + a->address, 0, value * sizeof(uint16_t));
+      a->address += value;
+      a->result->segments[a->result->segment_count - 1].length += value;
+      return 1;
+
+    case K_STRINGZ:
+      return parse_string(a);
+
+    case K_END:
+      a->in_segment = 0;
+      return 1;
+  }
+  return 0;
+}
+
+// [label] [mnemonic operands] [; comment]
+static int parse_line(assembler* a) {
+  token t;
+  uint16_t bits;
+  int kind;
+
+  if (!next_token(a, &t)) {
+    return 1;
+  }
+
+  if (!(kind = classify(a, &t, &bits))) {
+    if (t.s[0] == '.') {
+      return fail(a, a->line, "unknown directive '%.*s'", (int) t.length, t.s);
+    }
+    if (!define_label(a, &t)) {
+      return 0;
+    }
+    if (!next_token(a, &t)) {
+      return 1;
+    }
+    if (!(kind = classify(a, &t, &bits))) {
+      return fail(a, a->line, "unknown instruction '%.*s'", (int) t.length, t.s);
+    }
+  }
+
+  if (!parse_statement(a, kind, bits)) {
+    return 0;
+  }
+
+  if (next_token(a, &t)) {
+    return fail(a, a->line, "unexpected '%.*s'", (int) t.length, t.s);
+  }
+  if (a->p < a->end && *a->p == '"') {
+    return fail(a, a->line, "unexpected string");
+  }
+  return 1;
+}
+
+static int resolve_fixups(assembler* a) {
+  for (uint32_t i = 0; i < a->fixup_count; ++i) {
+    fixup* f = &a->fixups[i];
+    symbol* s = lookup(a, f->name, f->length, f->hash);
+
+    if (!s) {
+      return fail(a, f->line, "undefined label '%.*s'", (int) f->length, f->name);
+    }
+
+    if (!f->bits) {
+      a->memory[f->address] = s->address;
+      continue;
+    }
+
+    int32_t offset = (int32_t) s->address - (int32_t) (f->address + 1);
+    int32_t limit = 1 << (f->bits - 1);
+    if (!in_range(offset, -limit, limit - 1)) {
+      return fail(a, f->line, "label '%.*s' is out of range", (int) f->length, f->name);
+    }
+    a->memory[f->address] |= (uint16_t) offset & ((1 << f->bits) - 1);
+  }
+  return 1;
+}
+
+int assemble(const char* source, size_t length, uint16_t memory[], lc3_symbols* symbols, asm_result* result) {
+  assembler a;
+  memset(&a, 0, sizeof(a));
+  memset(result, 0, sizeof(*result));
+
+  a.p = source;
+  a.end = source + length;
+  a.memory = memory;
+  a.result = result;
+  a.labels = symbols;
+
+  for (int i = 0; i < KEYWORD_COUNT; ++i) {
+    a.keys[i] = pack(keywords[i].name, (uint32_t) strlen(keywords[i].name));
+  }
+
+  a.symbol_capacity = 1024;
+  a.symbols = (symbol*) calloc(a.symbol_capacity, sizeof(symbol));
+  if (!a.symbols) {
+    return fail(&a, 0, "out of memory");
+  }
+
+  int ok = 1;
+  while (ok && a.p < a.end) {
+    ++a.line;
+    ok = parse_line(&a);
+
+    const char* newline = (const char*) memchr(a.p, '\n', a.end - a.p);
+    a.p = newline ? newline + 1 : a.end;
+  }
+
+  if (ok) {
+    ok = resolve_fixups(&a);
+  }
+  if (ok && result->segment_count == 0) {
+    ok = fail(&a, 0, "no .ORIG block");
+  }
+
+  free(a.symbols);
+  free(a.fixups);
+  return ok;
+}
+
+int assemble_file(const char* path, uint16_t memory[], lc3_symbols* symbols, asm_result* result) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->error, sizeof(result->error), "cannot open file");
+    return 0;
+  }
+
+  size_t capacity = 1 << 16;
+  size_t length = 0;
+  size_t read;
+  char* source = (char*) malloc(capacity);
+
+  while (source && (read = fread(source + length, 1, capacity - length, file)) > 0) {
+    length += read;
+    if (length == capacity) {
+      capacity *= 2;
+      char* grown = (char*) realloc(source, capacity);
+      if (!grown) {
+        free(source);
+      }
+      source = grown;
+    }
+  }
+  fclose(file);
+
+  if (!source) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->error, sizeof(result->error), "out of memory");
+    return 0;
+  }
+
+  int ok = assemble(source, length, memory, symbols, result);
+  free(source);
+  return ok;
+}
+
+size_t asm_segment_image(const uint16_t memory[], const asm_segment* segment, uint8_t* image) {
+  image[0] = segment->origin >> 8;
+  image[1] = segment->origin & 0xFF;
+
+  for (uint32_t i = 0; i < segment->length; ++i) {
+    uint16_t word = memory[segment->origin + i];
+    image[2 * i + 2] = word >> 8;
+    image[2 * i + 3] = word & 0xFF;
+  }
+  return 2 * (segment->length + 1);
+}
@@ -0,0 +1,55 @@
+#ifndef _ASSEMBLER
+#define _ASSEMBLER
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "disassembler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* LC-3 assembler
+
+Single pass: labels go into a hashed symbol table as they are defined,
+and references to labels not yet seen are patched once the source has
+been read. Supports every opcode in opcodes.h (RES included), BR with
+any n/z/p flags, RET, JSRR, the trap aliases (GETC, OUT, PUTS, IN,
+PUTSP, HALT) and the .ORIG, .FILL, .BLKW, .STRINGZ and .END directives.
+
+Mnemonics, directives and registers are case-insensitive; labels are
+not. Numbers are #decimal, decimal, xHEX or 0xHEX. A source may hold
+several .ORIG blocks.
+*/
+enum { ASM_MAX_SEGMENTS = 64 };
+
+typedef struct asm_segment {
+  uint16_t origin;
+  uint32_t length;      /* words */
+} asm_segment;
+
+typedef struct asm_result {
+  asm_segment segments[ASM_MAX_SEGMENTS];
+  int segment_count;
+  int error_line;       /* line of the first error, 0 if none or not on a line */
+  char error[128];
+} asm_result;
+
+/* Assemble source into memory (MEMORY_SIZE words). Only words in
+the .ORIG blocks are written. Labels are added to symbols unless it
+is NULL. Returns 0 and fills in the error on failure */
+int assemble(const char* source, size_t length, uint16_t memory[], lc3_symbols* symbols, asm_result* result);
+
+/* assemble() on the contents of a file */
+int assemble_file(const char* path, uint16_t memory[], lc3_symbols* symbols, asm_result* result);
+
+/* Encode a segment as a .obj image: big-endian origin, then the words.
+image must hold 2 * (segment->length + 1) bytes. Returns the image size */
+size_t asm_segment_image(const uint16_t memory[], const asm_segment* segment, uint8_t* image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
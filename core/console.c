@@ -0,0 +1,218 @@
+#include "console.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* STDIO CONSOLE */
+static int stdio_get_char(void* context) {
+  (void) context;
+  return getchar();
+}
+
+static int stdio_key_ready(void* context) {
+  (void) context;
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(STDIN_FILENO, &readfds);
+
+  struct timeval timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  return select(1, &readfds, NULL, NULL, &timeout) != 0;
+}
+
+static void stdio_put_char(int c, void* context) {
+  (void) context;
+  putc(c, stdout);
+}
+
+static void stdio_flush(void* context) {
+  (void) context;
+  fflush(stdout);
+}
+
+const lc3_console stdio_console = {
+  stdio_get_char,
+  stdio_key_ready,
+  stdio_put_char,
+  stdio_flush,
+  NULL,
+  0,
+  0
+};
+
+/* BUFFER CONSOLE */
+static int buffer_get_char(void* context) {
+  buffer_console* buffer = (buffer_console*) context;
+
+  if (buffer->input_position == buffer->input_length) {
+    return EOF;
+  }
+  return buffer->input[buffer->input_position++];
+}
+
+static int buffer_key_ready(void* context) {
+  buffer_console* buffer = (buffer_console*) context;
+  return buffer->input_position < buffer->input_length;
+}
+
+static void buffer_put_char(int c, void* context) {
+  buffer_console* buffer = (buffer_console*) context;
+
+  if (buffer->output_length == buffer->output_capacity) {
+    size_t capacity = buffer->output_capacity ? buffer->output_capacity * 2 : 256;
+    char* output = (char*) realloc(buffer->output, capacity);
+    if (!output) {
+      // Out of memory: drop the character
+      return;
+    }
+    buffer->output = output;
+    buffer->output_capacity = capacity;
+  }
+  buffer->output[buffer->output_length++] = (char) c;
+}
+
+static void buffer_flush(void* context) {
+  (void) context;
+}
+
+lc3_console buffer_console_make(buffer_console* buffer) {
+  lc3_console console = {
+    buffer_get_char,
+    buffer_key_ready,
+    buffer_put_char,
+    buffer_flush,
+    buffer,
+    0,
+    0
+  };
+  return console;
+}
+
+void buffer_console_free(buffer_console* buffer) {
+  free(buffer->output);
+  buffer->output = NULL;
+  buffer->output_length = 0;
+  buffer->output_capacity = 0;
+}
+
+/* FD CONSOLE */
+
+// Refill the empty input buffer; with wait set, block until input
+// arrives. Non-zero if there is input or the input has ended
+static int fd_fill(fd_console* console, int wait) {
+  if (console->input_position < console->input_length || console->closed) {
+    return 1;
+  }
+
+  struct pollfd pfd = { console->input_fd, POLLIN, 0 };
+  int ready;
+  while ((ready = poll(&pfd, 1, wait ? -1 : 0)) < 0 && errno == EINTR) {
+  }
+  if (ready == 0) {
+    return 0;
+  }
+
+  ssize_t length;
+  while ((length = read(console->input_fd, console->input, sizeof(console->input))) < 0 && errno == EINTR) {
+  }
+  if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
+  if (length <= 0) {
+    console->closed = 1;
+    return 1;
+  }
+  console->input_position = 0;
+  console->input_length = (size_t) length;
+  return 1;
+}
+
+static int fd_get_char(void* context) {
+  fd_console* console = (fd_console*) context;
+
+  while (!fd_fill(console, 1)) {
+  }
+  if (console->input_position == console->input_length) {
+    return EOF;
+  }
+  return console->input[console->input_position++];
+}
+
+// Once input has ended no key is ever ready: a guest waits for
+// input rather than spinning on EOF, and its owner ends it
+static int fd_key_ready(void* context) {
+  fd_console* console = (fd_console*) context;
+  return fd_fill(console, 0) && console->input_position < console->input_length;
+}
+
+// Never waits for the reader: what it has not taken yet stays
+// buffered for the next flush
+static void fd_flush(void* context) {
+  fd_console* console = (fd_console*) context;
+  size_t written = 0;
+
+  while (written < console->output_length) {
+    ssize_t length = write(console->output_fd, console->output + written, console->output_length - written);
+    if (length > 0) {
+      written += (size_t) length;
+    }
+    else if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      memmove(console->output, console->output + written, console->output_length - written);
+      console->output_length -= written;
+      return;
+    }
+    else {
+      // The reader is gone: drop the output
+      break;
+    }
+  }
+  console->output_length = 0;
+}
+
+static void fd_put_char(int c, void* context) {
+  fd_console* console = (fd_console*) context;
+
+  if (console->output_length == sizeof(console->output)) {
+    fd_flush(console);
+  }
+  // A reader that stops reading loses output rather than holding
+  // up the thread
+  if (console->output_length < sizeof(console->output)) {
+    console->output[console->output_length++] = (char) c;
+  }
+}
+
+lc3_console fd_console_make(fd_console* console, int input_fd, int output_fd) {
+  console->input_fd = input_fd;
+  console->output_fd = output_fd;
+  console->closed = 0;
+  console->input_position = 0;
+  console->input_length = 0;
+  console->output_length = 0;
+
+  lc3_console result = {
+    fd_get_char,
+    fd_key_ready,
+    fd_put_char,
+    fd_flush,
+    console,
+    1,
+    0
+  };
+  return result;
+}
+
+void console_print(const lc3_console* console, const char* s) {
+  while (*s) {
+    console->put_char(*s++, console->context);
+  }
+}
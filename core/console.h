@@ -0,0 +1,79 @@
+#ifndef _CONSOLE
+#define _CONSOLE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Console
+All guest I/O (TRAP routines and the keyboard registers)
+goes through one of these, so a VM can be attached to
+the terminal or to an in-memory script
+*/
+typedef struct lc3_console {
+  int (*get_char)(void* context);       /* blocking read, EOF when closed */
+  int (*key_ready)(void* context);      /* non-zero if get_char will not block */
+  void (*put_char)(int c, void* context);
+  void (*flush)(void* context);
+  void* context;
+  int nonblocking;      /* GETC and IN stop with VM_WAIT rather than block, see core.h */
+  int waiting;          /* a GETC or IN is waiting: IN has printed its prompt */
+} lc3_console;
+
+/* Console attached to stdin/stdout */
+extern const lc3_console stdio_console;
+
+/* Scripted console
+Input is read from a fixed buffer and output is captured
+*/
+typedef struct buffer_console {
+  const uint8_t* input;
+  size_t input_length;
+  size_t input_position;
+
+  char* output;
+  size_t output_length;
+  size_t output_capacity;
+} buffer_console;
+
+lc3_console buffer_console_make(buffer_console* buffer);
+void buffer_console_free(buffer_console* buffer);
+
+/* File descriptor console
+A non-blocking console on a pair of descriptors, usually one socket
+for both. Input is read as it arrives into a small buffer; when none
+is ready, GETC and IN stop the VM with VM_WAIT instead of blocking
+the thread, and the owner resumes it once input_fd is readable.
+Once the input has ended no key is ever ready again.
+
+Output is buffered until flushed, which every output trap does.
+Flushing never waits on a non-blocking output_fd: output the reader
+has not taken stays buffered for the next flush, and once the buffer
+is full whatever the guest writes after it is dropped
+*/
+
+typedef struct fd_console {
+  int input_fd;
+  int output_fd;
+  int closed;             /* input ended or failed */
+
+  uint8_t input[256];
+  size_t input_position;
+  size_t input_length;
+
+  char output[1024];
+  size_t output_length;
+} fd_console;
+
+lc3_console fd_console_make(fd_console* console, int input_fd, int output_fd);
+
+void console_print(const lc3_console* console, const char* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
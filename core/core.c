@@ -1,50 +1,188 @@
 #include "core.h"
 
-#include <stdio.h>
-#include <unistd.h>
-#include <sys/time.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
-uint16_t check_key() {
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(STDIN_FILENO, &readfds);
+#include "mailbox.h"
+#include "page-allocator.h"
+#include "shared-image.h"
+#include "smp.h"
+#include "watch.h"
 
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  return select(1, &readfds, NULL, NULL, &timeout) != 0;
+_Static_assert(offsetof(lc3_vm, console) == CACHE_LINE_SIZE, "hot VM state must fit one cache line");
+_Static_assert(sizeof(lc3_vm) % CACHE_LINE_SIZE == 0, "VMs must not share cache lines");
+
+// Allocate guest memory and reset the machine, zero on failure
+int vm_init(lc3_vm* vm) {
+  vm->memory = memory_alloc();
+  if (!vm->memory) {
+    return 0;
+  }
+  vm->image = NULL;
+  vm->hibernated = NULL;
+  vm->mailbox = NULL;
+  vm->cpu = NULL;
+  vm->console = stdio_console;
+  vm->debug = NULL;
+  vm->watched_pages = 0;
+  vm->break_pages = 0;
+  vm_reset(vm);
+  return 1;
+}
+
+// Clear registers and memory in place; memory mapped from an
+// image goes back to the image, and a vCPU leaves shared memory alone
+void vm_reset(lc3_vm* vm) {
+  memset(vm->registers, 0, sizeof(vm->registers));
+  if (vm->image) {
+    shared_image_map(vm);
+  }
+  else if (!vm->cpu) {
+    memset(vm->memory, 0, MEMORY_SIZE * sizeof(uint16_t));
+  }
+  vm->registers[R_PC] = PC_START;
+  vm->status = VM_RUNNING;
+  vm->console.waiting = 0;
+  vm->dirty_pages = 0;
 }
 
-void update_flags(uint16_t r) {
-  if (registers[r] == 0)
+void vm_free(lc3_vm* vm) {
+  watch_clear(vm);
+  free(vm->hibernated);
+  vm->hibernated = NULL;
+  if (vm->image) {
+    shared_image_unmap(vm);
+  }
+  else {
+    if (!vm->cpu) {
+      memory_free(vm->memory);
+    }
+    vm->memory = NULL;
+  }
+}
+
+// Heap allocated VM on its own cache lines
+lc3_vm* vm_create() {
+  lc3_vm* vm = (lc3_vm*) aligned_alloc(CACHE_LINE_SIZE, sizeof(lc3_vm));
+  if (vm && !vm_init(vm)) {
+    free(vm);
+    vm = NULL;
+  }
+  return vm;
+}
+
+void vm_destroy(lc3_vm* vm) {
+  if (vm) {
+    vm_free(vm);
+    free(vm);
+  }
+}
+
+void update_flags(lc3_vm* vm, uint16_t r) {
+  if (vm->registers[r] == 0)
   {
-      registers[R_COND] = FL_ZRO;
+      vm->registers[R_COND] = FL_ZRO;
   }
-  else if (registers[r] >> 15) /* a 1 in the left-most bit indicates negative */
+  else if (vm->registers[r] >> 15) /* a 1 in the left-most bit indicates negative */
   {
-      registers[R_COND] = FL_NEG;
+      vm->registers[R_COND] = FL_NEG;
   }
   else
   {
-      registers[R_COND] = FL_POS;
+      vm->registers[R_COND] = FL_POS;
   }
 }
 
 /* MEMORY ACCESS */
-void mem_write(uint16_t address, uint16_t val) {
-    memory[address] = val;
-}
+void mem_write(lc3_vm* vm, uint16_t address, uint16_t val) {
+    uint64_t page = 1ull << (address >> MEMORY_PAGE_SHIFT);
 
-uint16_t mem_read(uint16_t address) {
-  
-  if (address == MR_KBSR) {
-    if (check_key()) {
-        memory[MR_KBSR] = (1 << 15);
-        memory[MR_KBDR] = getchar();
+    vm->memory[address] = val;
+    vm->dirty_pages |= page;
+
+    if (vm->watched_pages & page) {
+      watch_check(vm, address, WATCH_WRITE, val);
+    }
+    if (address >= MR_KBSR) {
+      if (vm->mailbox) {
+        mailbox_write(vm, address, val);
+      }
+      else if (vm->cpu) {
+        smp_write(vm, address, val);
+      }
     }
-    else {
-        memory[MR_KBSR] = 0;
+}
+
+// Memory mapped device registers
+static void keyboard_read(lc3_vm* vm) {
+  vm->dirty_pages |= 1ull << (MR_KBSR >> MEMORY_PAGE_SHIFT);
+  if (vm->console.key_ready(vm->console.context)) {
+    vm->memory[MR_KBSR] = (1 << 15);
+    vm->memory[MR_KBDR] = vm->console.get_char(vm->console.context);
+  }
+  else {
+    vm->memory[MR_KBSR] = 0;
+    // A guest polling a non-blocking console stops after this
+    // instruction, so its owner can run others until a key comes
+    if (vm->console.nonblocking) {
+      vm->status = VM_WAIT;
     }
   }
-  return memory[address];
-}
\ No newline at end of file
+}
+
+// Non-zero if the device returns the value itself: a vCPU's registers
+// are its own, while the word at the address is shared
+static int device_read(lc3_vm* vm, uint16_t address, uint16_t* value) {
+  if (address == MR_KBSR) {
+    keyboard_read(vm);
+  }
+  else if (vm->mailbox) {
+    mailbox_read(vm, address);
+  }
+  else if (vm->cpu) {
+    return smp_read(vm, address, value);
+  }
+  return 0;
+}
+
+uint16_t mem_read(lc3_vm* vm, uint16_t address) {
+  uint16_t value;
+
+  if (address < MR_KBSR || !device_read(vm, address, &value)) {
+    value = vm->memory[address];
+  }
+  if (vm->watched_pages & (1ull << (address >> MEMORY_PAGE_SHIFT))) {
+    watch_check(vm, address, WATCH_READ, value);
+  }
+  return value;
+}
+
+// Instruction fetch. Data watchpoints do not fire here. A breakpoint
+// returns 0x0000 (a branch that is never taken) and stops the
+// machine with the PC on the breakpoint. Only the keyboard reacts to
+// fetches
+uint16_t mem_fetch(lc3_vm* vm, uint16_t address) {
+
+  if ((vm->break_pages & (1ull << (address >> MEMORY_PAGE_SHIFT))) && break_check(vm, address)) {
+    return 0;
+  }
+  if (address == MR_KBSR) {
+    keyboard_read(vm);
+  }
+  return vm->memory[address];
+}
+
+int vm_wait_input(lc3_vm* vm) {
+  if (!vm->console.nonblocking || vm->console.key_ready(vm->console.context)) {
+    vm->console.waiting = 0;
+    return 0;
+  }
+  if (!vm->console.waiting) {
+    vm->console.flush(vm->console.context);
+    vm->console.waiting = 1;
+  }
+  --vm->registers[R_PC];
+  vm->status = VM_WAIT;
+  return 1;
+}
@@ -3,8 +3,11 @@
 
 #include <stdint.h>
 
-/* Memory: 65536 bytes */
-uint16_t memory[UINT16_MAX];
+#include "console.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* Registers
 R0 - R7: General purpose
@@ -24,7 +27,18 @@ enum {
   R_COND,
   R_COUNT
 };
-uint16_t registers[R_COUNT];
+
+/* Memory
+65536 words, tracked in pages of 1024 words. Every write marks
+its page in dirty_pages, so state can be reset or compared
+page by page instead of as a whole
+*/
+enum {
+  MEMORY_SIZE = 1 << 16,
+  MEMORY_PAGE_SHIFT = 10,
+  MEMORY_PAGE_WORDS = 1 << MEMORY_PAGE_SHIFT,
+  MEMORY_PAGE_COUNT = MEMORY_SIZE >> MEMORY_PAGE_SHIFT
+};
 
 /* Memory Mapped Registers */
 enum {
@@ -39,9 +53,75 @@ enum {
   FL_NEG = 1 << 2  /* N(egative) */
 };
 
-void update_flags(uint16_t r);
+/* Machine Status */
+enum {
+  VM_RUNNING = 0,
+  VM_HALTED,  /* TRAP HALT */
+  VM_FAULT,   /* RTI or reserved opcode */
+  VM_BREAK,   /* watchpoint or breakpoint hit, see watch.h */
+  VM_WAIT     /* no input on a non-blocking console: GETC or IN, which
+                 run again on resuming, or a KBSR poll, which completed */
+};
+
+/* Set the Program Counter to the default address:
+0x3000
+
+Lower addresses are left empty to leave space
+for trap routines
+*/
+enum { PC_START = 0x3000 };
+
+/* Cache line size the VM state is laid out for */
+#define CACHE_LINE_SIZE 64
+
+/* Virtual Machine
+All state of one LC-3 machine. Engines take a pointer to
+the VM they run, so several machines can live in one process.
+
+Everything an instruction touches besides guest memory sits in
+the first cache line. The struct is cache line aligned and
+padded, so VMs run by different threads never share a line
+*/
+typedef struct lc3_vm {
+  /* Hot: used by every instruction */
+  uint16_t registers[R_COUNT];
+  int status;
+  uint64_t dirty_pages;   /* one bit per memory page written */
+  uint64_t watched_pages; /* pages with a watchpoint */
+  uint64_t break_pages;   /* pages with a breakpoint */
+  uint16_t* memory;       /* MEMORY_SIZE words, see page-allocator.h */
+
+  /* Cold: I/O, debugging and where memory comes from */
+  lc3_console console __attribute__((aligned(CACHE_LINE_SIZE)));
+  struct lc3_debug* debug;
+  struct shared_image* image;   /* memory is mapped from it, see shared-image.h */
+  struct lc3_hibernation* hibernated; /* memory while hibernating, see hibernate.h */
+  struct mailbox_port* mailbox; /* mailbox device, see mailbox.h */
+  struct lc3_cpu* cpu;          /* vCPU sharing memory with others, see smp.h */
+} __attribute__((aligned(CACHE_LINE_SIZE))) lc3_vm;
+
+int vm_init(lc3_vm* vm);
+void vm_reset(lc3_vm* vm);
+void vm_free(lc3_vm* vm);
+
+lc3_vm* vm_create();
+void vm_destroy(lc3_vm* vm);
+
+void update_flags(lc3_vm* vm, uint16_t r);
+
+void mem_write(lc3_vm* vm, uint16_t address, uint16_t val);
+uint16_t mem_read(lc3_vm* vm, uint16_t address);
+uint16_t mem_fetch(lc3_vm* vm, uint16_t address);
+
+/* Called by GETC and IN before reading. On a non-blocking console with
+no input ready, flushes the output, moves the PC back to the TRAP and
+stops the machine with VM_WAIT, so the trap runs again once the owner
+resumes it with status VM_RUNNING. console.waiting stays set until the
+input arrives. Returns non-zero if the machine stopped */
+int vm_wait_input(lc3_vm* vm);
 
-void mem_write(uint16_t address, uint16_t val);
-uint16_t mem_read(uint16_t address);
+#ifdef __cplusplus
+}
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,374 @@
+#include "disassembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "opcodes.h"
+
+/* Operand layouts */
+enum {
+  F_NONE,
+  F_OPERATE,    /* DR, SR1, SR2 or #imm5 */
+  F_NOT,        /* DR, SR */
+  F_BR,         /* target, mnemonic from the n/z/p flags */
+  F_PC9,        /* DR/SR, target */
+  F_BASE6,      /* DR/SR, BaseR, #offset6 */
+  F_JSR,        /* target, or JSRR BaseR */
+  F_JMP,        /* BaseR, or RET */
+  F_TRAP        /* trap alias, or TRAP xNN */
+};
+
+typedef struct opcode_format {
+  const char* mnemonic;
+  uint8_t format;
+} opcode_format;
+
+static const opcode_format opcode_table[16] = {
+  [OP_BR]   = { "BR", F_BR },
+  [OP_ADD]  = { "ADD", F_OPERATE },
+  [OP_LD]   = { "LD", F_PC9 },
+  [OP_ST]   = { "ST", F_PC9 },
+  [OP_JSR]  = { "JSR", F_JSR },
+  [OP_AND]  = { "AND", F_OPERATE },
+  [OP_LDR]  = { "LDR", F_BASE6 },
+  [OP_STR]  = { "STR", F_BASE6 },
+  [OP_RTI]  = { "RTI", F_NONE },
+  [OP_NOT]  = { "NOT", F_NOT },
+  [OP_LDI]  = { "LDI", F_PC9 },
+  [OP_STI]  = { "STI", F_PC9 },
+  [OP_JMP]  = { "JMP", F_JMP },
+  [OP_RES]  = { "RES", F_NONE },
+  [OP_LEA]  = { "LEA", F_PC9 },
+  [OP_TRAP] = { "TRAP", F_TRAP }
+};
+
+/* Indexed by the n/z/p bits; a branch on no flags never branches */
+static const char* const branch_mnemonics[8] = {
+  "NOP", "BRp", "BRz", "BRzp", "BRn", "BRnp", "BRnz", "BRnzp"
+};
+
+static const char* const trap_mnemonics[] = {
+  "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT"
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/* TEXT */
+static char* put_string(char* out, const char* s) {
+  while (*s) {
+    *out++ = *s++;
+  }
+  return out;
+}
+
+static char* put_register(char* out, unsigned r) {
+  out[0] = 'R';
+  out[1] = (char) ('0' + (r & 0x7));
+  return out + 2;
+}
+
+static char* put_separator(char* out) {
+  out[0] = ',';
+  out[1] = ' ';
+  return out + 2;
+}
+
+static char* put_hex4(char* out, uint16_t value) {
+  out[0] = 'x';
+  out[1] = hex_digits[value >> 12];
+  out[2] = hex_digits[(value >> 8) & 0xF];
+  out[3] = hex_digits[(value >> 4) & 0xF];
+  out[4] = hex_digits[value & 0xF];
+  return out + 5;
+}
+
+// #decimal, for sign-extended fields of up to 11 bits
+static char* put_immediate(char* out, int value) {
+  char digits[8];
+  int count = 0;
+
+  *out++ = '#';
+  if (value < 0) {
+    *out++ = '-';
+    value = -value;
+  }
+  do {
+    digits[count++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value);
+
+  while (count) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+static char* put_target(char* out, uint16_t target, const lc3_symbols* symbols) {
+  const char* name = symbols_lookup(symbols, target);
+  return name ? put_string(out, name) : put_hex4(out, target);
+}
+
+static int sign_extended(uint16_t instruction, int bits) {
+  int value = instruction & ((1 << bits) - 1);
+  return value & (1 << (bits - 1)) ? value - (1 << bits) : value;
+}
+
+/* DISASSEMBLER */
+size_t disassemble(uint16_t address, uint16_t instruction, const lc3_symbols* symbols, char* out) {
+  const opcode_format* op = &opcode_table[instruction >> 12];
+  unsigned r0 = (instruction >> 9) & 0x7;
+  unsigned r1 = (instruction >> 6) & 0x7;
+  uint16_t next = address + 1;
+  char* p = out;
+
+  switch (op->format) {
+    case F_NONE:
+      p = put_string(p, op->mnemonic);
+      break;
+
+    case F_OPERATE:
+      p = put_string(p, op->mnemonic);
+      *p++ = ' ';
+      p = put_register(p, r0);
+      p = put_separator(p);
+      p = put_register(p, r1);
+      p = put_separator(p);
+      p = instruction & 0x20 ? put_immediate(p, sign_extended(instruction, 5))
+                             : put_register(p, instruction & 0x7);
+      break;
+
+    case F_NOT:
+      p = put_string(p, "NOT ");
+      p = put_register(p, r0);
+      p = put_separator(p);
+      p = put_register(p, r1);
+      break;
+
+    case F_BR:
+      p = put_string(p, branch_mnemonics[r0]);
+      *p++ = ' ';
+      p = put_target(p, next + sign_extended(instruction, 9), symbols);
+      break;
+
+    case F_PC9:
+      p = put_string(p, op->mnemonic);
+      *p++ = ' ';
+      p = put_register(p, r0);
+      p = put_separator(p);
+      p = put_target(p, next + sign_extended(instruction, 9), symbols);
+      break;
+
+    case F_BASE6:
+      p = put_string(p, op->mnemonic);
+      *p++ = ' ';
+      p = put_register(p, r0);
+      p = put_separator(p);
+      p = put_register(p, r1);
+      p = put_separator(p);
+      p = put_immediate(p, sign_extended(instruction, 6));
+      break;
+
+    case F_JSR:
+      if (instruction & 0x0800) {
+        p = put_string(p, "JSR ");
+        p = put_target(p, next + sign_extended(instruction, 11), symbols);
+      }
+      else {
+        p = put_string(p, "JSRR ");
+        p = put_register(p, r1);
+      }
+      break;
+
+    case F_JMP:
+      if (r1 == 7) {
+        p = put_string(p, "RET");
+      }
+      else {
+        p = put_string(p, "JMP ");
+        p = put_register(p, r1);
+      }
+      break;
+
+    case F_TRAP: {
+      unsigned vector = instruction & 0xFF;
+      if (vector >= TRAP_GETC && vector <= TRAP_HALT) {
+        p = put_string(p, trap_mnemonics[vector - TRAP_GETC]);
+      }
+      else {
+        p = put_string(p, "TRAP x");
+        *p++ = hex_digits[vector >> 4];
+        *p++ = hex_digits[vector & 0xF];
+      }
+      break;
+    }
+  }
+
+  *p = 0;
+  return (size_t) (p - out);
+}
+
+size_t disassemble_line(uint16_t address, uint16_t instruction, const lc3_symbols* symbols, char* out) {
+  const char* name = symbols_lookup(symbols, address);
+  char* p = put_hex4(out, address);
+
+  p[0] = ' ';
+  p[1] = ' ';
+  p[2] = hex_digits[instruction >> 12];
+  p[3] = hex_digits[(instruction >> 8) & 0xF];
+  p[4] = hex_digits[(instruction >> 4) & 0xF];
+  p[5] = hex_digits[instruction & 0xF];
+  p[6] = ' ';
+  p[7] = ' ';
+  p += 8;
+
+  if (name) {
+    p = put_string(p, name);
+    p = put_string(p, ": ");
+  }
+  return (size_t) (p - out) + disassemble(address, instruction, symbols, p);
+}
+
+/* SYMBOLS */
+void symbols_init(lc3_symbols* symbols) {
+  symbols->names = NULL;
+  symbols->count = 0;
+}
+
+int symbols_add(lc3_symbols* symbols, uint16_t address, const char* name, size_t length) {
+  if (!symbols->names) {
+    symbols->names = (char**) calloc(MEMORY_SIZE, sizeof(char*));
+    if (!symbols->names) {
+      return 0;
+    }
+  }
+
+  // The first label at an address wins
+  if (symbols->names[address]) {
+    return 1;
+  }
+
+  if (length > SYMBOL_NAME_MAX) {
+    length = SYMBOL_NAME_MAX;
+  }
+  char* copy = (char*) malloc(length + 1);
+  if (!copy) {
+    return 0;
+  }
+  memcpy(copy, name, length);
+  copy[length] = 0;
+
+  symbols->names[address] = copy;
+  ++symbols->count;
+  return 1;
+}
+
+static int is_hex(const char* s) {
+  if (!*s) {
+    return 0;
+  }
+  for (; *s; ++s) {
+    if (!strchr("0123456789abcdefABCDEF", *s)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// x3000 or 0x3000
+static int is_prefixed_hex(const char* s) {
+  if (s[0] == 'x' || s[0] == 'X') {
+    return is_hex(s + 1);
+  }
+  return s[0] == '0' && (s[1] == 'x' || s[1] == 'X') && is_hex(s + 2);
+}
+
+static int is_name(const char* s) {
+  if (!(*s == '_' || (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z'))) {
+    return 0;
+  }
+  for (; *s; ++s) {
+    if (!(*s == '_' || (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z') || (*s >= '0' && *s <= '9'))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static uint16_t hex_address(const char* s) {
+  if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    s += 2;
+  }
+  else if (s[0] == 'x' || s[0] == 'X') {
+    ++s;
+  }
+  return (uint16_t) strtoul(s, NULL, 16);
+}
+
+int symbols_load(lc3_symbols* symbols, const char* path) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return 0;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    char* tokens[3];
+    int count = 0;
+
+    for (char* token = strtok(line, " \t\r\n/"); token && count < 3; token = strtok(NULL, " \t\r\n/")) {
+      tokens[count++] = token;
+    }
+    if (count != 2) {
+      continue;
+    }
+
+    // Label first as lc3as writes it, unless only the first looks like an address
+    const char* name = tokens[0];
+    const char* address = tokens[1];
+    if (is_prefixed_hex(tokens[0]) || (!is_prefixed_hex(tokens[1]) && !is_hex(tokens[1]))) {
+      name = tokens[1];
+      address = tokens[0];
+    }
+
+    if (!is_name(name) || !(is_hex(address) || is_prefixed_hex(address))) {
+      continue;
+    }
+    if (!symbols_add(symbols, hex_address(address), name, strlen(name))) {
+      fclose(file);
+      return 0;
+    }
+  }
+
+  fclose(file);
+  return 1;
+}
+
+void symbols_free(lc3_symbols* symbols) {
+  if (symbols->names) {
+    for (uint32_t address = 0; address < MEMORY_SIZE; ++address) {
+      free(symbols->names[address]);
+    }
+    free(symbols->names);
+  }
+  symbols_init(symbols);
+}
+
+const char* symbols_lookup(const lc3_symbols* symbols, uint16_t address) {
+  return symbols && symbols->names ? symbols->names[address] : NULL;
+}
+
+const char* symbols_nearest(const lc3_symbols* symbols, uint16_t address, uint16_t* offset) {
+  if (!symbols || !symbols->names) {
+    return NULL;
+  }
+
+  for (uint32_t a = address + 1; a-- > 0;) {
+    if (symbols->names[a]) {
+      *offset = (uint16_t) (address - a);
+      return symbols->names[a];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef _DISASSEMBLER
+#define _DISASSEMBLER
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Symbols
+Labels by address, loaded from a symbol file. Each line holds a
+label and a hex address in either order (x3000, 0x3000 or 3000);
+lines starting with // are read too, so lc3as .sym files work.
+*/
+typedef struct lc3_symbols {
+  char** names;         /* MEMORY_SIZE entries, NULL where there is no label */
+  size_t count;
+} lc3_symbols;
+
+enum { SYMBOL_NAME_MAX = 63 };
+
+void symbols_init(lc3_symbols* symbols);
+int symbols_load(lc3_symbols* symbols, const char* path);
+int symbols_add(lc3_symbols* symbols, uint16_t address, const char* name, size_t length);
+void symbols_free(lc3_symbols* symbols);
+
+/* Label at address, or NULL */
+const char* symbols_lookup(const lc3_symbols* symbols, uint16_t address);
+
+/* Closest label at or below address, or NULL */
+const char* symbols_nearest(const lc3_symbols* symbols, uint16_t address, uint16_t* offset);
+
+/* Disassembler
+Renders one instruction as assembly text. PC-relative operands are
+shown as the target address, or its label when symbols is given.
+No stdio: the output is built with table lookups and digit tables,
+so traces can be rendered at tens of millions of lines per second.
+*/
+enum { DISASSEMBLY_MAX = 32 + SYMBOL_NAME_MAX };
+
+/* Writes a NUL terminated string to out and returns its length */
+size_t disassemble(uint16_t address, uint16_t instruction, const lc3_symbols* symbols, char* out);
+
+/* A listing line, as used by traces and reports:
+   x3000  1021  LOOP: ADD R0, R0, #1
+*/
+enum { DISASSEMBLY_LINE_MAX = 16 + SYMBOL_NAME_MAX + DISASSEMBLY_MAX };
+
+size_t disassemble_line(uint16_t address, uint16_t instruction, const lc3_symbols* symbols, char* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _ENGINE
+#define _ENGINE
+
+#include <stdint.h>
+
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Budget meaning "until the machine stops" */
+#define RUN_FOREVER UINT64_MAX
+
+/* Engine
+Runs at most budget instructions on vm, stopping early if the
+machine halts, faults, hits a breakpoint or waits for input.
+Returns the number of instructions executed; stopping on a
+breakpoint or to wait counts as one.
+*/
+typedef uint64_t (*engine_run)(lc3_vm* vm, uint64_t budget);
+
+typedef struct lc3_engine {
+  const char* name;
+  engine_run run;
+} lc3_engine;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
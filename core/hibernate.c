@@ -0,0 +1,125 @@
+#include "hibernate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "page-allocator.h"
+#include "shared-image.h"
+
+/* A page is encoded as pairs of runs, each pair a count of words equal
+to the base, a count of words that differ, then those words. Pairs
+hold at least one word, so a page takes at most this many words */
+enum { PAGE_ENCODED_MAX = 3 * MEMORY_PAGE_WORDS / 2 + 2 };
+
+static const uint16_t zero_page[MEMORY_PAGE_WORDS];
+
+static const uint16_t* base_page(const lc3_vm* vm, int page) {
+  return vm->image ? vm->image->memory + page * MEMORY_PAGE_WORDS : zero_page;
+}
+
+// Encode words against base into out; returns the words written
+static size_t encode_page(const uint16_t* words, const uint16_t* base, uint16_t* out) {
+  size_t length = 0;
+  size_t i = 0;
+
+  while (i < MEMORY_PAGE_WORDS) {
+    size_t same = i;
+    while (same < MEMORY_PAGE_WORDS && words[same] == base[same]) {
+      ++same;
+    }
+    size_t differ = same;
+    while (differ < MEMORY_PAGE_WORDS && words[differ] != base[differ]) {
+      ++differ;
+    }
+
+    out[length++] = (uint16_t) (same - i);
+    out[length++] = (uint16_t) (differ - same);
+    memcpy(out + length, words + same, (differ - same) * sizeof(uint16_t));
+    length += differ - same;
+    i = differ;
+  }
+  return length;
+}
+
+// Decode a page over memory that holds its base; returns the words read
+static size_t decode_page(const uint16_t* in, uint16_t* words) {
+  size_t length = 0;
+  size_t i = 0;
+
+  while (i < MEMORY_PAGE_WORDS) {
+    i += in[length++];
+    uint16_t differ = in[length++];
+    memcpy(words + i, in + length, differ * sizeof(uint16_t));
+    length += differ;
+    i += differ;
+  }
+  return length;
+}
+
+int vm_hibernate(lc3_vm* vm) {
+  if (vm->hibernated) {
+    return 1;
+  }
+
+  uint64_t pages = 0;
+  for (uint64_t p = vm->dirty_pages; p; p &= p - 1) {
+    int page = __builtin_ctzll(p);
+    if (memcmp(vm->memory + page * MEMORY_PAGE_WORDS, base_page(vm, page), MEMORY_PAGE_WORDS * sizeof(uint16_t))) {
+      pages |= 1ull << page;
+    }
+  }
+
+  size_t capacity = __builtin_popcountll(pages) * PAGE_ENCODED_MAX;
+  lc3_hibernation* h = (lc3_hibernation*) malloc(sizeof(lc3_hibernation) + capacity * sizeof(uint16_t));
+  if (!h) {
+    return 0;
+  }
+
+  h->pages = pages;
+  h->length = 0;
+  for (uint64_t p = pages; p; p &= p - 1) {
+    int page = __builtin_ctzll(p);
+    h->length += encode_page(vm->memory + page * MEMORY_PAGE_WORDS, base_page(vm, page), h->words + h->length);
+  }
+
+  lc3_hibernation* shrunk = (lc3_hibernation*) realloc(h, sizeof(lc3_hibernation) + h->length * sizeof(uint16_t));
+  vm->hibernated = shrunk ? shrunk : h;
+
+  // A fresh view of the image drops the copied pages but keeps the
+  // mapping (failing that, the image is copied over them, which wakes
+  // just as well); other memory goes back to the allocator
+  if (vm->image && vm->image->fd >= 0) {
+    shared_image_map(vm);
+  }
+  else {
+    memory_free(vm->memory);
+    vm->memory = NULL;
+  }
+  return 1;
+}
+
+int vm_wake(lc3_vm* vm) {
+  lc3_hibernation* h = vm->hibernated;
+  if (!h) {
+    return 1;
+  }
+
+  if (!vm->memory) {
+    if (vm->image ? !shared_image_map(vm) : !(vm->memory = memory_alloc())) {
+      return 0;
+    }
+  }
+
+  const uint16_t* in = h->words;
+  for (uint64_t p = h->pages; p; p &= p - 1) {
+    in += decode_page(in, vm->memory + __builtin_ctzll(p) * MEMORY_PAGE_WORDS);
+  }
+
+  free(h);
+  vm->hibernated = NULL;
+  return 1;
+}
+
+size_t vm_hibernated_size(const lc3_vm* vm) {
+  return vm->hibernated ? sizeof(lc3_hibernation) + vm->hibernated->length * sizeof(uint16_t) : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef _HIBERNATE
+#define _HIBERNATE
+
+#include <stdint.h>
+
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hibernation
+A VM that will not run for a while can give back its memory. Each
+page it wrote (dirty_pages) that now differs from where it started,
+the image it maps or zero, is kept as runs of words equal to that
+base and runs of the words that differ. Then the VM's own memory is
+released: a VM with a shared image gets a fresh view of it, which
+drops every page it copied, and any other gives its memory back.
+
+Registers, console and debug state stay as they are. A hibernated VM
+must be woken before it runs; waking restores memory exactly.
+*/
+typedef struct lc3_hibernation {
+  uint64_t pages;     /* pages kept, in page order in words */
+  size_t length;      /* words */
+  uint16_t words[];
+} lc3_hibernation;
+
+/* Returns 0 if there was no memory for the compressed copy, and
+leaves the VM as it was */
+int vm_hibernate(lc3_vm* vm);
+
+/* Returns 0 if memory could not be had, and leaves the VM hibernated */
+int vm_wake(lc3_vm* vm);
+
+/* Bytes the hibernated VM holds for its memory */
+size_t vm_hibernated_size(const lc3_vm* vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
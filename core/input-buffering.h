@@ -1,8 +1,16 @@
 #ifndef _INPUTBUFFERING
 #define _INPUTBUFFERING
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void disable_input_buffering();
 void restore_input_buffering();
 void handle_interrupt(int signal);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
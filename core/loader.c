@@ -0,0 +1,187 @@
+#include "loader.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+
+static int fail(lc3_loader* loader, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(loader->error, sizeof(loader->error), format, args);
+  va_end(args);
+  return 0;
+}
+
+void loader_init(lc3_loader* loader) {
+  memset(loader, 0, sizeof(*loader));
+}
+
+void loader_free(lc3_loader* loader) {
+  for (int i = 0; i < loader->segment_count; ++i) {
+    free(loader->segments[i].words);
+  }
+  loader_init(loader);
+}
+
+int loader_add(lc3_loader* loader, const char* source, uint16_t origin, const uint16_t* words, uint32_t length) {
+  uint32_t end = (uint32_t) origin + length;
+
+  if (length == 0) {
+    return 1;
+  }
+  if (end > MEMORY_SIZE) {
+    return fail(loader, "%s: x%04X-x%04X runs past the end of memory", source, origin, end - 1);
+  }
+  if (loader->segment_count == LOADER_MAX_SEGMENTS) {
+    return fail(loader, "%s: more than %d segments", source, LOADER_MAX_SEGMENTS);
+  }
+
+  // Keep the map sorted by origin; only the neighbours can overlap
+  int i = loader->segment_count;
+  while (i > 0 && loader->segments[i - 1].origin > origin) {
+    --i;
+  }
+
+  const lc3_segment* before = i > 0 ? &loader->segments[i - 1] : NULL;
+  const lc3_segment* after = i < loader->segment_count ? &loader->segments[i] : NULL;
+  if (before && before->origin + before->length > origin) {
+    return fail(loader, "%s (x%04X-x%04X) overlaps %s (x%04X-x%04X)", source, origin, end - 1,
+                before->source, before->origin, before->origin + before->length - 1);
+  }
+  if (after && end > after->origin) {
+    return fail(loader, "%s (x%04X-x%04X) overlaps %s (x%04X-x%04X)", source, origin, end - 1,
+                after->source, after->origin, after->origin + after->length - 1);
+  }
+
+  uint16_t* copy = (uint16_t*) malloc(length * sizeof(uint16_t));
+  if (!copy) {
+    return fail(loader, "%s: out of memory", source);
+  }
+  memcpy(copy, words, length * sizeof(uint16_t));
+
+  memmove(&loader->segments[i + 1], &loader->segments[i], (loader->segment_count - i) * sizeof(lc3_segment));
+  loader->segments[i].source = source;
+  loader->segments[i].origin = origin;
+  loader->segments[i].length = length;
+  loader->segments[i].words = copy;
+  ++loader->segment_count;
+  return 1;
+}
+
+// Big-endian origin followed by big-endian words
+int loader_add_image(lc3_loader* loader, const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return fail(loader, "%s: cannot open", path);
+  }
+
+  // An image holds at most the origin word and all of memory;
+  // one byte more means it is too big
+  size_t capacity = 2 * (MEMORY_SIZE + 1) + 1;
+  uint8_t* data = (uint8_t*) malloc(capacity);
+  if (!data) {
+    fclose(file);
+    return fail(loader, "%s: out of memory", path);
+  }
+  size_t size = fread(data, 1, capacity, file);
+  fclose(file);
+
+  if (size < 2 || size % 2 != 0 || size == capacity) {
+    free(data);
+    return fail(loader, "%s: not an image (%zu bytes)", path, size);
+  }
+
+  uint16_t origin = data[0] << 8 | data[1];
+  uint32_t length = (uint32_t) (size / 2 - 1);
+  uint16_t* words = (uint16_t*) data;
+
+  // In place: word i is read from bytes 2i + 2 and 2i + 3 before being overwritten
+  for (uint32_t i = 0; i < length; ++i) {
+    words[i] = data[2 * i + 2] << 8 | data[2 * i + 3];
+  }
+
+  int ok = loader_add(loader, path, origin, words, length);
+  free(data);
+  return ok;
+}
+
+// Every .ORIG block of the source becomes a segment
+int loader_add_source(lc3_loader* loader, const char* path, lc3_symbols* symbols) {
+  uint16_t* scratch = (uint16_t*) malloc(MEMORY_SIZE * sizeof(uint16_t));
+  asm_result result;
+
+  if (!scratch) {
+    return fail(loader, "%s: out of memory", path);
+  }
+
+  if (!assemble_file(path, scratch, symbols, &result)) {
+    if (result.error_line) {
+      fail(loader, "%s:%d: %s", path, result.error_line, result.error);
+    }
+    else {
+      fail(loader, "%s: %s", path, result.error);
+    }
+    free(scratch);
+    return 0;
+  }
+
+  int ok = 1;
+  for (int i = 0; ok && i < result.segment_count; ++i) {
+    const asm_segment* segment = &result.segments[i];
+    ok = loader_add(loader, path, segment->origin, scratch + segment->origin, segment->length);
+  }
+  free(scratch);
+  return ok;
+}
+
+uint64_t loader_pages(const lc3_loader* loader) {
+  uint64_t pages = 0;
+
+  for (int i = 0; i < loader->segment_count; ++i) {
+    const lc3_segment* segment = &loader->segments[i];
+    uint32_t last = segment->origin + segment->length - 1;
+
+    for (uint32_t page = segment->origin >> MEMORY_PAGE_SHIFT; page <= last >> MEMORY_PAGE_SHIFT; ++page) {
+      pages |= 1ull << page;
+    }
+  }
+  return pages;
+}
+
+int loader_find(const lc3_loader* loader, uint16_t address) {
+  int low = 0;
+  int high = loader->segment_count - 1;
+
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    const lc3_segment* segment = &loader->segments[middle];
+
+    if (address < segment->origin) {
+      high = middle - 1;
+    }
+    else if (address >= segment->origin + segment->length) {
+      low = middle + 1;
+    }
+    else {
+      return middle;
+    }
+  }
+  return -1;
+}
+
+void loader_install(const lc3_loader* loader, lc3_vm* vm) {
+  for (int i = 0; i < loader->segment_count; ++i) {
+    const lc3_segment* segment = &loader->segments[i];
+    memcpy(vm->memory + segment->origin, segment->words, segment->length * sizeof(uint16_t));
+  }
+}
+
+void loader_print(const lc3_loader* loader, FILE* out) {
+  for (int i = 0; i < loader->segment_count; ++i) {
+    const lc3_segment* segment = &loader->segments[i];
+    fprintf(out, "segment  x%04X-x%04X  %5u words  %s\n", segment->origin,
+            segment->origin + segment->length - 1, segment->length, segment->source);
+  }
+}
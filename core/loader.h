@@ -0,0 +1,57 @@
+#ifndef _LOADER
+#define _LOADER
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "core.h"
+#include "disassembler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Loader
+Reads every image (and assembles every source) up front into a
+segment map, rejecting images that overlap or run past the end of
+memory, then installs the segments into a VM in one go.
+*/
+enum { LOADER_MAX_SEGMENTS = 64 };
+
+typedef struct lc3_segment {
+  const char* source;     /* image or source path, not copied */
+  uint16_t origin;
+  uint32_t length;        /* words */
+  uint16_t* words;
+} lc3_segment;
+
+typedef struct lc3_loader {
+  lc3_segment segments[LOADER_MAX_SEGMENTS];   /* sorted by origin */
+  int segment_count;
+  char error[256];
+} lc3_loader;
+
+void loader_init(lc3_loader* loader);
+void loader_free(lc3_loader* loader);
+
+/* Each returns 0 and sets loader->error on failure */
+int loader_add(lc3_loader* loader, const char* source, uint16_t origin, const uint16_t* words, uint32_t length);
+int loader_add_image(lc3_loader* loader, const char* path);
+int loader_add_source(lc3_loader* loader, const char* path, lc3_symbols* symbols);
+
+/* Pages holding at least one segment */
+uint64_t loader_pages(const lc3_loader* loader);
+
+/* Index of the segment holding address, or -1 */
+int loader_find(const lc3_loader* loader, uint16_t address);
+
+/* Copy the segments into memory */
+void loader_install(const lc3_loader* loader, lc3_vm* vm);
+
+void loader_print(const lc3_loader* loader, FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,408 @@
+#include "mailbox.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static lc3_mailbox* mailbox_create(int receiver, uint32_t capacity) {
+  size_t size = sizeof(lc3_mailbox) + capacity * sizeof(mailbox_slot);
+  size = (size + CACHE_LINE_SIZE - 1) & ~(size_t) (CACHE_LINE_SIZE - 1);
+
+  lc3_mailbox* mailbox = (lc3_mailbox*) aligned_alloc(CACHE_LINE_SIZE, size);
+  if (!mailbox) {
+    return NULL;
+  }
+  memset(mailbox, 0, size);
+  mailbox->mask = capacity - 1;
+  mailbox->receiver = receiver;
+  for (uint32_t i = 0; i < capacity; ++i) {
+    mailbox->slots[i].sequence = i;
+  }
+  return mailbox;
+}
+
+mailbox_network* mailbox_network_create(int ports, uint32_t capacity) {
+  if (ports < 1 || ports > MAILBOX_MAX_PORTS || capacity < 1 || capacity > 1u << 30) {
+    return NULL;
+  }
+  uint32_t rounded = 2;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+
+  mailbox_network* network = (mailbox_network*) calloc(1, sizeof(mailbox_network));
+  if (!network) {
+    return NULL;
+  }
+  for (int i = 0; i < ports; ++i) {
+    mailbox_port* port = &network->ports[i];
+    int fds[2] = { -1, -1 };
+
+    port->network = network;
+    port->id = i;
+    port->wake_fd = -1;
+    port->wake_write_fd = -1;
+    ++network->port_count;
+
+    port->inbox = mailbox_create(i, rounded);
+    if (!port->inbox || pipe(fds) != 0) {
+      mailbox_network_free(network);
+      return NULL;
+    }
+    port->wake_fd = fds[0];
+    port->wake_write_fd = fds[1];
+    for (int j = 0; j < 2; ++j) {
+      fcntl(fds[j], F_SETFL, fcntl(fds[j], F_GETFL) | O_NONBLOCK);
+      fcntl(fds[j], F_SETFD, FD_CLOEXEC);
+    }
+  }
+  return network;
+}
+
+void mailbox_network_free(mailbox_network* network) {
+  if (!network) {
+    return;
+  }
+  for (int i = 0; i < network->port_count; ++i) {
+    mailbox_port* port = &network->ports[i];
+    free(port->inbox);
+    if (port->wake_fd >= 0) {
+      close(port->wake_fd);
+      close(port->wake_write_fd);
+    }
+  }
+  free(network);
+}
+
+int mailbox_connect(mailbox_network* network, int from, int to) {
+  if (from < 0 || from >= network->port_count || to < 0 || to >= network->port_count) {
+    return -1;
+  }
+  mailbox_port* port = &network->ports[from];
+  lc3_mailbox* inbox = network->ports[to].inbox;
+
+  // Each inbox at most once, so the outboxes never overflow
+  for (int i = 0; i < port->outbox_count; ++i) {
+    if (port->outboxes[i] == to) {
+      return -1;
+    }
+  }
+  if (port->outbox_count >= MAILBOX_MAX_PORTS) {
+    return -1;
+  }
+
+  // A port sending to itself is never waited for to close
+  inbox->producers++;
+  inbox->open_senders += from != to;
+  port->outboxes[port->outbox_count] = to;
+  return port->outbox_count++;
+}
+
+void mailbox_attach(lc3_vm* vm, mailbox_port* port) {
+  vm->mailbox = port;
+}
+
+// A full pipe has a wake-up pending already
+static void wake(mailbox_port* port) {
+  char one = 1;
+  if (write(port->wake_write_fd, &one, 1) < 0) {
+  }
+}
+
+/* THE QUEUE
+With one producer, head and tail are each written by one side, and
+each side keeps the other's as last read so a full or empty check
+only reads it again when it seems to say so. With several, producers
+claim a slot by advancing tail and fill it later, and each slot's
+sequence says when it has been filled and when read (Vyukov's
+bounded queue) */
+
+// Multiple producers: take the slot at tail, 0 if full
+static int claim(lc3_mailbox* m, uint32_t* index) {
+  uint32_t tail = __atomic_load_n(&m->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    int32_t lag = (int32_t) (__atomic_load_n(&m->slots[tail & m->mask].sequence, __ATOMIC_ACQUIRE) - tail);
+    if (lag == 0) {
+      if (__atomic_compare_exchange_n(&m->tail, &tail, tail + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *index = tail;
+        return 1;
+      }
+    }
+    else if (lag < 0) {
+      return 0;
+    }
+    else {
+      tail = __atomic_load_n(&m->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void fill(lc3_mailbox* m, uint32_t index, uint16_t word, int skip) {
+  mailbox_slot* slot = &m->slots[index & m->mask];
+  slot->word = word;
+  slot->skip = (uint16_t) skip;
+  __atomic_store_n(&slot->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+static int push(lc3_mailbox* m, uint16_t word) {
+  if (m->producers > 1) {
+    uint32_t index;
+    if (!claim(m, &index)) {
+      return 0;
+    }
+    fill(m, index, word, 0);
+    return 1;
+  }
+
+  uint32_t tail = m->tail;
+  if (tail - m->cached_head > m->mask) {
+    m->cached_head = __atomic_load_n(&m->head, __ATOMIC_ACQUIRE);
+    if (tail - m->cached_head > m->mask) {
+      return 0;
+    }
+  }
+  m->slots[tail & m->mask].word = word;
+  __atomic_store_n(&m->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Receiver only. Multiple producers: slots given up are passed over.
+// Returns the filled slot at head, or NULL
+static mailbox_slot* peek(lc3_mailbox* m) {
+  if (m->producers <= 1) {
+    if (m->head == m->cached_tail) {
+      m->cached_tail = __atomic_load_n(&m->tail, __ATOMIC_ACQUIRE);
+      if (m->head == m->cached_tail) {
+        return NULL;
+      }
+    }
+    return &m->slots[m->head & m->mask];
+  }
+
+  for (;;) {
+    mailbox_slot* slot = &m->slots[m->head & m->mask];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != m->head + 1) {
+      return NULL;
+    }
+    if (!slot->skip) {
+      return slot;
+    }
+    __atomic_store_n(&slot->sequence, m->head + m->mask + 1, __ATOMIC_RELEASE);
+    ++m->head;
+  }
+}
+
+static int pop(lc3_mailbox* m, uint16_t* word) {
+  mailbox_slot* slot = peek(m);
+  if (!slot) {
+    return 0;
+  }
+  *word = slot->word;
+  if (m->producers > 1) {
+    __atomic_store_n(&slot->sequence, m->head + m->mask + 1, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&m->head, m->head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Sender only
+static int can_send(lc3_mailbox* m) {
+  if (m->producers <= 1) {
+    return m->tail - __atomic_load_n(&m->head, __ATOMIC_ACQUIRE) <= m->mask;
+  }
+  uint32_t tail = __atomic_load_n(&m->tail, __ATOMIC_RELAXED);
+  return __atomic_load_n(&m->slots[tail & m->mask].sequence, __ATOMIC_ACQUIRE) == tail;
+}
+
+/* WAKING
+A side about to sleep says so, then looks at the queue again; the
+other side changes the queue, then looks for sleepers. With a full
+fence between each store and load, one of them sees the other */
+static void wake_receiver(mailbox_network* network, lc3_mailbox* mailbox) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&mailbox->receiver_waiting, __ATOMIC_RELAXED)
+      && __atomic_exchange_n(&mailbox->receiver_waiting, 0, __ATOMIC_RELAXED)) {
+    wake(&network->ports[mailbox->receiver]);
+  }
+}
+
+static void wake_senders(mailbox_network* network, lc3_mailbox* mailbox) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&mailbox->senders_waiting, __ATOMIC_RELAXED)) {
+    for (uint64_t s = __atomic_exchange_n(&mailbox->senders_waiting, 0, __ATOMIC_RELAXED); s; s &= s - 1) {
+      wake(&network->ports[__builtin_ctzll(s)]);
+    }
+  }
+}
+
+int mailbox_send(mailbox_network* network, lc3_mailbox* mailbox, uint16_t word) {
+  if (!push(mailbox, word)) {
+    return 0;
+  }
+  wake_receiver(network, mailbox);
+  return 1;
+}
+
+int mailbox_receive(mailbox_network* network, lc3_mailbox* mailbox, uint16_t* word) {
+  if (!pop(mailbox, word)) {
+    return 0;
+  }
+  wake_senders(network, mailbox);
+  return 1;
+}
+
+// Give up the slot taken for a word that will not be written
+static void unclaim(mailbox_port* port) {
+  if (port->claimed) {
+    fill(port->claimed, port->claim, 0, 1);
+    wake_receiver(port->network, port->claimed);
+    port->claimed = NULL;
+  }
+}
+
+void mailbox_close(mailbox_port* port) {
+  mailbox_network* network = port->network;
+
+  unclaim(port);
+
+  // Senders waiting for room find the inbox closed instead
+  __atomic_store_n(&port->inbox->closed, 1, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < network->port_count; ++i) {
+    if (__atomic_load_n(&port->inbox->senders_waiting, __ATOMIC_SEQ_CST) & (1ull << i)) {
+      wake(&network->ports[i]);
+    }
+  }
+
+  for (int i = 0; i < port->outbox_count; ++i) {
+    lc3_mailbox* outbox = network->ports[port->outboxes[i]].inbox;
+    if (outbox != port->inbox && __atomic_sub_fetch(&outbox->open_senders, 1, __ATOMIC_SEQ_CST) == 0) {
+      wake(&network->ports[outbox->receiver]);
+    }
+  }
+}
+
+/* DEVICE REGISTERS */
+static uint16_t receive_status(lc3_vm* vm, mailbox_port* port) {
+  lc3_mailbox* inbox = port->inbox;
+
+  if (peek(inbox)) {
+    return MAILBOX_READY;
+  }
+  // Every word was sent before its sender closed
+  if (__atomic_load_n(&inbox->open_senders, __ATOMIC_ACQUIRE) == 0) {
+    return peek(inbox) ? MAILBOX_READY : MAILBOX_CLOSED;
+  }
+  if (!vm->console.nonblocking) {
+    return 0;
+  }
+
+  __atomic_store_n(&inbox->receiver_waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (peek(inbox) || __atomic_load_n(&inbox->open_senders, __ATOMIC_ACQUIRE) == 0) {
+    __atomic_store_n(&inbox->receiver_waiting, 0, __ATOMIC_RELAXED);
+    return receive_status(vm, port);
+  }
+  vm->status = VM_WAIT;
+  port->waiting = 1;
+  return 0;
+}
+
+// Room for a word, held for this port if others send there too
+static int room(mailbox_port* port, lc3_mailbox* outbox) {
+  if (outbox->producers <= 1) {
+    return can_send(outbox);
+  }
+  if (!port->claimed && claim(outbox, &port->claim)) {
+    port->claimed = outbox;
+  }
+  return port->claimed != NULL;
+}
+
+static lc3_mailbox* selected(const mailbox_port* port) {
+  return port->destination < port->outbox_count
+         ? port->network->ports[port->outboxes[port->destination]].inbox : NULL;
+}
+
+static uint16_t transmit_status(lc3_vm* vm, mailbox_port* port) {
+  lc3_mailbox* outbox = selected(port);
+  if (!outbox) {
+    return MAILBOX_CLOSED;
+  }
+  uint16_t dropped = port->dropped ? MAILBOX_DROPPED : 0;
+  port->dropped = 0;
+
+  if (__atomic_load_n(&outbox->closed, __ATOMIC_ACQUIRE)) {
+    return MAILBOX_READY | MAILBOX_CLOSED | dropped;
+  }
+  if (room(port, outbox)) {
+    return MAILBOX_READY | dropped;
+  }
+  if (!vm->console.nonblocking) {
+    return dropped;
+  }
+
+  uint64_t bit = 1ull << port->id;
+  __atomic_fetch_or(&outbox->senders_waiting, bit, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (can_send(outbox) || __atomic_load_n(&outbox->closed, __ATOMIC_ACQUIRE)) {
+    __atomic_fetch_and(&outbox->senders_waiting, ~bit, __ATOMIC_RELAXED);
+    port->dropped = dropped != 0;
+    return transmit_status(vm, port);
+  }
+  vm->status = VM_WAIT;
+  port->waiting = 1;
+  return dropped;
+}
+
+static void transmit(mailbox_port* port, uint16_t word) {
+  lc3_mailbox* outbox = selected(port);
+
+  if (port->claimed) {
+    fill(port->claimed, port->claim, word, 0);
+    wake_receiver(port->network, port->claimed);
+    port->claimed = NULL;
+  }
+  else if (outbox && !__atomic_load_n(&outbox->closed, __ATOMIC_ACQUIRE)
+           && !mailbox_send(port->network, outbox, word)) {
+    port->dropped = 1;
+  }
+}
+
+void mailbox_read(lc3_vm* vm, uint16_t address) {
+  mailbox_port* port = vm->mailbox;
+  uint16_t word;
+
+  port->waiting = 0;
+  switch (address) {
+    case MR_MRSR:
+      vm->memory[address] = receive_status(vm, port);
+      break;
+    case MR_MRDR:
+      if (mailbox_receive(port->network, port->inbox, &word)) {
+        vm->memory[address] = word;
+      }
+      break;
+    case MR_MTSR:
+      vm->memory[address] = transmit_status(vm, port);
+      break;
+    case MR_MPID:
+      vm->memory[address] = (uint16_t) port->id;
+      break;
+    default:
+      return;
+  }
+  vm->dirty_pages |= 1ull << (address >> MEMORY_PAGE_SHIFT);
+}
+
+void mailbox_write(lc3_vm* vm, uint16_t address, uint16_t value) {
+  mailbox_port* port = vm->mailbox;
+
+  if (address == MR_MTDR) {
+    transmit(port, value);
+  }
+  else if (address == MR_MTDS && value != port->destination) {
+    unclaim(port);
+    port->destination = value;
+  }
+}
@@ -0,0 +1,148 @@
+#ifndef _MAILBOX
+#define _MAILBOX
+
+#include <stdint.h>
+
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Mailboxes
+VMs in one process pass words to each other through a network of
+ports, one per VM. Each port has an inbox, a bounded lock-free queue
+that only its own VM reads, and may be connected to the inboxes of
+others, its outboxes. An inbox with one port connected to it is a
+single producer queue; with more it takes words from all of them
+(multiple producer, single consumer). Either way a word costs no lock
+and no system call unless the other side is asleep.
+
+A VM sees its port as device registers, in the manner of the
+keyboard's: status registers say whether a word can be received or
+sent, and data registers move it. Nothing changes for a VM without a
+port, where these addresses are memory.
+
+  MR_MRSR  receive status: bit 15, a word is waiting; bit 14, none
+           is and none will come, every sender having closed
+  MR_MRDR  receive data: reading takes the waiting word
+  MR_MTSR  transmit status, for the selected outbox: bit 15, a word
+           can be sent; bit 14, its reader has closed and words sent
+           are dropped; bit 0, a word was sent while it was full and
+           dropped, since the last read
+  MR_MTDR  transmit data: writing sends the word
+  MR_MTDS  transmit select: the outbox used, numbered from 0 in the
+           order they were connected
+  MR_MPID  this port's number in the network
+
+Where several ports send to one inbox, room seen in MR_MTSR could
+be taken by another sender before the word is written, so reading
+MR_MTSR as ready takes a slot for this port's next word. A slot taken
+and not written when the port selects another outbox or closes is
+skipped by the reader.
+
+On an owner-resumed VM (console.nonblocking, see core.h), reading a
+status register that says to wait stops the machine with VM_WAIT
+after the instruction, like a KBSR poll, and the port's wake_fd
+becomes readable once the word or the room arrives. A scheduler
+parks the guest on it (see c/scheduler.h).
+
+Connections are made before any VM runs; ports close once, when
+their VM has stopped.
+*/
+enum {
+  MR_MRSR = 0xFE08,
+  MR_MRDR = 0xFE0A,
+  MR_MTSR = 0xFE0C,
+  MR_MTDR = 0xFE0E,
+  MR_MTDS = 0xFE10,
+  MR_MPID = 0xFE12
+};
+
+enum {
+  MAILBOX_READY = 1 << 15,
+  MAILBOX_CLOSED = 1 << 14,
+  MAILBOX_DROPPED = 1 << 0
+};
+
+enum { MAILBOX_MAX_PORTS = 64 };
+
+typedef struct mailbox_slot {
+  uint32_t sequence;    /* multiple producers: the send it awaits, or the receive plus one */
+  uint16_t word;
+  uint16_t skip;        /* multiple producers: taken and given up, no word */
+} mailbox_slot;
+
+typedef struct lc3_mailbox {
+  uint32_t mask;                /* capacity - 1 */
+  int producers;                /* ports connected to it */
+  int receiver;                 /* the port it belongs to */
+
+  /* Written by senders */
+  uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+  uint32_t cached_head;         /* single producer: head as last read */
+
+  /* Written by the receiver */
+  uint32_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+  uint32_t cached_tail;         /* single producer: tail as last read */
+
+  /* Shared, rarely written: who to wake and who is left */
+  int receiver_waiting __attribute__((aligned(CACHE_LINE_SIZE)));
+  uint64_t senders_waiting;     /* one bit per port */
+  int open_senders;
+  int closed;                   /* the receiver has stopped */
+
+  mailbox_slot slots[];
+} lc3_mailbox;
+
+typedef struct mailbox_port {
+  struct mailbox_network* network;
+  int id;
+  int wake_fd;                  /* readable when the VM should look again */
+  int wake_write_fd;
+  lc3_mailbox* inbox;
+  int outboxes[MAILBOX_MAX_PORTS];
+  int outbox_count;
+  uint16_t destination;
+  lc3_mailbox* claimed;         /* outbox with a slot taken for the next word */
+  uint32_t claim;
+  int dropped;
+  int waiting;                  /* the VM stopped on a status register */
+} mailbox_port;
+
+typedef struct mailbox_network {
+  int port_count;
+  mailbox_port ports[MAILBOX_MAX_PORTS];
+} mailbox_network;
+
+/* ports ports with capacity words each, rounded up to a power of two
+and at least 2. NULL on failure */
+mailbox_network* mailbox_network_create(int ports, uint32_t capacity);
+void mailbox_network_free(mailbox_network* network);
+
+/* Connect from's port to to's inbox. Returns the outbox number, or -1
+if either port does not exist or they are connected already */
+int mailbox_connect(mailbox_network* network, int from, int to);
+
+/* The VM behind vm->mailbox is its port from now on */
+void mailbox_attach(lc3_vm* vm, mailbox_port* port);
+
+/* The port's VM has stopped: its inbox drops what is sent to it, and
+the readers of its outboxes see it gone */
+void mailbox_close(mailbox_port* port);
+
+/* Queue operations for the host. Return 0 if full or empty; a word
+sent may be from any sender's thread, a word received only from the
+receiver's */
+int mailbox_send(mailbox_network* network, lc3_mailbox* mailbox, uint16_t word);
+int mailbox_receive(mailbox_network* network, lc3_mailbox* mailbox, uint16_t* word);
+
+/* Used by core.c on the VM's port registers */
+void mailbox_read(lc3_vm* vm, uint16_t address);
+void mailbox_write(lc3_vm* vm, uint16_t address, uint16_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+#include "page-allocator.h"
+#include "core.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+enum {
+  ARENA_SIZE = 2 << 20,  /* one huge page */
+  SLICE_SIZE = MEMORY_SIZE * sizeof(uint16_t),
+  SLICES_PER_ARENA = ARENA_SIZE / SLICE_SIZE
+};
+
+/* Free slices are linked through their first word */
+typedef struct free_slice {
+  struct free_slice* next;
+} free_slice;
+
+static free_slice* free_slices;
+static uint8_t* fresh_arena;
+static int fresh_remaining;
+static int huge_pages;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Map one 2 MiB aligned arena
+static void* map_arena() {
+  void* arena;
+
+#ifdef MAP_HUGETLB
+  arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (arena != MAP_FAILED) {
+    huge_pages = 1;
+    return arena;
+  }
+#endif
+
+  // Over-allocate so the arena can be aligned to a huge page boundary
+  uint8_t* region = (uint8_t*) mmap(NULL, 2 * ARENA_SIZE, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return NULL;
+  }
+
+  uint8_t* aligned = (uint8_t*) (((uintptr_t) region + ARENA_SIZE - 1) & ~(uintptr_t) (ARENA_SIZE - 1));
+  if (aligned > region) {
+    munmap(region, aligned - region);
+  }
+  munmap(aligned + ARENA_SIZE, region + 2 * ARENA_SIZE - (aligned + ARENA_SIZE));
+
+#ifdef MADV_HUGEPAGE
+  madvise(aligned, ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+  return aligned;
+}
+
+uint16_t* memory_alloc() {
+  pthread_mutex_lock(&lock);
+
+  // Recycled slices must be cleared
+  if (free_slices) {
+    free_slice* slice = free_slices;
+    free_slices = slice->next;
+    pthread_mutex_unlock(&lock);
+
+    memset(slice, 0, SLICE_SIZE);
+    return (uint16_t*) slice;
+  }
+
+  // Untouched slices of the current arena are zero already
+  if (!fresh_remaining) {
+    fresh_arena = (uint8_t*) map_arena();
+    if (!fresh_arena) {
+      pthread_mutex_unlock(&lock);
+      return NULL;
+    }
+    fresh_remaining = SLICES_PER_ARENA;
+  }
+
+  uint8_t* slice = fresh_arena + (size_t) (SLICES_PER_ARENA - fresh_remaining) * SLICE_SIZE;
+  --fresh_remaining;
+  pthread_mutex_unlock(&lock);
+  return (uint16_t*) slice;
+}
+
+void memory_free(uint16_t* memory) {
+  if (!memory) {
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  free_slice* slice = (free_slice*) memory;
+  slice->next = free_slices;
+  free_slices = slice;
+  pthread_mutex_unlock(&lock);
+}
+
+int memory_uses_huge_pages() {
+  return huge_pages;
+}
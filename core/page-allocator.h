@@ -0,0 +1,26 @@
+#ifndef _PAGE_ALLOCATOR
+#define _PAGE_ALLOCATOR
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Guest memory allocator
+Hands out zeroed 64K-word guest memories carved from 2 MiB
+arenas. Arenas use explicit huge pages when the system has
+them reserved, and transparent huge pages otherwise, so one
+TLB entry covers sixteen guests
+*/
+uint16_t* memory_alloc();
+void memory_free(uint16_t* memory);
+
+/* Non-zero if the arenas are backed by explicit huge pages */
+int memory_uses_huge_pages();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
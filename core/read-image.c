@@ -2,20 +2,20 @@
 #include <stdint.h>
 
 #include "bit-utilities.h"
+#include "core.h"
 #include "read-image.h"
 
 // Read an executable file into memory
 void read_image_file(FILE* file, uint16_t memory[]) {
 
-  printf("READ IMAGE FILE\n");
-
   uint16_t origin;
   fread(&origin, sizeof(origin), 1, file);
 
   // NOTE: LC-3 is Big Endian, but x86-64 is little endian
   origin = swap16(origin);
 
-  uint16_t max_read = UINT16_MAX - origin;
+  // Everything from origin to the last word of memory
+  size_t max_read = MEMORY_SIZE - origin;
   uint16_t* program = memory + origin;
   size_t read = fread(program, sizeof(uint16_t), max_read, file);
 
@@ -29,8 +29,6 @@ void read_image_file(FILE* file, uint16_t memory[]) {
 // Given a path, load the program into memory
 int read_image(const char* image_path, uint16_t memory[]) {
 
-  printf("READ IMAGE\n");
-  
   FILE* file = fopen(image_path, "rb");
   
   if (!file) { 
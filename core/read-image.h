@@ -4,7 +4,15 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void read_image_file(FILE* file, uint16_t memory[]);
 int read_image(const char* image_path, uint16_t memory[]);
 
-#endif
\ No newline at end of file
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+
+#include "shared-image.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "page-allocator.h"
+
+enum { IMAGE_SIZE = MEMORY_SIZE * sizeof(uint16_t) };
+
+// The in-memory file backing the image, -1 if there is none
+static int image_file(const uint16_t* memory) {
+#ifdef MFD_CLOEXEC
+  int fd = memfd_create("lc3-image", MFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (ftruncate(fd, IMAGE_SIZE) != 0 || pwrite(fd, memory, IMAGE_SIZE, 0) != IMAGE_SIZE) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+#else
+  (void) memory;
+  return -1;
+#endif
+}
+
+shared_image* shared_image_create(const lc3_loader* loader) {
+  shared_image* image = (shared_image*) calloc(1, sizeof(shared_image));
+  uint16_t* memory = memory_alloc();
+
+  if (!image || !memory) {
+    free(image);
+    memory_free(memory);
+    return NULL;
+  }
+
+  for (int i = 0; i < loader->segment_count; ++i) {
+    const lc3_segment* segment = &loader->segments[i];
+    memcpy(memory + segment->origin, segment->words, segment->length * sizeof(uint16_t));
+  }
+  image->references = 1;
+
+  // Keep a read-only view of the file rather than a second copy
+  image->fd = image_file(memory);
+  if (image->fd >= 0) {
+    void* view = mmap(NULL, IMAGE_SIZE, PROT_READ, MAP_SHARED, image->fd, 0);
+    if (view != MAP_FAILED) {
+      memory_free(memory);
+      image->memory = (uint16_t*) view;
+      return image;
+    }
+    close(image->fd);
+    image->fd = -1;
+  }
+
+  image->memory = memory;
+  return image;
+}
+
+void shared_image_release(shared_image* image) {
+  if (!image || __atomic_sub_fetch(&image->references, 1, __ATOMIC_ACQ_REL) > 0) {
+    return;
+  }
+
+  if (image->fd >= 0) {
+    munmap(image->memory, IMAGE_SIZE);
+    close(image->fd);
+  }
+  else {
+    memory_free(image->memory);
+  }
+  free(image);
+}
+
+// Map a fresh private view of the image over the VM's memory, or
+// copy the image into it. A fresh view drops every page the VM wrote
+int shared_image_map(lc3_vm* vm) {
+  const shared_image* image = vm->image;
+
+  if (image->fd >= 0) {
+    void* memory = mmap(vm->memory, IMAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | (vm->memory ? MAP_FIXED : 0), image->fd, 0);
+    if (memory != MAP_FAILED) {
+      vm->memory = (uint16_t*) memory;
+      return 1;
+    }
+    if (!vm->memory) {
+      return 0;
+    }
+  }
+  else if (!vm->memory && !(vm->memory = memory_alloc())) {
+    return 0;
+  }
+
+  memcpy(vm->memory, image->memory, IMAGE_SIZE);
+  return 1;
+}
+
+void shared_image_unmap(lc3_vm* vm) {
+  if (vm->image->fd >= 0) {
+    munmap(vm->memory, IMAGE_SIZE);
+  }
+  else {
+    memory_free(vm->memory);
+  }
+  vm->memory = NULL;
+
+  shared_image_release(vm->image);
+  vm->image = NULL;
+}
+
+int vm_init_image(lc3_vm* vm, shared_image* image) {
+  vm->memory = NULL;
+  vm->image = image;
+  if (!shared_image_map(vm)) {
+    vm->image = NULL;
+    return 0;
+  }
+  __atomic_add_fetch(&image->references, 1, __ATOMIC_RELAXED);
+
+  vm->console = stdio_console;
+  vm->debug = NULL;
+  vm->hibernated = NULL;
+  vm->mailbox = NULL;
+  vm->cpu = NULL;
+  vm->watched_pages = 0;
+  vm->break_pages = 0;
+  vm_reset(vm);
+  return 1;
+}
+
+lc3_vm* vm_create_image(shared_image* image) {
+  lc3_vm* vm = (lc3_vm*) aligned_alloc(CACHE_LINE_SIZE, sizeof(lc3_vm));
+  if (vm && !vm_init_image(vm, image)) {
+    free(vm);
+    vm = NULL;
+  }
+  return vm;
+}
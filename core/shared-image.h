@@ -0,0 +1,49 @@
+#ifndef _SHARED_IMAGE
+#define _SHARED_IMAGE
+
+#include <stdint.h>
+
+#include "core.h"
+#include "loader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared images
+A loaded memory image that many VMs map copy-on-write instead of
+each holding a private 128 KiB copy. The image lives in an anonymous
+in-memory file; every VM built from it maps the file privately, so
+pages it only reads stay shared with every other VM, and a page is
+copied the first time the VM writes it (4 KiB, two guest pages).
+
+Engines see an ordinary flat memory array, so nothing on the
+instruction path changes. Where the system has no memfd, each VM
+gets a private copy of the image instead.
+*/
+typedef struct shared_image {
+  int fd;                   /* -1 when VMs get private copies */
+  uint16_t* memory;         /* the image, as VMs see it at start */
+  int references;
+} shared_image;
+
+/* The segments of loader as one image, NULL on failure */
+shared_image* shared_image_create(const lc3_loader* loader);
+
+/* Drop a reference; the last VM or owner to let go frees the image */
+void shared_image_release(shared_image* image);
+
+/* Like vm_init, with memory mapped from the image. vm_reset returns
+the VM to the image contents, and vm_free releases the image */
+int vm_init_image(lc3_vm* vm, shared_image* image);
+lc3_vm* vm_create_image(shared_image* image);
+
+/* Used by core.c for VMs with an image */
+int shared_image_map(lc3_vm* vm);
+void shared_image_unmap(lc3_vm* vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+#include "smp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "page-allocator.h"
+
+lc3_smp* smp_create(int cpus) {
+  if (cpus < 1 || cpus > SMP_MAX_CPUS) {
+    return NULL;
+  }
+  size_t size = sizeof(lc3_smp) + cpus * sizeof(lc3_cpu);
+  lc3_smp* smp = (lc3_smp*) aligned_alloc(CACHE_LINE_SIZE, size);
+  if (!smp) {
+    return NULL;
+  }
+  memset(smp, 0, size);
+  if (!(smp->memory = memory_alloc())) {
+    free(smp);
+    return NULL;
+  }
+
+  smp->cpu_count = cpus;
+  for (int i = 0; i < cpus; ++i) {
+    lc3_cpu* cpu = &smp->cpus[i];
+    lc3_vm* vm = &cpu->vm;
+
+    cpu->smp = smp;
+    cpu->id = i;
+    vm->memory = smp->memory;
+    vm->cpu = cpu;
+    vm->image = NULL;
+    vm->hibernated = NULL;
+    vm->mailbox = NULL;
+    vm->console = stdio_console;
+    vm->debug = NULL;
+    vm->watched_pages = 0;
+    vm->break_pages = 0;
+    vm_reset(vm);
+  }
+  return smp;
+}
+
+void smp_destroy(lc3_smp* smp) {
+  if (!smp) {
+    return;
+  }
+  for (int i = 0; i < smp->cpu_count; ++i) {
+    vm_free(&smp->cpus[i].vm);
+  }
+  memory_free(smp->memory);
+  free(smp);
+}
+
+// Atomic operations fence on both sides, so plain accesses around
+// them are ordered too, as smp.h promises, on any host
+static uint16_t exchange(uint16_t* word, uint16_t value) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  uint16_t old = __atomic_exchange_n(word, value, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return old;
+}
+
+static uint16_t fetch_add(uint16_t* word, uint16_t value) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  uint16_t old = __atomic_fetch_add(word, value, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return old;
+}
+
+int smp_read(lc3_vm* vm, uint16_t address, uint16_t* value) {
+  lc3_cpu* cpu = vm->cpu;
+  uint16_t* word = &vm->memory[cpu->address];
+
+  switch (address) {
+    case MR_AADR:
+      *value = cpu->address;
+      return 1;
+    case MR_AVAL:
+      *value = cpu->operand;
+      return 1;
+    case MR_ATAS:
+      *value = exchange(word, 1);
+      break;
+    case MR_AFAA:
+      *value = fetch_add(word, cpu->operand);
+      break;
+    case MR_CPID:
+      *value = (uint16_t) cpu->id;
+      return 1;
+    case MR_NCPU:
+      *value = (uint16_t) cpu->smp->cpu_count;
+      return 1;
+    default:
+      return 0;
+  }
+  vm->dirty_pages |= 1ull << (cpu->address >> MEMORY_PAGE_SHIFT);
+  return 1;
+}
+
+void smp_write(lc3_vm* vm, uint16_t address, uint16_t value) {
+  if (address == MR_AADR) {
+    vm->cpu->address = value;
+  }
+  else if (address == MR_AVAL) {
+    vm->cpu->operand = value;
+  }
+}
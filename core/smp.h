@@ -0,0 +1,92 @@
+#ifndef _SMP
+#define _SMP
+
+#include <stdint.h>
+
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Multiprocessor
+Several vCPUs share one guest memory, each an lc3_vm with its own
+registers, PC, status and console, run by a host thread of its own.
+
+Memory ordering, as the vCPUs see each other:
+
+- Every load, store and instruction fetch moves a whole word: a vCPU
+  reads a word as some vCPU wrote it, never a mix of two.
+- A vCPU sees its own accesses in program order. Those of others it
+  may see late and in any order (relaxed): plain accesses are the
+  host's word moves, with no fence, so a weakly ordered host shows
+  the guest as much reordering as it does itself.
+- The atomic operations below are sequentially consistent and full
+  fences: whatever a vCPU did before one is visible to a vCPU whose
+  own atomic operation comes after it, before anything that vCPU
+  does next. Data is published with an atomic operation on both
+  sides, and a lock is released with one (MR_AFAA adding -1), not
+  with a store.
+- Instructions are fetched from memory as they run. No engine keeps
+  decoded code, and the goto engine's loop idioms (see c/idiom.h)
+  compare a vCPU's loop with memory word by word before running it,
+  so code written by one vCPU runs on another once the write is
+  visible to it, under the same rules as data.
+
+Each vCPU has its own device registers, in the manner of the
+keyboard's; nothing changes for a VM that is not a vCPU, where these
+addresses are memory.
+
+  MR_AADR  atomic address: the word the operations act on
+  MR_AVAL  atomic operand
+  MR_ATAS  test and set: reading sets the word to 1 and returns
+           what it held
+  MR_AFAA  fetch and add: reading adds MR_AVAL to the word and
+           returns what it held
+  MR_CPID  this vCPU's number, from 0
+  MR_NCPU  the number of vCPUs
+
+A vCPU reads its own values from these registers whatever the others
+do at the same addresses. The keyboard and display are shared; a
+guest leaves them to one vCPU, or takes a lock around them.
+*/
+enum {
+  MR_AADR = 0xFE14,
+  MR_AVAL = 0xFE16,
+  MR_ATAS = 0xFE18,
+  MR_AFAA = 0xFE1A,
+  MR_CPID = 0xFE1C,
+  MR_NCPU = 0xFE1E
+};
+
+enum { SMP_MAX_CPUS = 64 };
+
+/* One vCPU: the machine and its device registers */
+typedef struct lc3_cpu {
+  lc3_vm vm;
+  struct lc3_smp* smp;
+  int id;
+  uint16_t address;     /* MR_AADR */
+  uint16_t operand;     /* MR_AVAL */
+} lc3_cpu;
+
+typedef struct lc3_smp {
+  uint16_t* memory;     /* MEMORY_SIZE words, every vCPU's */
+  int cpu_count;
+  lc3_cpu cpus[];
+} lc3_smp;
+
+/* cpus vCPUs, reset, on zeroed memory. NULL on failure */
+lc3_smp* smp_create(int cpus);
+void smp_destroy(lc3_smp* smp);
+
+/* Used by core.c on a vCPU's device registers. smp_read returns
+non-zero with the value read if address is one of them */
+int smp_read(lc3_vm* vm, uint16_t address, uint16_t* value);
+void smp_write(lc3_vm* vm, uint16_t address, uint16_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
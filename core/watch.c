@@ -0,0 +1,166 @@
+#include "watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static lc3_debug* debug_state(lc3_vm* vm) {
+  if (!vm->debug) {
+    vm->debug = (lc3_debug*) calloc(1, sizeof(lc3_debug));
+    if (vm->debug) {
+      vm->debug->resume_pc = -1;
+    }
+  }
+  return vm->debug;
+}
+
+static uint64_t page_bits(uint16_t first, uint16_t last) {
+  uint64_t bits = 0;
+  for (int page = first >> MEMORY_PAGE_SHIFT; page <= last >> MEMORY_PAGE_SHIFT; ++page) {
+    bits |= 1ull << page;
+  }
+  return bits;
+}
+
+// Recompute which pages need the slow path
+static void update_pages(lc3_vm* vm) {
+  lc3_debug* debug = vm->debug;
+
+  vm->watched_pages = 0;
+  for (int i = 0; i < debug->watchpoint_count; ++i) {
+    vm->watched_pages |= page_bits(debug->watchpoints[i].first, debug->watchpoints[i].last);
+  }
+
+  vm->break_pages = 0;
+  for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+    for (int i = 0; i < MEMORY_PAGE_WORDS / 64; ++i) {
+      if (debug->breakpoints[page * (MEMORY_PAGE_WORDS / 64) + i]) {
+        vm->break_pages |= 1ull << page;
+        break;
+      }
+    }
+  }
+}
+
+// Returns the watchpoint index, or -1 if the table is full
+int watch_add(lc3_vm* vm, uint16_t first, uint16_t last, int kind) {
+  lc3_debug* debug = debug_state(vm);
+
+  if (!debug || debug->watchpoint_count == MAX_WATCHPOINTS || first > last || !(kind & WATCH_ACCESS)) {
+    return -1;
+  }
+
+  watchpoint* w = &debug->watchpoints[debug->watchpoint_count];
+  w->first = first;
+  w->last = last;
+  w->kind = kind & WATCH_ACCESS;
+  debug->watchpoint_count++;
+  update_pages(vm);
+  return debug->watchpoint_count - 1;
+}
+
+// Returns 1 if a matching watchpoint was removed
+int watch_remove(lc3_vm* vm, uint16_t first, uint16_t last, int kind) {
+  lc3_debug* debug = vm->debug;
+  if (!debug) {
+    return 0;
+  }
+
+  for (int i = 0; i < debug->watchpoint_count; ++i) {
+    watchpoint* w = &debug->watchpoints[i];
+    if (w->first == first && w->last == last && w->kind == (kind & WATCH_ACCESS)) {
+      *w = debug->watchpoints[--debug->watchpoint_count];
+      update_pages(vm);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int break_add(lc3_vm* vm, uint16_t address) {
+  lc3_debug* debug = debug_state(vm);
+  if (!debug) {
+    return 0;
+  }
+
+  debug->breakpoints[address / 64] |= 1ull << (address % 64);
+  vm->break_pages |= 1ull << (address >> MEMORY_PAGE_SHIFT);
+  return 1;
+}
+
+int break_remove(lc3_vm* vm, uint16_t address) {
+  lc3_debug* debug = vm->debug;
+  if (!debug || !(debug->breakpoints[address / 64] & (1ull << (address % 64)))) {
+    return 0;
+  }
+
+  debug->breakpoints[address / 64] &= ~(1ull << (address % 64));
+  update_pages(vm);
+  return 1;
+}
+
+void watch_clear(lc3_vm* vm) {
+  free(vm->debug);
+  vm->debug = NULL;
+  vm->watched_pages = 0;
+  vm->break_pages = 0;
+}
+
+void vm_resume(lc3_vm* vm) {
+  if (vm->status != VM_BREAK) {
+    return;
+  }
+
+  if (vm->debug && vm->debug->hit.kind == WATCH_BREAKPOINT) {
+    break_step_over(vm);
+  }
+  vm->status = VM_RUNNING;
+}
+
+void break_step_over(lc3_vm* vm) {
+  uint16_t pc = vm->registers[R_PC];
+
+  if (vm->debug && (vm->debug->breakpoints[pc / 64] & (1ull << (pc % 64)))) {
+    vm->debug->resume_pc = pc;
+  }
+}
+
+void watch_check(lc3_vm* vm, uint16_t address, int kind, uint16_t value) {
+  lc3_debug* debug = vm->debug;
+
+  for (int i = 0; i < debug->watchpoint_count; ++i) {
+    watchpoint* w = &debug->watchpoints[i];
+
+    if ((w->kind & kind) && address >= w->first && address <= w->last) {
+      debug->hit.kind = kind;
+      debug->hit.address = address;
+      debug->hit.value = value;
+      debug->hit.pc = vm->registers[R_PC] - 1;
+      vm->status = VM_BREAK;
+      return;
+    }
+  }
+}
+
+// Non-zero if the fetch at address hits a breakpoint. The PC is
+// rewound so the instruction runs when the machine resumes
+int break_check(lc3_vm* vm, uint16_t address) {
+  lc3_debug* debug = vm->debug;
+
+  if (debug->resume_pc == address) {
+    debug->resume_pc = -1;
+    return 0;
+  }
+  debug->resume_pc = -1;
+
+  if (!(debug->breakpoints[address / 64] & (1ull << (address % 64)))) {
+    return 0;
+  }
+
+  debug->hit.kind = WATCH_BREAKPOINT;
+  debug->hit.address = address;
+  debug->hit.value = vm->memory[address];
+  debug->hit.pc = address;
+  vm->registers[R_PC] = address;
+  vm->status = VM_BREAK;
+  return 1;
+}
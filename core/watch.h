@@ -0,0 +1,77 @@
+#ifndef _WATCH
+#define _WATCH
+
+#include <stdint.h>
+
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Watchpoints and Breakpoints
+Armed at run time on any VM. Pages with something armed are
+marked in the VM's watched_pages and break_pages bits; memory
+accesses on other pages only pay for one bit test.
+
+A hit stops the machine with status VM_BREAK after the access
+(watchpoints) or before the instruction (breakpoints), and is
+described in the VM's debug state. vm_resume continues.
+*/
+enum {
+  WATCH_READ = 1 << 0,
+  WATCH_WRITE = 1 << 1,
+  WATCH_ACCESS = WATCH_READ | WATCH_WRITE,
+  WATCH_BREAKPOINT = 1 << 2   /* hit kind of a PC breakpoint */
+};
+
+enum { MAX_WATCHPOINTS = 32 };
+
+typedef struct watchpoint {
+  uint16_t first;
+  uint16_t last;
+  int kind;
+} watchpoint;
+
+typedef struct watch_hit {
+  int kind;
+  uint16_t address;
+  uint16_t value;
+  uint16_t pc;     /* instruction that made the access */
+} watch_hit;
+
+typedef struct lc3_debug {
+  watchpoint watchpoints[MAX_WATCHPOINTS];
+  int watchpoint_count;
+
+  uint64_t breakpoints[MEMORY_SIZE / 64];
+  int32_t resume_pc;  /* breakpoint to step over on resume, or -1 */
+
+  watch_hit hit;
+} lc3_debug;
+
+int watch_add(lc3_vm* vm, uint16_t first, uint16_t last, int kind);
+int watch_remove(lc3_vm* vm, uint16_t first, uint16_t last, int kind);
+
+int break_add(lc3_vm* vm, uint16_t address);
+int break_remove(lc3_vm* vm, uint16_t address);
+
+void watch_clear(lc3_vm* vm);
+
+/* Continue after VM_BREAK */
+void vm_resume(lc3_vm* vm);
+
+/* Run the instruction at the PC once even if a breakpoint is armed
+there. Only takes effect when one is, since the breakpoint's page is
+what clears it on the next fetch */
+void break_step_over(lc3_vm* vm);
+
+/* Slow paths, only called on marked pages */
+void watch_check(lc3_vm* vm, uint16_t address, int kind, uint16_t value);
+int break_check(lc3_vm* vm, uint16_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "../core/core.h"
+#include "../core/engine.h"
+#include "../core/input-buffering.h"
+#include "../core/loader.h"
+
+#include "aot-runtime.hpp"
+#include "fetch-execute.h"
+
+uint32_t aotBlockOf[MEMORY_SIZE];
+
+aot_prediction aotReturnStack[AOT_RETURN_DEPTH];
+unsigned aotReturnTop;
+
+// Map every translated word to its block
+void aotInit() {
+  for (unsigned i = 0; i < AOT_RETURN_DEPTH; ++i) {
+    aotReturnStack[i] = { AOT_NO_ADDRESS, 0 };
+  }
+  for (unsigned b = 0; b < aotBlockCount; ++b) {
+    aotStale[b] = false;
+    for (uint32_t i = 0; i < aotBlocks[b].length; ++i) {
+      aotBlockOf[(uint16_t) (aotBlocks[b].address + i)] = b + 1;
+    }
+  }
+}
+
+// The word the translation was made from
+static uint16_t translatedWord(uint16_t address) {
+  for (unsigned s = 0; s < aotSegmentCount; ++s) {
+    const aot_segment* segment = &aotSegments[s];
+    if (address >= segment->origin && address - segment->origin < segment->length) {
+      return segment->words[address - segment->origin];
+    }
+  }
+  return 0;
+}
+
+// A store hit a translated word: once it differs from what was
+// translated, the block falls back to the interpreter for good
+bool aotStaleWord(const lc3_vm* vm, uint16_t address, uint32_t block) {
+  uint32_t hit = aotBlockOf[address] - 1;
+
+  if (aotStale[hit] || vm->memory[address] == translatedWord(address)) {
+    return false;
+  }
+  aotStale[hit] = true;
+  return hit == block;
+}
+
+// Where the store instruction at pc will write, or -1
+static int32_t storeAddress(const lc3_vm* vm, uint16_t pc, uint16_t instruction) {
+  uint16_t pcPlusOffset = pc + 1 + sign_extend(instruction & 0x1FF, 9);
+
+  switch (instruction >> 12) {
+    case OP_ST:
+      return pcPlusOffset;
+    case OP_STI:
+      return vm->memory[pcPlusOffset];
+    case OP_STR:
+      return (uint16_t) (vm->registers[(instruction >> 6) & 0x7] + sign_extend(instruction & 0x3F, 6));
+    default:
+      return -1;
+  }
+}
+
+// One instruction through the interpreter, still checking its store
+static uint64_t interpretOne(lc3_vm* vm) {
+  uint16_t pc = vm->registers[R_PC];
+  int32_t address = storeAddress(vm, pc, vm->memory[pc]);
+  uint64_t executed = fetchExecuteTemplate(vm, 1);
+
+  if (address >= 0) {
+    aotStore(vm, (uint16_t) address, AOT_NO_BLOCK);
+  }
+  return executed;
+}
+
+// Translated fetch-execute
+// Watchpoints and breakpoints are checked per access and per fetch,
+// which translated blocks skip, so any armed one means interpreting
+uint64_t fetchExecuteAot(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint64_t n = 0;
+
+    if (!(vm->watched_pages | vm->break_pages)) {
+      n = aotRun(vm, budget - executed);
+    }
+    if (!n) {
+      n = interpretOne(vm);
+    }
+    executed += n;
+  }
+  return executed;
+}
+
+// The machine
+static lc3_vm vm;
+
+// MAIN
+int main(int argc, const char* argv[]) {
+  if (argc > 1) {
+    // the images are built in
+    printf("%s: translated from %s, takes no arguments\n", argv[0], aotSource);
+    exit(2);
+  }
+
+  if (!vm_init(&vm)) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+
+  lc3_loader loader;
+  loader_init(&loader);
+
+  for (unsigned s = 0; s < aotSegmentCount; ++s) {
+    const aot_segment* segment = &aotSegments[s];
+    if (!loader_add(&loader, aotSource, segment->origin, segment->words, segment->length)) {
+      printf("failed to load: %s\n", loader.error);
+      exit(1);
+    }
+  }
+  loader_install(&loader, &vm);
+  loader_free(&loader);
+  aotInit();
+
+  signal(SIGINT, handle_interrupt);
+  disable_input_buffering();
+
+  fetchExecuteAot(&vm, RUN_FOREVER);
+
+  restore_input_buffering();
+
+  if (vm.status == VM_FAULT) {
+    abort();
+  }
+  vm_free(&vm);
+  return 0;
+}
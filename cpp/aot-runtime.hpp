@@ -0,0 +1,108 @@
+#ifndef _AOT_RUNTIME_HPP
+#define _AOT_RUNTIME_HPP
+
+#include <stdint.h>
+
+#include "../core/core.h"
+#include "../core/opcodes.h"
+
+#include "instruction-set.hpp"
+
+// AHEAD OF TIME TRANSLATION
+// lc3-aot turns the code reachable in an image into one C++ function
+// per basic block, each a straight run of ins<op, variant> calls on
+// constant instruction words. The generated file provides the tables
+// below; aot-runtime.cpp provides the engine and main.
+//
+// aotRun chains blocks without going back to a dispatcher: a block
+// whose successors are known jumps to them when the PC matches, a
+// return (JMP R7) to the top of a shadow stack of return addresses
+// pushed by JSR and JSRR, and any other jump through a register to the
+// last target seen at that site. Other targets are looked up.
+//
+// Anything the translation does not cover (jumps to untranslated
+// addresses, blocks whose words were overwritten, stepping under
+// watchpoints or breakpoints) falls back to the interpreter one
+// instruction at a time.
+
+// An image as loaded, kept in the executable
+struct aot_segment {
+  uint16_t origin;
+  uint32_t length;
+  const uint16_t* words;
+};
+
+// A translated basic block
+struct aot_block {
+  uint16_t address;
+  uint16_t length;
+};
+
+// No block: the store came from the interpreter
+enum : uint32_t { AOT_NO_BLOCK = UINT32_MAX };
+
+// Generated
+extern const char* const aotSource;
+extern const aot_segment aotSegments[];
+extern const unsigned aotSegmentCount;
+extern const aot_block aotBlocks[];
+extern const unsigned aotBlockCount;
+extern bool aotStale[];                    // per block, once its words have changed
+
+// Runs translated blocks from the PC, chaining them while they are
+// valid, fit the budget and leave the machine running. Returns the
+// instructions executed, 0 if there is no block at the PC
+uint64_t aotRun(lc3_vm* vm, uint64_t budget);
+
+// Runtime
+extern uint32_t aotBlockOf[MEMORY_SIZE];   // block index + 1 per translated word, 0 elsewhere
+
+void aotInit();
+bool aotStaleWord(const lc3_vm* vm, uint16_t address, uint32_t block);
+
+// The block starting at address, or AOT_NO_BLOCK
+inline uint32_t aotBlockStart(uint16_t address) {
+  uint32_t block = aotBlockOf[address];
+  return block && aotBlocks[block - 1].address == address ? block - 1 : AOT_NO_BLOCK;
+}
+
+// A predicted jump: control goes to block if the PC is address
+struct aot_prediction {
+  uint32_t address;
+  uint32_t block;
+};
+
+// Matches no PC
+enum : uint32_t { AOT_NO_ADDRESS = MEMORY_SIZE };
+
+// Shadow return stack. Deep recursion overwrites the oldest entries
+// and mismatched returns pop wrong ones, which only cost a lookup
+enum { AOT_RETURN_DEPTH = 64 };
+
+extern aot_prediction aotReturnStack[AOT_RETURN_DEPTH];
+extern unsigned aotReturnTop;
+
+inline void aotCall(uint32_t address, uint32_t block) {
+  aotReturnStack[aotReturnTop++ % AOT_RETURN_DEPTH] = { address, block };
+}
+
+inline const aot_prediction& aotReturn() {
+  return aotReturnStack[--aotReturnTop % AOT_RETURN_DEPTH];
+}
+
+// Called after every store a translated block makes that may hit
+// translated code. True when it invalidated the running block,
+// which must then return to the dispatcher at once
+inline bool aotStore(const lc3_vm* vm, uint16_t address, uint32_t block) {
+  return aotBlockOf[address] && aotStaleWord(vm, address, block);
+}
+
+// Whether a block may run: not invalidated, and within the budget
+inline bool aotEnter(uint32_t block, uint64_t length, uint64_t budget) {
+  return !aotStale[block] && length <= budget;
+}
+
+// Engine running translated blocks
+uint64_t fetchExecuteAot(lc3_vm* vm, uint64_t budget);
+
+#endif
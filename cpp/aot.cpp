@@ -0,0 +1,440 @@
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "../core/bit-utilities.h"
+#include "../core/core.h"
+#include "../core/disassembler.h"
+#include "../core/loader.h"
+#include "../core/opcodes.h"
+
+#include "traits.hpp"
+
+// lc3-aot
+// Translates the code reachable from the entry points of a set of
+// images into C++ for aot-runtime.cpp: one function per basic block,
+// aotRun, which chains them, and the images themselves.
+
+static const char* const opcodeNames[16] = {
+  "OP_BR", "OP_ADD", "OP_LD", "OP_ST", "OP_JSR", "OP_AND", "OP_LDR", "OP_STR",
+  "OP_RTI", "OP_NOT", "OP_LDI", "OP_STI", "OP_JMP", "OP_RES", "OP_LEA", "OP_TRAP"
+};
+
+static lc3_loader loader;
+static lc3_symbols symbols;
+
+static uint16_t memory[MEMORY_SIZE];
+static bool loaded[MEMORY_SIZE];
+static bool reachable[MEMORY_SIZE];
+static bool leader[MEMORY_SIZE];
+
+struct block {
+  uint16_t address;
+  uint16_t length;
+};
+
+// Ends its basic block: control may not continue at the next word
+static bool endsBlock(uint16_t instruction) {
+  unsigned op = instruction >> 12;
+  return (op == OP_BR && (instruction & 0x0E00)) || op == OP_JMP || op == OP_JSR
+      || op == OP_TRAP || faults(op);
+}
+
+// Reads the PC, which the block only stores when needed
+static bool readsPC(unsigned op) {
+  return usesPCOffset9(op) || op == OP_JSR;
+}
+
+static uint16_t pcOffset9(uint16_t address, uint16_t instruction) {
+  return address + 1 + sign_extend(instruction & 0x1FF, 9);
+}
+
+// REACHABILITY
+// Follows every static edge from the entry points. Jumps through
+// registers (JMP, RET, JSRR) are left to the dispatcher, which finds
+// a block there or interprets
+static void explore(uint16_t entry) {
+  std::vector<uint16_t> work;
+
+  leader[entry] = true;
+  work.push_back(entry);
+
+  while (!work.empty()) {
+    uint16_t address = work.back();
+    work.pop_back();
+
+    while (loaded[address] && !reachable[address]) {
+      uint16_t instruction = memory[address];
+      unsigned op = instruction >> 12;
+      uint16_t next = address + 1;
+
+      reachable[address] = true;
+
+      if (op == OP_BR && (instruction & 0x0E00)) {
+        uint16_t target = pcOffset9(address, instruction);
+        leader[target] = true;
+        work.push_back(target);
+        if ((instruction & 0x0E00) == 0x0E00) {
+          break;
+        }
+      }
+      else if (op == OP_JSR && (instruction & 0x0800)) {
+        uint16_t target = address + 1 + sign_extend(instruction & 0x7FF, 11);
+        leader[target] = true;
+        work.push_back(target);
+      }
+      else if (op == OP_JMP || faults(op) || instruction == (0xF000 | TRAP_HALT)) {
+        break;
+      }
+
+      if (next == 0) {
+        break;
+      }
+      address = next;
+    }
+  }
+}
+
+static std::vector<block> findBlocks() {
+  std::vector<block> blocks;
+
+  for (uint32_t address = 0; address < MEMORY_SIZE; ++address) {
+    if (!reachable[address]) {
+      continue;
+    }
+    if (blocks.empty() || leader[address]
+        || blocks.back().address + blocks.back().length != address
+        || endsBlock(memory[address - 1])) {
+      blocks.push_back({ (uint16_t) address, 0 });
+    }
+    ++blocks.back().length;
+  }
+  return blocks;
+}
+
+// CODE GENERATION
+static void emitInstruction(FILE* out, uint16_t address, uint16_t instruction, unsigned index,
+                            unsigned count, bool last) {
+  char line[DISASSEMBLY_LINE_MAX];
+  unsigned op = instruction >> 12;
+  uint16_t next = address + 1;
+
+  disassemble_line(address, instruction, &symbols, line);
+  fprintf(out, "  // %s\n", line);
+
+  if (readsPC(op) || last) {
+    fprintf(out, "  vm->registers[R_PC] = 0x%04X;\n", next);
+  }
+
+  // Stores that may land on translated code are checked
+  const char* address_expression = NULL;
+  char buffer[64];
+  if (op == OP_ST && reachable[pcOffset9(address, instruction)]) {
+    snprintf(buffer, sizeof(buffer), "0x%04X", pcOffset9(address, instruction));
+    address_expression = buffer;
+  }
+  else if (op == OP_STI) {
+    snprintf(buffer, sizeof(buffer), "vm->memory[0x%04X]", pcOffset9(address, instruction));
+    address_expression = buffer;
+  }
+  else if (op == OP_STR) {
+    snprintf(buffer, sizeof(buffer), "(uint16_t) (vm->registers[%u] + %d)",
+             (instruction >> 6) & 0x7, (int16_t) sign_extend(instruction & 0x3F, 6));
+    address_expression = buffer;
+  }
+
+  if (address_expression) {
+    fprintf(out, "  {\n");
+    fprintf(out, "    uint16_t address = %s;\n", address_expression);
+    fprintf(out, "    ins<%s, %u>(vm, 0x%04X);\n", opcodeNames[op], variantOf(op, instruction), instruction);
+    if (!last) {
+      fprintf(out, "    if (aotStore(vm, address, %u)) {\n", index);
+      fprintf(out, "      vm->registers[R_PC] = 0x%04X;\n", next);
+      fprintf(out, "      return %u;\n", count);
+      fprintf(out, "    }\n");
+    }
+    else {
+      fprintf(out, "    aotStore(vm, address, %u);\n", index);
+    }
+    fprintf(out, "  }\n");
+  }
+  else {
+    fprintf(out, "  ins<%s, %u>(vm, 0x%04X);\n", opcodeNames[op], variantOf(op, instruction), instruction);
+  }
+
+  // Loads that may reach device registers can stop the machine (a KBSR
+  // or mailbox status read waiting on a non-blocking console), and the
+  // block must end there
+  bool device = op == OP_LDI || op == OP_LDR || (op == OP_LD && pcOffset9(address, instruction) >= MR_KBSR);
+  if (device && !last) {
+    fprintf(out, "  if (vm->status != VM_RUNNING) {\n");
+    fprintf(out, "    vm->registers[R_PC] = 0x%04X;\n", next);
+    fprintf(out, "    return %u;\n", count);
+    fprintf(out, "  }\n");
+  }
+}
+
+static void emitBlock(FILE* out, const block& b, unsigned index) {
+  fprintf(out, "static uint64_t block_%04X(lc3_vm* vm) {\n", b.address);
+  for (unsigned i = 0; i < b.length; ++i) {
+    uint16_t address = b.address + i;
+    emitInstruction(out, address, memory[address], index, i + 1, i + 1 == b.length);
+  }
+  fprintf(out, "  return %u;\n", b.length);
+  fprintf(out, "}\n\n");
+}
+
+// CHAINING
+// Where control may go after block b, in aotRun. Known successors are
+// jumped to when the PC matches; anything else is looked up
+static void emitExit(FILE* out, const block& b, const std::vector<int>& indexOf,
+                     unsigned& sites) {
+  uint16_t last = b.address + b.length - 1;
+  uint16_t instruction = memory[last];
+  uint16_t next = last + 1;
+  unsigned op = instruction >> 12;
+  std::vector<uint16_t> successors;
+
+  if (op == OP_JSR) {
+    // the return address, for the JMP R7 that comes back
+    if (indexOf[next] >= 0) {
+      fprintf(out, "  aotCall(0x%04X, %d);\n", next, indexOf[next]);
+    }
+    else {
+      fprintf(out, "  aotCall(AOT_NO_ADDRESS, 0);\n");
+    }
+  }
+
+  if (op == OP_JMP && ((instruction >> 6) & 0x7) == R_R7) {
+    fprintf(out, "  {\n");
+    fprintf(out, "    const aot_prediction& r = aotReturn();\n");
+    fprintf(out, "    if (r.address == vm->registers[R_PC]) goto *entries[r.block];\n");
+    fprintf(out, "  }\n");
+  }
+  else if (op == OP_JMP || (op == OP_JSR && !(instruction & 0x0800))) {
+    // last target of this jump through a register
+    fprintf(out, "  if (targets[%u].address == vm->registers[R_PC]) goto *entries[targets[%u].block];\n",
+            sites, sites);
+    fprintf(out, "  site = &targets[%u];\n", sites);
+    ++sites;
+  }
+  else if (op == OP_JSR) {
+    successors.push_back(next + sign_extend(instruction & 0x7FF, 11));
+  }
+  else {
+    if (op == OP_BR && (instruction & 0x0E00)) {
+      successors.push_back(pcOffset9(last, instruction));
+    }
+    if (!(op == OP_BR && (instruction & 0x0E00) == 0x0E00) && !faults(op)) {
+      successors.push_back(next);
+    }
+  }
+
+  for (uint16_t successor : successors) {
+    if (indexOf[successor] >= 0) {
+      fprintf(out, "  if (vm->registers[R_PC] == 0x%04X) goto block_%u;\n", successor, indexOf[successor]);
+    }
+  }
+  fprintf(out, "  goto lookup;\n");
+}
+
+static void emitRun(FILE* out, const std::vector<block>& blocks) {
+  std::vector<int> indexOf(MEMORY_SIZE, -1);
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    indexOf[blocks[i].address] = i;
+  }
+
+  // Bodies first, to count the indirect jump sites
+  unsigned sites = 0;
+  char* text = NULL;
+  size_t length = 0;
+  FILE* buffer = open_memstream(&text, &length);
+
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    const block& b = blocks[i];
+    fprintf(buffer, "block_%u:\n", i);
+    fprintf(buffer, "  if (!aotEnter(%u, %u, budget - executed)) return executed;\n", i, b.length);
+    fprintf(buffer, "  n = block_%04X(vm);\n", b.address);
+    fprintf(buffer, "  executed += n;\n");
+    fprintf(buffer, "  if (n != %u || vm->status != VM_RUNNING) return executed;\n", b.length);
+    emitExit(buffer, b, indexOf, sites);
+  }
+  fclose(buffer);
+
+  fprintf(out, "uint64_t aotRun(lc3_vm* vm, uint64_t budget) {\n");
+  fprintf(out, "  static void* const entries[] = {");
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    fprintf(out, "%s&&block_%u,", i % 8 ? " " : "\n    ", i);
+  }
+  fprintf(out, "\n  };\n");
+  fprintf(out, "  static aot_prediction targets[%u] = {", sites ? sites : 1);
+  for (unsigned i = 0; i < (sites ? sites : 1); ++i) {
+    fprintf(out, "%s{ AOT_NO_ADDRESS, 0 },", i % 4 ? " " : "\n    ");
+  }
+  fprintf(out, "\n  };\n");
+  fprintf(out, "  aot_prediction* site = nullptr;\n");
+  fprintf(out, "  uint64_t executed = 0;\n");
+  fprintf(out, "  uint64_t n;\n");
+  fprintf(out, "  uint32_t b;\n\n");
+
+  // Lookup, filling the target cache of the jump that missed
+  fprintf(out, "lookup:\n");
+  fprintf(out, "  b = aotBlockStart(vm->registers[R_PC]);\n");
+  fprintf(out, "  if (b == AOT_NO_BLOCK) return executed;\n");
+  fprintf(out, "  if (site) {\n");
+  fprintf(out, "    *site = { vm->registers[R_PC], b };\n");
+  fprintf(out, "    site = nullptr;\n");
+  fprintf(out, "  }\n");
+  fprintf(out, "  goto *entries[b];\n\n");
+
+  fwrite(text, 1, length, out);
+  free(text);
+  fprintf(out, "}\n");
+}
+
+static void emit(FILE* out, const std::vector<block>& blocks, const char* source) {
+  fprintf(out, "// Generated by lc3-aot from %s\n", source);
+  fprintf(out, "#include \"aot-runtime.hpp\"\n\n");
+
+  fprintf(out, "const char* const aotSource = \"%s\";\n\n", source);
+
+  // Images
+  for (int s = 0; s < loader.segment_count; ++s) {
+    const lc3_segment* segment = &loader.segments[s];
+    fprintf(out, "static const uint16_t segment_%d[] = {", s);
+    for (uint32_t i = 0; i < segment->length; ++i) {
+      fprintf(out, "%s0x%04X,", i % 8 ? " " : "\n  ", segment->words[i]);
+    }
+    fprintf(out, "\n};\n\n");
+  }
+  fprintf(out, "const aot_segment aotSegments[] = {\n");
+  for (int s = 0; s < loader.segment_count; ++s) {
+    fprintf(out, "  { 0x%04X, %u, segment_%d },\n", loader.segments[s].origin, loader.segments[s].length, s);
+  }
+  fprintf(out, "};\n");
+  fprintf(out, "const unsigned aotSegmentCount = %d;\n\n", loader.segment_count);
+
+  // Blocks
+  fprintf(out, "const aot_block aotBlocks[] = {\n");
+  for (const block& b : blocks) {
+    fprintf(out, "  { 0x%04X, %u },\n", b.address, b.length);
+  }
+  fprintf(out, "};\n");
+  fprintf(out, "const unsigned aotBlockCount = %zu;\n", blocks.size());
+  fprintf(out, "bool aotStale[%zu];\n\n", blocks.size());
+
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    emitBlock(out, blocks[i], i);
+  }
+
+  emitRun(out, blocks);
+}
+
+// Parse an address in C (0x3000) or LC-3 (x3000) notation
+static bool parseAddress(const char* text, uint16_t* address) {
+  char* end;
+  if (*text == 'x' || *text == 'X') {
+    ++text;
+    *address = (uint16_t) strtoul(text, &end, 16);
+  }
+  else {
+    *address = (uint16_t) strtoul(text, &end, 0);
+  }
+  return end != text && *end == 0;
+}
+
+// MAIN
+int main(int argc, char* argv[]) {
+  std::vector<uint16_t> entries;
+  const char* output_path = NULL;
+  int opt;
+
+  loader_init(&loader);
+  symbols_init(&symbols);
+
+  while ((opt = getopt(argc, argv, "e:o:s:")) != -1) {
+    uint16_t entry;
+    switch (opt) {
+      case 'e':
+        if (!parseAddress(optarg, &entry)) {
+          printf("bad entry point: %s\n", optarg);
+          exit(2);
+        }
+        entries.push_back(entry);
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 's':
+        if (!symbols_load(&symbols, optarg)) {
+          printf("failed to load symbols: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      default:
+        optind = argc;
+        break;
+    }
+  }
+
+  if (optind >= argc) {
+    // show usage string
+    printf("lc3-aot [-e entry]... [-s symbol-file] [-o output.cpp] image-file1 ...\n");
+    exit(2);
+  }
+
+  std::string source;
+  for (int j = optind; j < argc; ++j) {
+    if (!loader_add_image(&loader, argv[j])) {
+      printf("failed to load: %s\n", loader.error);
+      exit(1);
+    }
+    const char* name = strrchr(argv[j], '/');
+    source += source.empty() ? "" : " ";
+    source += name ? name + 1 : argv[j];
+  }
+
+  for (int s = 0; s < loader.segment_count; ++s) {
+    const lc3_segment* segment = &loader.segments[s];
+    for (uint32_t i = 0; i < segment->length; ++i) {
+      memory[segment->origin + i] = segment->words[i];
+      loaded[segment->origin + i] = true;
+    }
+  }
+
+  if (entries.empty()) {
+    entries.push_back(PC_START);
+  }
+  for (uint16_t entry : entries) {
+    explore(entry);
+  }
+  std::vector<block> blocks = findBlocks();
+
+  FILE* out = output_path ? fopen(output_path, "w") : stdout;
+  if (!out) {
+    printf("failed to open %s\n", output_path);
+    exit(1);
+  }
+  emit(out, blocks, source.c_str());
+
+  if (out != stdout && fclose(out) != 0) {
+    printf("failed to write %s\n", output_path);
+    exit(1);
+  }
+
+  size_t words = 0;
+  for (const block& b : blocks) {
+    words += b.length;
+  }
+  fprintf(stderr, "%zu blocks, %zu instructions\n", blocks.size(), words);
+
+  loader_free(&loader);
+  symbols_free(&symbols);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdint.h>
+
+#include <utility>
+
+#include "../core/core.h"
+
+#include "instruction-set.hpp"
+#include "fetch-execute.h"
+
+typedef void (*handler)(lc3_vm*, uint16_t);
+
+// Handler Table
+// One specialized ins<op, variant> per handler index, generated from traits.hpp
+template <size_t... index>
+constexpr std::array<handler, sizeof...(index)> makeHandlerTable(std::index_sequence<index...>) {
+  return {{ ins<handlerOpcode(index), handlerVariant(index)>... }};
+}
+
+static constexpr std::array<handler, handlerCount> handler_table =
+  makeHandlerTable(std::make_index_sequence<handlerCount>());
+
+// Fused Handlers
+// Superinstruction for fusedPairs[f]: both handlers inline into one
+// function, so values the first leaves in registers stay in host
+// registers for the second. Returns the instructions executed
+typedef uint64_t (*fused_handler)(lc3_vm*, uint16_t, uint16_t);
+
+template <unsigned f>
+uint64_t fused(lc3_vm* vm, uint16_t instruction, uint16_t next) {
+  constexpr unsigned first = fusedPairs[f].first;
+  constexpr unsigned second = fusedPairs[f].second;
+
+  ins<handlerOpcode(first), handlerVariant(first)>(vm, instruction);
+  if constexpr (mayStop(handlerOpcode(first))) {
+    if (vm->status != VM_RUNNING) {
+      return 1;
+    }
+  }
+  ++vm->registers[R_PC];
+  ins<handlerOpcode(second), handlerVariant(second)>(vm, next);
+  return 2;
+}
+
+template <size_t... index>
+constexpr std::array<fused_handler, sizeof...(index)> makeFusedTable(std::index_sequence<index...>) {
+  return {{ fused<index>... }};
+}
+
+static constexpr std::array<fused_handler, fusedCount> fused_table =
+  makeFusedTable(std::make_index_sequence<fusedCount>());
+
+// Whether the word at address can be fetched ahead of time: no
+// breakpoint on its page and below the device registers, which
+// the first instruction's load could change
+static inline bool prefetchable(const lc3_vm* vm, uint16_t address) {
+  return !(vm->break_pages & (1ull << (address >> MEMORY_PAGE_SHIFT))) && address < MR_KBSR;
+}
+
+// C++ fetch-execute
+// decodeTable maps the whole instruction word to its handler,
+// so dispatch is two loads and an indirect call. A handler that
+// starts a fused pair looks up the next word in pairTable and
+// runs both instructions with one dispatch
+uint64_t fetchExecuteTemplate(lc3_vm* vm, uint64_t budget) {
+  uint64_t executed = 0;
+
+  while (executed < budget && vm->status == VM_RUNNING) {
+    uint16_t instruction = mem_fetch(vm, vm->registers[R_PC]++);
+    unsigned h = decodeTable[instruction];
+
+    if (leadsPair[h] && budget - executed >= 2) {
+      uint16_t pc = vm->registers[R_PC];
+      uint8_t f = prefetchable(vm, pc) ? pairTable[h][decodeTable[vm->memory[pc]]] : 0;
+      if (f) {
+        executed += fused_table[f - 1](vm, instruction, vm->memory[pc]);
+        continue;
+      }
+    }
+    handler_table[h](vm, instruction);
+    ++executed;
+  }
+  return executed;
+}
@@ -0,0 +1,18 @@
+#ifndef _FETCH_EXECUTE_TEMPLATE
+#define _FETCH_EXECUTE_TEMPLATE
+
+#include <stdint.h>
+
+#include "../core/core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t fetchExecuteTemplate(lc3_vm* vm, uint64_t budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef _INSTRUCTION_SET_HPP
+#define _INSTRUCTION_SET_HPP
+
+#include <stdint.h>
+
+#include "../core/bit-utilities.h"
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/opcodes.h"
+
+#include "traits.hpp"
+
+// Mode bits of an instruction: fixed by the variant,
+// or decoded at run time for VARIANT_ANY
+template <unsigned op, unsigned variant>
+inline unsigned mode(uint16_t instruction) {
+  return variant == VARIANT_ANY ? variantOf(op, instruction) : variant;
+}
+
+// C++ fetch-execute using templates
+// ins<op> handles any instruction with opcode op. ins<op, variant>
+// is specialized for one variant (see traits.hpp) and has no
+// mode bit branches left after inlining.
+template <unsigned op, unsigned variant = VARIANT_ANY>
+void ins(lc3_vm* vm, uint16_t instruction) {
+  
+  uint16_t register0 = 0;
+  uint16_t register1 = 0;
+  uint16_t register2 = 0;
+
+  uint16_t immediateValue_5 = 0;
+
+  uint16_t pcPlusOffset = 0;
+  uint16_t basePlusOffset = 0;
+
+  const unsigned m = mode<op, variant>(instruction);
+
+  // Read in the register values
+  if constexpr (usesRegister0(op)) {
+    register0 = (instruction >> 9) & 0x7;
+  }
+
+  if constexpr (usesRegister1(op)) {
+    register1 = (instruction >> 6) & 0x7;
+  }
+
+  if constexpr (hasImmediateMode(op)) {
+    if (m) {
+      immediateValue_5 = sign_extend((instruction) & 0x1F, 5);
+    }
+    else {
+      register2 = instruction & 0x7;
+    }
+  }
+
+  if constexpr (usesBaseOffset(op)) {
+    // Base + offset
+    basePlusOffset = vm->registers[register1] + sign_extend(instruction & 0x3F, 6);
+  }
+
+  if constexpr (usesPCOffset9(op)) {
+    // Indirect address
+    pcPlusOffset = vm->registers[R_PC] + sign_extend(instruction & 0x1FF, 9);
+  }
+
+  // Instructions
+  if constexpr (op == OP_BR) {
+    // BR: m is the n, z, p mask
+    if (m & vm->registers[R_COND]) {
+      vm->registers[R_PC] = pcPlusOffset;
+    }
+  }
+
+  if constexpr (op == OP_ADD) {
+    // ADD
+    if (m) {
+      vm->registers[register0] = vm->registers[register1] + immediateValue_5;
+    }
+    else {
+      vm->registers[register0] = vm->registers[register1] + vm->registers[register2];
+    }
+  }
+
+  if constexpr (op == OP_AND) {
+    // AND
+    if (m) {
+      vm->registers[register0] = vm->registers[register1] & immediateValue_5;
+    }
+    else {
+      vm->registers[register0] = vm->registers[register1] & vm->registers[register2];
+    }
+  }
+
+  if constexpr (op == OP_NOT) {
+    // NOT
+    vm->registers[register0] = ~vm->registers[register1];
+  }
+
+  if constexpr (op == OP_JMP) {
+    // JMP
+    vm->registers[R_PC] = vm->registers[register1];
+  }
+
+  if constexpr (op == OP_JSR) {
+    // JSR: m is the long flag
+    vm->registers[R_R7] = vm->registers[R_PC];
+
+    if (m) {
+      vm->registers[R_PC] += sign_extend(instruction & 0x7FF, 11);
+    }
+    else {
+      vm->registers[R_PC] = vm->registers[register1];
+    }
+  }
+
+  if constexpr (op == OP_LD) {
+    // LD
+    vm->registers[register0] = mem_read(vm, pcPlusOffset); 
+  }
+
+  if constexpr (op == OP_LDI) {
+    // LDI
+    vm->registers[register0] = mem_read(vm, mem_read(vm, pcPlusOffset));
+  }
+
+  if constexpr (op == OP_LDR) {
+    // LDR
+    vm->registers[register0] = mem_read(vm, basePlusOffset);
+  }
+  
+  if constexpr (op == OP_LEA) {
+    // LEA
+    vm->registers[register0] = pcPlusOffset;
+  }
+
+  if constexpr (op == OP_ST) {
+    // ST
+    mem_write(vm, pcPlusOffset, vm->registers[register0]);
+  }
+
+  if constexpr (op == OP_STI) {
+    // STI
+    mem_write(vm, mem_read(vm, pcPlusOffset), vm->registers[register0]);
+  }
+
+  if constexpr (op == OP_STR) {
+    // STR
+    mem_write(vm, basePlusOffset, vm->registers[register0]);
+  }
+
+  if constexpr (op == OP_TRAP) {
+    // TRAP: m is the vector index, TRAP_VECTOR_COUNT if unknown
+    switch (TRAP_GETC + m) {
+      case TRAP_GETC:
+        // read a single ASCII char
+        if (vm_wait_input(vm)) {
+          break;
+        }
+        vm->registers[R_R0] = (uint16_t) vm->console.get_char(vm->console.context);
+        break;
+      
+      case TRAP_OUT:
+        vm->console.put_char((char) vm->registers[R_R0], vm->console.context);
+        vm->console.flush(vm->console.context);
+        break;
+             
+      case TRAP_PUTS:
+        {
+          // one char per word, wrapping at the end of memory
+          uint16_t c = vm->registers[R_R0];
+          for (uint32_t n = 0; n < MEMORY_SIZE && vm->memory[c]; ++n) {
+            vm->console.put_char((char) vm->memory[c], vm->console.context);
+            ++c;
+          }
+          vm->console.flush(vm->console.context);
+        }
+        break;
+
+      case TRAP_IN:
+        // no second prompt when a wait for input ends
+        if (!vm->console.waiting) {
+          console_print(&vm->console, "Enter a character: ");
+        }
+        if (vm_wait_input(vm)) {
+          break;
+        }
+        vm->registers[R_R0] = (uint16_t) vm->console.get_char(vm->console.context);
+        break;
+             
+      case TRAP_PUTSP:
+        /* one char per byte (two bytes per word)
+          here we need to swap back to
+          big endian format */
+        {
+          uint16_t c = vm->registers[R_R0];
+          for (uint32_t n = 0; n < MEMORY_SIZE && vm->memory[c]; ++n) {
+            char char1 = vm->memory[c] & 0xFF;
+            vm->console.put_char(char1, vm->console.context);
+            char char2 = vm->memory[c] >> 8;
+            if (char2) { 
+              vm->console.put_char(char2, vm->console.context);
+            }
+            ++c;
+          } // end for c
+          vm->console.flush(vm->console.context);
+        }
+        break;
+      
+      case TRAP_HALT:
+        console_print(&vm->console, "HALT\n");
+        vm->console.flush(vm->console.context);
+        vm->status = VM_HALTED;
+        break;
+      } // end switch
+    } // end if TRAP
+
+  if constexpr (faults(op)) {
+    // RTI and RES
+    vm->status = VM_FAULT;
+  }
+
+  if constexpr (updatesFlags(op)) { 
+    update_flags(vm, register0); 
+  }
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef _TRAITS_HPP
+#define _TRAITS_HPP
+
+#include <stdint.h>
+
+#include <array>
+
+#include "../core/opcodes.h"
+
+// OPCODE TRAITS
+// Which fields and steps each opcode uses. ins<op, variant>
+// tests these at compile time instead of magic bitmasks.
+
+// DR/SR field in bits 9-11
+constexpr bool usesRegister0(unsigned op) {
+  return op == OP_ADD || op == OP_LD || op == OP_ST || op == OP_AND
+      || op == OP_LDR || op == OP_STR || op == OP_NOT || op == OP_LDI
+      || op == OP_STI || op == OP_LEA;
+}
+
+// SR1/BaseR field in bits 6-8
+constexpr bool usesRegister1(unsigned op) {
+  return op == OP_ADD || op == OP_JSR || op == OP_AND || op == OP_LDR
+      || op == OP_STR || op == OP_NOT || op == OP_JMP;
+}
+
+// Register or 5-bit immediate second operand, selected by bit 5
+constexpr bool hasImmediateMode(unsigned op) {
+  return op == OP_ADD || op == OP_AND;
+}
+
+// BaseR + offset6 address
+constexpr bool usesBaseOffset(unsigned op) {
+  return op == OP_LDR || op == OP_STR;
+}
+
+// PC + offset9 address
+constexpr bool usesPCOffset9(unsigned op) {
+  return op == OP_BR || op == OP_LD || op == OP_ST || op == OP_LDI
+      || op == OP_STI || op == OP_LEA;
+}
+
+// Sets the condition codes from DR
+constexpr bool updatesFlags(unsigned op) {
+  return op == OP_ADD || op == OP_LD || op == OP_AND || op == OP_LDR
+      || op == OP_NOT || op == OP_LDI || op == OP_LEA;
+}
+
+// Stops the machine
+constexpr bool faults(unsigned op) {
+  return op == OP_RTI || op == OP_RES;
+}
+
+// VARIANTS
+// Opcodes whose behaviour depends on mode bits get one handler per
+// mode, so the handler itself has no mode branches:
+//   ADD, AND  register / immediate (bit 5)
+//   BR        one per n, z, p combination (bits 9-11)
+//   JSR       JSRR / JSR (bit 11)
+//   TRAP      one per trap vector, plus one for unknown vectors
+
+// Decode the variant at run time
+enum : unsigned { VARIANT_ANY = 0xFF };
+
+enum : unsigned { TRAP_VECTOR_COUNT = TRAP_HALT - TRAP_GETC + 1 };
+
+constexpr unsigned variantCount(unsigned op) {
+  return hasImmediateMode(op) ? 2
+       : op == OP_BR ? 8
+       : op == OP_JSR ? 2
+       : op == OP_TRAP ? TRAP_VECTOR_COUNT + 1
+       : 1;
+}
+
+constexpr unsigned variantOf(unsigned op, uint16_t instruction) {
+  return hasImmediateMode(op) ? (instruction >> 5) & 0x1
+       : op == OP_BR ? (instruction >> 9) & 0x7
+       : op == OP_JSR ? (instruction >> 11) & 0x1
+       : op == OP_TRAP ? ((instruction & 0xFF) >= TRAP_GETC && (instruction & 0xFF) <= TRAP_HALT
+                           ? (instruction & 0xFF) - TRAP_GETC
+                           : static_cast<unsigned>(TRAP_VECTOR_COUNT))
+       : 0;
+}
+
+// HANDLER TABLE LAYOUT
+// Handlers are numbered opcode by opcode, one per variant
+constexpr unsigned handlerBase(unsigned op) {
+  return op == 0 ? 0 : handlerBase(op - 1) + variantCount(op - 1);
+}
+
+constexpr unsigned handlerCount = handlerBase(16);
+
+constexpr unsigned handlerIndex(unsigned op, unsigned variant) {
+  return handlerBase(op) + variant;
+}
+
+constexpr unsigned handlerOpcode(unsigned index, unsigned op = 0) {
+  return index < handlerBase(op + 1) ? op : handlerOpcode(index, op + 1);
+}
+
+constexpr unsigned handlerVariant(unsigned index) {
+  return index - handlerBase(handlerOpcode(index));
+}
+
+// Instruction word -> handler index, for every 16-bit instruction
+typedef std::array<uint8_t, 1 << 16> decode_table;
+
+constexpr decode_table makeDecodeTable() {
+  decode_table table {};
+  for (uint32_t instruction = 0; instruction < table.size(); ++instruction) {
+    unsigned op = instruction >> 12;
+    table[instruction] = handlerIndex(op, variantOf(op, instruction));
+  }
+  return table;
+}
+
+inline constexpr decode_table decodeTable = makeDecodeTable();
+
+// FUSED PAIRS
+// Frequent handler pairs run as one superinstruction, ins<> of the
+// first then the second, with a single dispatch between them:
+//   ADD imm + BR      loop counters
+//   LDR + ADD         walking a table
+//   LEA + TRAP PUTS   printing a string
+//   AND imm + ADD imm loading a constant
+// The first of a pair never stores, so it cannot change the word
+// fetched for the second.
+struct fused_pair {
+  uint8_t first;
+  uint8_t second;
+};
+
+constexpr fused_pair fusedPairs[] = {
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 0) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 1) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 2) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 3) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 4) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 5) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 6) },
+  { handlerIndex(OP_ADD, 1), handlerIndex(OP_BR, 7) },
+  { handlerIndex(OP_LDR, 0), handlerIndex(OP_ADD, 0) },
+  { handlerIndex(OP_LDR, 0), handlerIndex(OP_ADD, 1) },
+  { handlerIndex(OP_LEA, 0), handlerIndex(OP_TRAP, TRAP_PUTS - TRAP_GETC) },
+  { handlerIndex(OP_AND, 1), handlerIndex(OP_ADD, 1) }
+};
+
+constexpr unsigned fusedCount = sizeof(fusedPairs) / sizeof(fusedPairs[0]);
+
+// The first instruction may stop the machine (a load hitting a
+// watchpoint or a KBSR poll), which must skip the second
+constexpr bool mayStop(unsigned op) {
+  return op == OP_LD || op == OP_LDI || op == OP_LDR || op == OP_TRAP || faults(op);
+}
+
+// First handler, second handler -> fused index + 1, 0 if not fused
+typedef std::array<std::array<uint8_t, handlerCount>, handlerCount> pair_table;
+
+constexpr pair_table makePairTable() {
+  pair_table table {};
+  for (unsigned f = 0; f < fusedCount; ++f) {
+    table[fusedPairs[f].first][fusedPairs[f].second] = f + 1;
+  }
+  return table;
+}
+
+inline constexpr pair_table pairTable = makePairTable();
+
+// Handlers that start a pair, so the others never look ahead
+constexpr std::array<bool, handlerCount> makeLeadsPair() {
+  std::array<bool, handlerCount> leads {};
+  for (unsigned f = 0; f < fusedCount; ++f) {
+    leads[fusedPairs[f].first] = true;
+  }
+  return leads;
+}
+
+inline constexpr std::array<bool, handlerCount> leadsPair = makeLeadsPair();
+
+// COMPILE TIME TESTS
+constexpr uint16_t opcodeMask(bool (*trait)(unsigned)) {
+  uint16_t mask = 0;
+  for (unsigned op = 0; op < 16; ++op) {
+    if (trait(op)) {
+      mask |= 1 << op;
+    }
+  }
+  return mask;
+}
+
+// The traits match the bitmasks they replace, except that the old
+// register1 mask 0x12F3 also decoded it for BR, which never reads it
+static_assert(opcodeMask(usesRegister0) == 0x4EEE, "register0 opcodes");
+static_assert(opcodeMask(usesRegister1) == 0x12F2, "register1 opcodes");
+static_assert(opcodeMask(hasImmediateMode) == 0x0022, "immediate mode opcodes");
+static_assert(opcodeMask(usesBaseOffset) == 0x00C0, "base + offset opcodes");
+static_assert(opcodeMask(usesPCOffset9) == 0x4C0D, "PC + offset opcodes");
+static_assert(opcodeMask(updatesFlags) == 0x4666, "flag updating opcodes");
+static_assert(opcodeMask(faults) == 0x2100, "faulting opcodes");
+
+// The handler numbering is dense and round trips
+static_assert(handlerCount == 32, "handler count");
+static_assert(handlerCount <= 256, "handler index must fit in the decode table");
+static_assert(handlerOpcode(handlerIndex(OP_TRAP, TRAP_VECTOR_COUNT)) == OP_TRAP, "last handler");
+static_assert(handlerVariant(handlerIndex(OP_BR, 5)) == 5, "BR variant");
+static_assert(handlerOpcode(handlerIndex(OP_LEA, 0)) == OP_LEA, "LEA handler");
+
+// Decoding picks the expected variant
+static_assert(decodeTable[0x1021] == handlerIndex(OP_ADD, 1), "ADD R0, R0, #1");
+static_assert(decodeTable[0x1001] == handlerIndex(OP_ADD, 0), "ADD R0, R0, R1");
+static_assert(decodeTable[0x5020] == handlerIndex(OP_AND, 1), "AND R0, R0, #0");
+static_assert(decodeTable[0x0000] == handlerIndex(OP_BR, 0), "BR never");
+static_assert(decodeTable[0x0E05] == handlerIndex(OP_BR, 7), "BRnzp");
+static_assert(decodeTable[0x0405] == handlerIndex(OP_BR, 0x2), "BRz");
+static_assert(decodeTable[0x4800] == handlerIndex(OP_JSR, 1), "JSR");
+static_assert(decodeTable[0x4080] == handlerIndex(OP_JSR, 0), "JSRR R2");
+static_assert(decodeTable[0xC1C0] == handlerIndex(OP_JMP, 0), "RET");
+static_assert(decodeTable[0xF020] == handlerIndex(OP_TRAP, 0), "TRAP GETC");
+static_assert(decodeTable[0xF025] == handlerIndex(OP_TRAP, 5), "TRAP HALT");
+static_assert(decodeTable[0xF026] == handlerIndex(OP_TRAP, TRAP_VECTOR_COUNT), "unknown trap");
+static_assert(decodeTable[0xF000] == handlerIndex(OP_TRAP, TRAP_VECTOR_COUNT), "unknown trap");
+
+// Pairs are looked up by handler
+static_assert(pairTable[decodeTable[0x127F]][decodeTable[0x03FE]] != 0, "ADD R1, R1, #-1; BRp");
+static_assert(pairTable[decodeTable[0x6042]][decodeTable[0x1001]] != 0, "LDR R0, R1, #2; ADD R0, R0, R1");
+static_assert(pairTable[decodeTable[0xE002]][decodeTable[0xF022]] != 0, "LEA R0, #2; PUTS");
+static_assert(pairTable[decodeTable[0x5260]][decodeTable[0x1265]] != 0, "AND R1, R1, #0; ADD R1, R1, #5");
+static_assert(pairTable[decodeTable[0x1001]][decodeTable[0x03FE]] == 0, "ADD register; BRp");
+static_assert(pairTable[decodeTable[0xE002]][decodeTable[0xF021]] == 0, "LEA R0, #2; OUT");
+static_assert(leadsPair[handlerIndex(OP_LDR, 0)] && !leadsPair[handlerIndex(OP_ST, 0)], "pair leaders");
+
+#endif
@@ -0,0 +1,295 @@
+/* Batch runner for the lockstep engine
+
+Runs one VM per input file, all loaded with the same images, through
+lockstep_run (see c/lockstep.h). Each VM reads its input file as
+keyboard input and its output is captured, and written to a file
+per input when an output directory is given.
+
+With -c every VM is also run alone on the reference engine and must
+end in the same state, which checks the lockstep engine and gives the
+scalar time to compare against.
+
+With -M the totals are also written to a file in the Prometheus text
+format, for a node exporter's textfile collector to pick up.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/loader.h"
+#include "../core/shared-image.h"
+#include "../c/lockstep.h"
+#include "../c/metrics.h"
+
+#include "lane.h"
+
+/* One guest of the batch */
+typedef struct batch_instance {
+  const char* input_path;
+  uint8_t* input;
+  size_t input_length;
+  lc3_vm* vm;
+  buffer_console console;
+} batch_instance;
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Private resident memory from /proc, 0 where there is none. Shared
+// image pages are counted once per VM mapping them in VmRSS, not here
+static long private_kib() {
+  FILE* status = fopen("/proc/self/status", "r");
+  char line[256];
+  long kib = 0;
+
+  while (status && fgets(line, sizeof(line), status)) {
+    if (sscanf(line, "RssAnon: %ld kB", &kib) == 1) {
+      break;
+    }
+  }
+  if (status) {
+    fclose(status);
+  }
+  return kib;
+}
+
+static void usage() {
+  printf("lc3-batch [-m max-instructions] [-c] [-w output-dir] [-M metrics-file] [-l input-list] [-i input-file] ...\n"
+         "          image-file1 ...\n");
+  exit(2);
+}
+
+static const char** input_paths;
+static int input_count;
+
+static void add_input(const char* path) {
+  input_paths = (const char**) realloc(input_paths, (input_count + 1) * sizeof(const char*));
+  input_paths[input_count++] = path;
+}
+
+// One input path per line
+static void add_input_list(const char* path) {
+  size_t length;
+  char* list = (char*) read_file(path, &length);
+  if (!list) {
+    printf("failed to read input list: %s\n", path);
+    exit(1);
+  }
+  list = (char*) realloc(list, length + 1);
+  list[length] = 0;
+
+  for (char* line = strtok(list, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+    add_input(line);
+  }
+}
+
+static void instance_init(batch_instance* instance, shared_image* image) {
+  memset(&instance->console, 0, sizeof(instance->console));
+  instance->console.input = instance->input;
+  instance->console.input_length = instance->input_length;
+
+  instance->vm = vm_create_image(image);
+  if (!instance->vm) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+  instance->vm->console = buffer_console_make(&instance->console);
+}
+
+static void instance_free(batch_instance* instance) {
+  buffer_console_free(&instance->console);
+  vm_destroy(instance->vm);
+}
+
+// Non-zero if both ended in the same state
+static int instances_match(const batch_instance* a, const batch_instance* b) {
+  return a->vm->status == b->vm->status
+      && memcmp(a->vm->registers, b->vm->registers, sizeof(a->vm->registers)) == 0
+      && memcmp(a->vm->memory, b->vm->memory, MEMORY_SIZE * sizeof(uint16_t)) == 0
+      && a->console.input_position == b->console.input_position
+      && a->console.output_length == b->console.output_length
+      && memcmp(a->console.output, b->console.output, a->console.output_length) == 0;
+}
+
+static void write_metrics(const char* path, const batch_instance* instances, uint64_t total,
+                          const lockstep_stats* stats, double elapsed) {
+  FILE* out = fopen(path, "w");
+  if (!out) {
+    printf("failed to write %s\n", path);
+    exit(1);
+  }
+
+  int counts[VM_WAIT + 1] = { 0 };
+  for (int i = 0; i < input_count; ++i) {
+    ++counts[instances[i].vm->status];
+  }
+
+  metric_write(out, "lc3_batch_guests", "gauge", "Guests in the batch, by final status.",
+               "status=\"halted\"", counts[VM_HALTED]);
+  metric_sample(out, "lc3_batch_guests", "status=\"fault\"", counts[VM_FAULT]);
+  metric_sample(out, "lc3_batch_guests", "status=\"running\"", counts[VM_RUNNING]);
+  metric_write(out, "lc3_batch_instructions", "gauge", "Instructions executed by all guests.",
+               NULL, total);
+  metric_write(out, "lc3_batch_lockstep_instructions", "gauge", "Instructions executed in a group of two or more.",
+               NULL, stats->lockstep);
+  metric_write(out, "lc3_batch_lanes_per_step", "gauge", "Average guests per lockstep step.",
+               NULL, stats->issued ? (double) stats->lockstep / stats->issued : 0.0);
+  metric_write(out, "lc3_batch_falls", "gauge", "Guests that fell out of their group.", NULL, stats->falls);
+  metric_write(out, "lc3_batch_run_seconds", "gauge", "Wall time of the lockstep run.", NULL, elapsed);
+  metric_write(out, "lc3_batch_mips", "gauge", "Millions of instructions per second.",
+               NULL, elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+  metric_write(out, "lc3_batch_private_bytes", "gauge", "Private resident memory after the run.",
+               NULL, private_kib() * 1024.0);
+  metric_write(out, "lc3_batch_peak_resident_bytes", "gauge", "Peak resident memory of the process.",
+               NULL, metric_peak_resident_bytes());
+  fclose(out);
+}
+
+static void write_output(const char* directory, const batch_instance* instance) {
+  const char* name = strrchr(instance->input_path, '/');
+  name = name ? name + 1 : instance->input_path;
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s.out", directory, name);
+
+  FILE* file = fopen(path, "wb");
+  if (!file || fwrite(instance->console.output, 1, instance->console.output_length, file)
+                   != instance->console.output_length) {
+    printf("failed to write %s\n", path);
+    exit(1);
+  }
+  fclose(file);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  uint64_t max_instructions = 100000000;
+  const char* output_directory = NULL;
+  const char* metrics_path = NULL;
+  int check = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "m:cw:M:l:i:")) != -1) {
+    switch (option) {
+      case 'm':
+        max_instructions = strtoull(optarg, NULL, 0);
+        break;
+      case 'c':
+        check = 1;
+        break;
+      case 'w':
+        output_directory = optarg;
+        break;
+      case 'M':
+        metrics_path = optarg;
+        break;
+      case 'l':
+        add_input_list(optarg);
+        break;
+      case 'i':
+        add_input(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (optind >= argc || input_count == 0) {
+    usage();
+  }
+
+  lc3_loader loader;
+  loader_init(&loader);
+  for (int j = optind; j < argc; ++j) {
+    if (!loader_add_image(&loader, argv[j])) {
+      printf("failed to load: %s\n", loader.error);
+      exit(1);
+    }
+  }
+
+  // Every guest maps the images copy-on-write
+  shared_image* image = shared_image_create(&loader);
+  if (!image) {
+    printf("failed to allocate memory\n");
+    exit(1);
+  }
+  loader_free(&loader);
+
+  batch_instance* instances = (batch_instance*) calloc(input_count, sizeof(batch_instance));
+  lc3_vm** vms = (lc3_vm**) malloc(input_count * sizeof(lc3_vm*));
+  for (int i = 0; i < input_count; ++i) {
+    batch_instance* instance = &instances[i];
+    instance->input_path = input_paths[i];
+    if (!(instance->input = read_file(instance->input_path, &instance->input_length))) {
+      printf("failed to read input: %s\n", instance->input_path);
+      exit(1);
+    }
+    instance_init(instance, image);
+    vms[i] = instance->vm;
+  }
+
+  lockstep_stats stats;
+  double start = now();
+  uint64_t total = lockstep_run(vms, input_count, max_instructions, &stats);
+  double elapsed = now() - start;
+
+  for (int i = 0; i < input_count; ++i) {
+    const batch_instance* instance = &instances[i];
+    printf("%s: %s, %zu bytes of output\n", instance->input_path,
+           status_name(instance->vm->status), instance->console.output_length);
+    if (output_directory) {
+      write_output(output_directory, instance);
+    }
+  }
+
+  printf("%d guests, %llu instructions in %.3fs (%.1fM/s), %.1f%% in lockstep at %.1f lanes per step, %llu fell out\n",
+         input_count, (unsigned long long) total, elapsed, total / elapsed / 1e6,
+         total ? 100.0 * stats.lockstep / total : 0.0,
+         stats.issued ? (double) stats.lockstep / stats.issued : 0.0, (unsigned long long) stats.falls);
+
+  printf("%ld KiB of private memory for %d guests\n", private_kib(), input_count);
+  if (metrics_path) {
+    write_metrics(metrics_path, instances, total, &stats, elapsed);
+  }
+
+  int mismatches = 0;
+  if (check) {
+    double scalar = 0;
+
+    for (int i = 0; i < input_count; ++i) {
+      batch_instance reference = instances[i];
+      instance_init(&reference, image);
+
+      double t = now();
+      harness_engines[0].run(reference.vm, max_instructions);
+      scalar += now() - t;
+
+      if (!instances_match(&instances[i], &reference)) {
+        printf("MISMATCH: %s differs from the %s engine\n", instances[i].input_path, harness_engines[0].name);
+        ++mismatches;
+      }
+      instance_free(&reference);
+    }
+    printf("%d of %d guests match the %s engine, which took %.3fs\n",
+           input_count - mismatches, input_count, harness_engines[0].name, scalar);
+  }
+
+  for (int i = 0; i < input_count; ++i) {
+    instance_free(&instances[i]);
+    free(instances[i].input);
+  }
+  free(instances);
+  free(vms);
+  free(input_paths);
+  shared_image_release(image);
+  return mismatches ? 1 : 0;
+}
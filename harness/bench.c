@@ -0,0 +1,297 @@
+/* Benchmark runner
+
+Assembles each LC-3 program given (the corpus is the .asm files in
+bench/), runs it on every engine for a number of repetitions and
+reports guest MIPS per engine: the best run, the median and the
+relative standard deviation.
+Every run must halt with exactly the output in the program's .out
+file, so a fast but wrong engine fails too.
+
+With -b the best runs are compared against a baseline file of
+"program engine mips" lines, and any that falls more than -t percent
+(20 by default) below its baseline fails the run. Other load on the
+host only ever slows a run down, so the best of several runs is far
+steadier than the median, and runs are timed in thread CPU time. -u
+writes this run's best MIPS to the baseline file instead. A baseline
+only means something on the machine that wrote it, so none is kept in
+the tree: the bench-baseline build target records one in the build
+directory, and without it only the output is checked.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../core/assembler.h"
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/engine.h"
+
+#include "lane.h"
+
+enum { MAX_BASELINE = 256, NAME_MAX_LENGTH = 64 };
+
+/* Best MIPS of one program on one engine */
+typedef struct bench_result {
+  char program[NAME_MAX_LENGTH];
+  char engine[NAME_MAX_LENGTH];
+  double mips;
+} bench_result;
+
+static bench_result baseline[MAX_BASELINE];
+static int baseline_count;
+
+static bench_result results[MAX_BASELINE];
+static int result_count;
+
+static uint16_t image[MEMORY_SIZE];
+
+// CPU time of this thread, so time the host gives to others is not
+// counted against the engine
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+// "bench/sieve.asm" -> "sieve"
+static void program_name(const char* path, char* name) {
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  snprintf(name, NAME_MAX_LENGTH, "%s", base);
+
+  char* extension = strrchr(name, '.');
+  if (extension) {
+    *extension = 0;
+  }
+}
+
+// The expected output: path with its extension replaced by .out
+static uint8_t* read_expected(const char* path, size_t* length) {
+  char expected_path[4096];
+  snprintf(expected_path, sizeof(expected_path), "%s", path);
+
+  char* extension = strrchr(expected_path, '.');
+  if (extension && !strchr(extension, '/')) {
+    *extension = 0;
+  }
+  strncat(expected_path, ".out", sizeof(expected_path) - strlen(expected_path) - 1);
+  return read_file(expected_path, length);
+}
+
+static void read_baseline(const char* path) {
+  FILE* file = fopen(path, "r");
+  char line[256];
+
+  if (!file) {
+    printf("no baseline in %s, checking output only\n", path);
+    return;
+  }
+  while (fgets(line, sizeof(line), file) && baseline_count < MAX_BASELINE) {
+    bench_result* entry = &baseline[baseline_count];
+    if (line[0] != '#' && sscanf(line, "%63s %63s %lf", entry->program, entry->engine, &entry->mips) == 3) {
+      ++baseline_count;
+    }
+  }
+  fclose(file);
+}
+
+static const bench_result* find_baseline(const char* program, const char* engine) {
+  for (int i = 0; i < baseline_count; ++i) {
+    if (!strcmp(baseline[i].program, program) && !strcmp(baseline[i].engine, engine)) {
+      return &baseline[i];
+    }
+  }
+  return NULL;
+}
+
+static int write_baseline(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return 0;
+  }
+  fprintf(file, "# program engine best-mips, written by lc3-bench -u\n");
+  for (int i = 0; i < result_count; ++i) {
+    fprintf(file, "%s %s %.1f\n", results[i].program, results[i].engine, results[i].mips);
+  }
+  return fclose(file) == 0;
+}
+
+// One run from a fresh machine. Returns the instructions executed,
+// 0 if the program did not halt with the expected output
+static uint64_t run_once(harness_lane* lane, uint64_t max_instructions,
+                         const uint8_t* expected, size_t expected_length, double* seconds) {
+  vm_reset(&lane->vm);
+  memcpy(lane->vm.memory, image, sizeof(image));
+  lane->console.output_length = 0;
+
+  double start = now();
+  uint64_t executed = lane->engine->run(&lane->vm, max_instructions);
+  *seconds = now() - start;
+
+  if (lane->vm.status != VM_HALTED || lane->console.output_length != expected_length
+      || memcmp(lane->console.output, expected, expected_length) != 0) {
+    return 0;
+  }
+  return executed;
+}
+
+// Run a program on every engine; returns the number of failures
+static int bench_program(const char* path, int repetitions, uint64_t max_instructions, double threshold) {
+  char name[NAME_MAX_LENGTH];
+  asm_result assembled;
+  size_t expected_length;
+
+  program_name(path, name);
+  memset(image, 0, sizeof(image));
+  if (!assemble_file(path, image, NULL, &assembled)) {
+    printf("%s:%d: %s\n", path, assembled.error_line, assembled.error);
+    return 1;
+  }
+
+  uint8_t* expected = read_expected(path, &expected_length);
+  if (!expected) {
+    printf("%s: no expected output\n", name);
+    return 1;
+  }
+
+  int failures = 0;
+  double* mips = (double*) malloc(repetitions * sizeof(double));
+
+  for (int e = 0; e < ENGINE_COUNT; ++e) {
+    harness_lane lane;
+    lane_init(&lane, &harness_engines[e], NULL, 0);
+
+    // One warm-up run, then the measured ones
+    double seconds;
+    uint64_t executed = run_once(&lane, max_instructions, expected, expected_length, &seconds);
+    for (int r = 0; r < repetitions && executed; ++r) {
+      executed = run_once(&lane, max_instructions, expected, expected_length, &seconds);
+      mips[r] = executed / seconds / 1e6;
+    }
+
+    if (!executed) {
+      printf("%-14s %-9s FAILED: %s, %zu bytes of output\n", name, lane.engine->name,
+             status_name(lane.vm.status), lane.console.output_length);
+      ++failures;
+      lane_free(&lane);
+      continue;
+    }
+
+    double sum = 0;
+    double squares = 0;
+    for (int r = 0; r < repetitions; ++r) {
+      sum += mips[r];
+      squares += mips[r] * mips[r];
+    }
+    double mean = sum / repetitions;
+    double deviation = sqrt(fmax(squares / repetitions - mean * mean, 0));
+
+    qsort(mips, repetitions, sizeof(double), compare_doubles);
+    double best = mips[repetitions - 1];
+    double median = repetitions % 2 ? mips[repetitions / 2]
+                                    : (mips[repetitions / 2 - 1] + mips[repetitions / 2]) / 2;
+
+    printf("%-14s %-9s %10llu  %8.1f MIPS  %8.1f  %4.1f%%",
+           name, lane.engine->name, (unsigned long long) executed, best, median,
+           100 * deviation / mean);
+
+    const bench_result* base = find_baseline(name, lane.engine->name);
+    if (base) {
+      double change = 100 * (best - base->mips) / base->mips;
+      printf("  %+6.1f%% vs %.1f", change, base->mips);
+      if (change < -threshold) {
+        printf("  REGRESSION");
+        ++failures;
+      }
+    }
+    printf("\n");
+
+    if (result_count < MAX_BASELINE) {
+      bench_result* result = &results[result_count++];
+      snprintf(result->program, sizeof(result->program), "%s", name);
+      snprintf(result->engine, sizeof(result->engine), "%s", lane.engine->name);
+      result->mips = best;
+    }
+    lane_free(&lane);
+  }
+
+  free(mips);
+  free(expected);
+  return failures;
+}
+
+static void usage() {
+  printf("lc3-bench [-r repetitions] [-m max-instructions] [-b baseline-file [-t percent] [-u]] program.asm ...\n");
+  exit(2);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  int repetitions = 7;
+  uint64_t max_instructions = 1000000000;
+  const char* baseline_path = NULL;
+  double threshold = 20;
+  int update = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "r:m:b:t:u")) != -1) {
+    switch (option) {
+      case 'r':
+        repetitions = atoi(optarg);
+        break;
+      case 'm':
+        max_instructions = strtoull(optarg, NULL, 0);
+        break;
+      case 'b':
+        baseline_path = optarg;
+        break;
+      case 't':
+        threshold = atof(optarg);
+        break;
+      case 'u':
+        update = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (optind >= argc || repetitions < 1 || (update && !baseline_path)) {
+    usage();
+  }
+
+  if (baseline_path && !update) {
+    read_baseline(baseline_path);
+  }
+
+  printf("%-14s %-9s %10s  %13s  %8s  %5s\n", "program", "engine", "instr", "best", "median", "sd");
+
+  int failures = 0;
+  for (int j = optind; j < argc; ++j) {
+    failures += bench_program(argv[j], repetitions, max_instructions, threshold);
+  }
+
+  if (update) {
+    if (!write_baseline(baseline_path)) {
+      printf("failed to write baseline: %s\n", baseline_path);
+      exit(1);
+    }
+    printf("baseline written to %s\n", baseline_path);
+  }
+
+  if (failures) {
+    printf("%d failed\n", failures);
+  }
+  return failures ? 1 : 0;
+}
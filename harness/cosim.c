@@ -0,0 +1,156 @@
+/* Differential co-simulation harness
+
+Runs every engine on its own VM, loaded with the same images and
+fed the same scripted input. Every interval instructions each engine
+is compared against the reference (the first engine): status,
+registers, memory and console output must match bit-for-bit.
+
+When a chunk disagrees, all engines are rewound to the start of the
+chunk and stepped one instruction at a time to report the first
+divergent instruction.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/engine.h"
+#include "../core/loader.h"
+
+#include "lane.h"
+
+static harness_lane lanes[ENGINE_COUNT];
+
+// Rewind every lane to the start of the chunk and find the first divergent instruction
+static void locate_divergence(uint64_t chunk_start, uint64_t chunk_length) {
+
+  for (int i = 0; i < ENGINE_COUNT; ++i) {
+    lane_restore(&lanes[i]);
+  }
+
+  for (uint64_t step = 0; step < chunk_length; ++step) {
+    uint16_t pc = lanes[0].vm.registers[R_PC];
+    uint16_t instruction = lanes[0].vm.memory[pc];
+
+    for (int i = 0; i < ENGINE_COUNT; ++i) {
+      lanes[i].engine->run(&lanes[i].vm, 1);
+    }
+
+    for (int i = 1; i < ENGINE_COUNT; ++i) {
+      if (!lanes_match(&lanes[0], &lanes[i], ALL_PAGES)) {
+        report_divergence(stdout, &lanes[0], &lanes[i], chunk_start + step + 1, pc, instruction);
+        return;
+      }
+    }
+  }
+
+  printf("DIVERGENCE in instructions %llu-%llu did not reproduce when single stepping\n",
+         (unsigned long long) chunk_start + 1, (unsigned long long) (chunk_start + chunk_length));
+}
+
+static void usage() {
+  printf("lc3-cosim [-n interval] [-m max-instructions] [-i input-file] [-o] image-file1 ...\n");
+  exit(2);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  uint64_t interval = 100000;
+  uint64_t max_instructions = 100000000;
+  const char* input_path = NULL;
+  int show_output = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "n:m:i:o")) != -1) {
+    switch (option) {
+      case 'n':
+        interval = strtoull(optarg, NULL, 0);
+        break;
+      case 'm':
+        max_instructions = strtoull(optarg, NULL, 0);
+        break;
+      case 'i':
+        input_path = optarg;
+        break;
+      case 'o':
+        show_output = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (optind >= argc || interval == 0) {
+    usage();
+  }
+
+  uint8_t* input = NULL;
+  size_t input_length = 0;
+  if (input_path && !(input = read_file(input_path, &input_length))) {
+    printf("failed to read input: %s\n", input_path);
+    exit(1);
+  }
+
+  // Through the loader, so overlapping images fail as they do in lc3
+  lc3_loader loader;
+  loader_init(&loader);
+  for (int j = optind; j < argc; ++j) {
+    if (!loader_add_image(&loader, argv[j])) {
+      printf("failed to load: %s\n", loader.error);
+      exit(1);
+    }
+  }
+
+  for (int i = 0; i < ENGINE_COUNT; ++i) {
+    harness_lane* lane = &lanes[i];
+    lane_init(lane, &harness_engines[i], input, input_length);
+    loader_install(&loader, &lane->vm);
+  }
+  loader_free(&loader);
+
+  uint64_t total = 0;
+  while (total < max_instructions && lanes[0].vm.status == VM_RUNNING) {
+
+    uint64_t chunk = max_instructions - total < interval ? max_instructions - total : interval;
+
+    for (int i = 0; i < ENGINE_COUNT; ++i) {
+      lane_save(&lanes[i]);
+    }
+
+    uint64_t executed = lanes[0].engine->run(&lanes[0].vm, chunk);
+    int diverged = 0;
+
+    for (int i = 1; i < ENGINE_COUNT; ++i) {
+      uint64_t lane_executed = lanes[i].engine->run(&lanes[i].vm, chunk);
+      if (lane_executed != executed || !lanes_match(&lanes[0], &lanes[i], ALL_PAGES)) {
+        diverged = 1;
+      }
+    }
+
+    if (diverged) {
+      locate_divergence(total, chunk);
+      exit(1);
+    }
+
+    total += executed;
+  }
+
+  if (show_output) {
+    fwrite(lanes[0].console.output, 1, lanes[0].console.output_length, stdout);
+  }
+
+  printf("%d engines agree after %llu instructions (%s, %zu bytes of output)\n",
+         ENGINE_COUNT, (unsigned long long) total,
+         status_name(lanes[0].vm.status),
+         lanes[0].console.output_length);
+
+  for (int i = 0; i < ENGINE_COUNT; ++i) {
+    lane_free(&lanes[i]);
+  }
+  free(input);
+  return 0;
+}
@@ -0,0 +1,864 @@
+/* Coverage-guided fuzzer for the instruction set
+
+Each test case is a short random program loaded at PC_START together
+with initial registers, condition flags and keyboard input. The case
+runs on every engine under a small instruction budget:
+
+- the reference engine is single stepped to record PC/opcode edges
+  into a coverage map shared by all worker processes
+- the other engines run at full speed and must end in the same state
+
+Cases that reach new coverage join the corpus. Divergences are
+minimized and saved in-process. Crashes kill the worker; the
+supervisor minimizes the saved case in forked children and restarts
+the worker.
+
+Every VM is reused between cases. Only memory pages the previous case
+loaded or wrote are cleared, so a case costs roughly its own
+instruction count, on every engine: up to budget instructions on each
+of four, the reference one stepped one at a time. That bounds a worker
+at tens of thousands of cases a second, not millions; throughput
+scales with -j.
+
+Each worker draws from its own stream, derived from -s and its index.
+With -j 1 a seed reproduces a run exactly; with more workers, which
+share coverage, the corpus also depends on their timing.
+
+The case format is also a libFuzzer target (build with -DLC3_LIBFUZZER):
+  bytes 0-15   R0-R7, big endian
+  byte 16      condition flags (0, P, Z, N)
+  byte 17      input length (0-15), followed by the input bytes
+  remaining    program words, big endian
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../core/core.h"
+#include "../core/disassembler.h"
+#include "../core/opcodes.h"
+#include "../c/fetch-execute.h"
+
+#include "lane.h"
+
+enum {
+  MAP_SIZE = 1 << 16,
+  MAX_PROGRAM_WORDS = 256,
+  MAX_INPUT = 15,
+  CASE_HEADER = 18,
+  MAX_CASE_BYTES = CASE_HEADER + MAX_INPUT + 2 * MAX_PROGRAM_WORDS,
+  MAX_BUDGET = 1 << 16,
+  MAX_CORPUS = 4096,
+  MAX_WORKERS = 64
+};
+
+/* A decoded test case */
+typedef struct fuzz_case {
+  uint16_t registers[8];
+  uint8_t cond;
+  uint8_t input_length;
+  uint8_t input[MAX_INPUT];
+  uint16_t word_count;
+  uint16_t words[MAX_PROGRAM_WORDS];
+} fuzz_case;
+
+/* State shared by the supervisor and all workers */
+typedef struct fuzz_shared {
+  uint8_t coverage[MAP_SIZE];   /* hit-count buckets seen per edge */
+  uint32_t edges;
+  uint32_t divergences;
+  uint32_t crashes;
+  uint8_t divergence_seen[16 * ENGINE_COUNT];
+  uint64_t execs[MAX_WORKERS];
+  uint64_t corpus[MAX_WORKERS];
+} fuzz_shared;
+
+static fuzz_shared* shared;
+
+static harness_lane lanes[ENGINE_COUNT];
+static uint64_t loaded_pages;
+static uint64_t executed[ENGINE_COUNT];
+
+/* Coverage of the current case */
+static uint8_t trace[MAP_SIZE];
+static uint32_t touched[MAX_BUDGET];
+static uint32_t touched_count;
+
+static uint64_t budget = 256;
+static const char* output_directory = ".";
+
+/* Saved by the crash handler */
+static uint8_t current_bytes[MAX_CASE_BYTES];
+static size_t current_size;
+static char crash_path[4096];
+
+static const uint16_t cond_values[4] = { 0, FL_POS, FL_ZRO, FL_NEG };
+
+/* RANDOM NUMBERS */
+static uint64_t seed = 0x9E3779B97F4A7C15ull;
+static uint64_t rng_state;
+
+static uint64_t splitmix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+static uint32_t rng() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (uint32_t) (rng_state >> 16);
+}
+
+/* CASE ENCODING */
+static size_t encode_case(const fuzz_case* c, uint8_t* data) {
+  size_t size = 0;
+
+  for (int r = 0; r < 8; ++r) {
+    data[size++] = c->registers[r] >> 8;
+    data[size++] = c->registers[r] & 0xFF;
+  }
+  data[size++] = c->cond;
+  data[size++] = c->input_length;
+  memcpy(data + size, c->input, c->input_length);
+  size += c->input_length;
+
+  for (int i = 0; i < c->word_count; ++i) {
+    data[size++] = c->words[i] >> 8;
+    data[size++] = c->words[i] & 0xFF;
+  }
+  return size;
+}
+
+static void decode_case(const uint8_t* data, size_t size, fuzz_case* c) {
+  uint8_t header[CASE_HEADER] = { 0 };
+  memcpy(header, data, size < CASE_HEADER ? size : CASE_HEADER);
+
+  for (int r = 0; r < 8; ++r) {
+    c->registers[r] = (header[2 * r] << 8) | header[2 * r + 1];
+  }
+  c->cond = header[16] & 3;
+
+  size_t position = CASE_HEADER;
+  c->input_length = header[17] % (MAX_INPUT + 1);
+  if (position + c->input_length > size) {
+    c->input_length = size > position ? size - position : 0;
+  }
+  memcpy(c->input, data + position, c->input_length);
+  position += c->input_length;
+
+  c->word_count = 0;
+  while (position + 1 < size && c->word_count < MAX_PROGRAM_WORDS) {
+    c->words[c->word_count++] = (data[position] << 8) | data[position + 1];
+    position += 2;
+  }
+}
+
+/* EXECUTION */
+
+// Map a hit count onto an AFL style bucket bit
+static uint8_t bucket(uint8_t count) {
+  if (count < 4) return count == 3 ? 4 : count;
+  if (count < 8) return 8;
+  if (count < 16) return 16;
+  if (count < 32) return 32;
+  if (count < 128) return 64;
+  return 128;
+}
+
+// Single step the reference engine recording PC/opcode edges
+static uint64_t run_traced(lc3_vm* vm, uint64_t budget) {
+  uint64_t count = 0;
+  uint32_t previous = 0;
+
+  while (count < budget && vm->status == VM_RUNNING) {
+    uint16_t pc = vm->registers[R_PC];
+    uint32_t location = ((((uint32_t) pc << 4) | (vm->memory[pc] >> 12)) * 0x9E3779B1u) >> 16;
+    uint32_t edge = (location ^ previous) & (MAP_SIZE - 1);
+
+    if (trace[edge] == 0) {
+      touched[touched_count++] = edge;
+    }
+    if (trace[edge] < 255) {
+      ++trace[edge];
+    }
+    previous = location >> 1;
+
+    fetchExecute(vm);
+    ++count;
+  }
+  return count;
+}
+
+// Merge the trace of the last case into the shared map, non-zero if it found anything new
+static int merge_coverage() {
+  int novel = 0;
+
+  for (uint32_t i = 0; i < touched_count; ++i) {
+    uint32_t edge = touched[i];
+    uint8_t bit = bucket(trace[edge]);
+    trace[edge] = 0;
+
+    if (!(shared->coverage[edge] & bit)) {
+      if (!shared->coverage[edge]) {
+        __sync_fetch_and_add(&shared->edges, 1);
+      }
+      __sync_fetch_and_or(&shared->coverage[edge], bit);
+      novel = 1;
+    }
+  }
+  touched_count = 0;
+  return novel;
+}
+
+// Clear what the previous case left behind and load the case into every lane
+static void load_case(const fuzz_case* c) {
+  uint64_t program_pages = 0;
+  for (uint32_t page = PC_START >> MEMORY_PAGE_SHIFT; page <= (uint32_t) (PC_START + c->word_count) >> MEMORY_PAGE_SHIFT; ++page) {
+    program_pages |= 1ull << page;
+  }
+
+  for (int i = 0; i < ENGINE_COUNT; ++i) {
+    lc3_vm* vm = &lanes[i].vm;
+    uint64_t pages = vm->dirty_pages | loaded_pages;
+
+    for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+      if (pages & (1ull << page)) {
+        memset(vm->memory + ((size_t) page << MEMORY_PAGE_SHIFT), 0, MEMORY_PAGE_WORDS * sizeof(uint16_t));
+      }
+    }
+    memcpy(vm->memory + PC_START, c->words, c->word_count * sizeof(uint16_t));
+
+    memcpy(vm->registers, c->registers, sizeof(c->registers));
+    vm->registers[R_PC] = PC_START;
+    vm->registers[R_COND] = cond_values[c->cond & 3];
+    vm->status = VM_RUNNING;
+    vm->dirty_pages = 0;
+
+    lanes[i].console.input = c->input;
+    lanes[i].console.input_length = c->input_length;
+    lanes[i].console.input_position = 0;
+    lanes[i].console.output_length = 0;
+  }
+  loaded_pages = program_pages;
+}
+
+// Run one case on every engine, returns the index of the first divergent engine or 0
+static int execute_case(const fuzz_case* c, int traced) {
+  load_case(c);
+
+  if (traced) {
+    executed[0] = run_traced(&lanes[0].vm, budget);
+  }
+  else {
+    executed[0] = lanes[0].engine->run(&lanes[0].vm, budget);
+  }
+
+  for (int i = 1; i < ENGINE_COUNT; ++i) {
+    executed[i] = lanes[i].engine->run(&lanes[i].vm, budget);
+  }
+
+  for (int i = 1; i < ENGINE_COUNT; ++i) {
+    uint64_t pages = lanes[0].vm.dirty_pages | lanes[i].vm.dirty_pages | loaded_pages;
+    if (executed[i] != executed[0] || !lanes_match(&lanes[0], &lanes[i], pages)) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+// Disassembly of the case's program
+static void list_program(FILE* out, const fuzz_case* c) {
+  char line[DISASSEMBLY_LINE_MAX];
+
+  fprintf(out, "program:\n");
+  for (uint16_t i = 0; i < c->word_count; ++i) {
+    disassemble_line(PC_START + i, c->words[i], NULL, line);
+    fprintf(out, "  %s\n", line);
+  }
+}
+
+// Re-run a divergent case one instruction at a time and describe it
+static int describe_divergence(const fuzz_case* c, FILE* out) {
+  load_case(c);
+
+  for (uint64_t step = 0; step < budget && lanes[0].vm.status == VM_RUNNING; ++step) {
+    uint16_t pc = lanes[0].vm.registers[R_PC];
+    uint16_t instruction = lanes[0].vm.memory[pc];
+
+    for (int i = 0; i < ENGINE_COUNT; ++i) {
+      lanes[i].engine->run(&lanes[i].vm, 1);
+    }
+
+    for (int i = 1; i < ENGINE_COUNT; ++i) {
+      if (!lanes_match(&lanes[0], &lanes[i], ALL_PAGES)) {
+        if (out) {
+          report_divergence(out, &lanes[0], &lanes[i], step + 1, pc, instruction);
+          list_program(out, c);
+        }
+        return (instruction >> 12) * ENGINE_COUNT + i;
+      }
+    }
+  }
+  return -1;
+}
+
+/* MINIMIZATION */
+typedef int (*case_predicate)(const fuzz_case* c);
+
+static int diverges(const fuzz_case* c) {
+  return execute_case(c, 0) != 0;
+}
+
+// Run the case in a child process, non-zero if the child is killed by a signal
+static int crashes(const fuzz_case* c) {
+  pid_t child = fork();
+  if (child == 0) {
+    signal(SIGSEGV, SIG_DFL);
+    signal(SIGBUS, SIG_DFL);
+    signal(SIGFPE, SIG_DFL);
+    signal(SIGABRT, SIG_DFL);
+    execute_case(c, 0);
+    _exit(0);
+  }
+
+  int status;
+  if (child < 0 || waitpid(child, &status, 0) < 0) {
+    return 0;
+  }
+  return WIFSIGNALED(status);
+}
+
+// Shrink a failing case while the predicate still holds
+static void minimize_case(fuzz_case* c, case_predicate still_fails) {
+  int progress = 1;
+
+  while (progress) {
+    progress = 0;
+    fuzz_case trial;
+
+    // Drop trailing program words
+    for (int chunk = c->word_count / 2; chunk > 0; chunk /= 2) {
+      while (c->word_count >= chunk) {
+        trial = *c;
+        trial.word_count -= chunk;
+        if (!still_fails(&trial)) {
+          break;
+        }
+        *c = trial;
+        progress = 1;
+      }
+    }
+
+    // Replace words with 0x0000 (a branch that is never taken)
+    for (int i = 0; i < c->word_count; ++i) {
+      if (c->words[i]) {
+        trial = *c;
+        trial.words[i] = 0;
+        if (still_fails(&trial)) {
+          *c = trial;
+          progress = 1;
+        }
+      }
+    }
+
+    // Clear registers
+    for (int r = 0; r < 8; ++r) {
+      if (c->registers[r]) {
+        trial = *c;
+        trial.registers[r] = 0;
+        if (still_fails(&trial)) {
+          *c = trial;
+          progress = 1;
+        }
+      }
+    }
+
+    if (c->cond) {
+      trial = *c;
+      trial.cond = 0;
+      if (still_fails(&trial)) {
+        *c = trial;
+        progress = 1;
+      }
+    }
+
+    // Drop input
+    while (c->input_length) {
+      trial = *c;
+      --trial.input_length;
+      if (!still_fails(&trial)) {
+        break;
+      }
+      *c = trial;
+      progress = 1;
+    }
+  }
+}
+
+static int save_case(const char* path, const fuzz_case* c) {
+  uint8_t data[MAX_CASE_BYTES];
+  size_t size = encode_case(c, data);
+
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return 0;
+  }
+  fwrite(data, 1, size, file);
+  fclose(file);
+  return 1;
+}
+
+static int load_case_file(const char* path, fuzz_case* c) {
+  uint8_t data[MAX_CASE_BYTES];
+
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return 0;
+  }
+  size_t size = fread(data, 1, sizeof(data), file);
+  fclose(file);
+
+  decode_case(data, size, c);
+  return 1;
+}
+
+static void handle_divergence(const fuzz_case* found) {
+  fuzz_case c = *found;
+  minimize_case(&c, diverges);
+
+  int signature = describe_divergence(&c, NULL);
+  if (signature < 0 || __sync_lock_test_and_set(&shared->divergence_seen[signature], 1)) {
+    return;
+  }
+
+  uint32_t id = __sync_fetch_and_add(&shared->divergences, 1);
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s/divergence-%u.case", output_directory, id);
+  save_case(path, &c);
+
+  snprintf(path, sizeof(path), "%s/divergence-%u.txt", output_directory, id);
+  FILE* report = fopen(path, "w");
+  if (report) {
+    describe_divergence(&c, report);
+    fclose(report);
+  }
+}
+
+/* CRASHES */
+static void handle_crash(int signal_number) {
+  int file = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file >= 0) {
+    ssize_t written = write(file, current_bytes, current_size);
+    (void) written;
+    close(file);
+  }
+  signal(signal_number, SIG_DFL);
+  raise(signal_number);
+}
+
+/* MUTATION */
+
+// A random instruction, biased away from RTI/RES and towards real trap vectors
+static uint16_t random_instruction() {
+  uint16_t word = (uint16_t) rng();
+
+  switch (word >> 12) {
+    case OP_RTI:
+    case OP_RES:
+      if (rng() % 8) {
+        word = (word & 0x0FFF) | (OP_ADD << 12);
+      }
+      break;
+    case OP_TRAP:
+      if (rng() % 16) {
+        word = (OP_TRAP << 12) | (TRAP_GETC + rng() % 6);
+      }
+      break;
+  }
+  return word;
+}
+
+static uint16_t interesting_value() {
+  static const uint16_t values[] = {
+    0x0000, 0x0001, 0x7FFF, 0x8000, 0xFFFF, PC_START, MR_KBSR, MR_KBDR, 0xFFFE
+  };
+  uint32_t choice = rng() % 12;
+  if (choice < sizeof(values) / sizeof(values[0])) {
+    return values[choice];
+  }
+  return choice == 9 ? (uint16_t) (PC_START + rng() % MAX_PROGRAM_WORDS) : (uint16_t) rng();
+}
+
+static void generate_case(fuzz_case* c) {
+  memset(c, 0, sizeof(*c));
+
+  for (int r = 0; r < 8; ++r) {
+    c->registers[r] = interesting_value();
+  }
+  c->cond = rng() & 3;
+  c->input_length = rng() % (MAX_INPUT + 1);
+  for (int i = 0; i < c->input_length; ++i) {
+    c->input[i] = rng();
+  }
+  c->word_count = 1 + rng() % 32;
+  for (int i = 0; i < c->word_count; ++i) {
+    c->words[i] = rng() % 4 ? random_instruction() : interesting_value();
+  }
+}
+
+static void mutate_case(fuzz_case* c, const fuzz_case* corpus, uint32_t corpus_size) {
+  int mutations = 1 + rng() % 4;
+
+  while (mutations--) {
+    uint32_t i = c->word_count ? rng() % c->word_count : 0;
+
+    switch (rng() % 10) {
+      case 0:
+        if (c->word_count) c->words[i] = random_instruction();
+        break;
+      case 1:
+        if (c->word_count) c->words[i] ^= 1 << (rng() % 16);
+        break;
+      case 2:
+        if (c->word_count < MAX_PROGRAM_WORDS) {
+          memmove(c->words + i + 1, c->words + i, (c->word_count - i) * sizeof(uint16_t));
+          c->words[i] = random_instruction();
+          ++c->word_count;
+        }
+        break;
+      case 3:
+        if (c->word_count > 1) {
+          memmove(c->words + i, c->words + i + 1, (c->word_count - i - 1) * sizeof(uint16_t));
+          --c->word_count;
+        }
+        break;
+      case 4:
+        c->registers[rng() % 8] = interesting_value();
+        break;
+      case 5:
+        if (c->input_length) {
+          c->input[rng() % c->input_length] = rng();
+        }
+        else {
+          c->input_length = 1;
+          c->input[0] = rng();
+        }
+        break;
+      case 6:
+        if (corpus_size) {
+          // Splice a run of words from another corpus entry
+          const fuzz_case* other = &corpus[rng() % corpus_size];
+          if (other->word_count) {
+            uint32_t from = rng() % other->word_count;
+            uint32_t length = 1 + rng() % (other->word_count - from);
+            if (i + length > MAX_PROGRAM_WORDS) {
+              length = MAX_PROGRAM_WORDS - i;
+            }
+            memcpy(c->words + i, other->words + from, length * sizeof(uint16_t));
+            if (i + length > c->word_count) {
+              c->word_count = i + length;
+            }
+          }
+        }
+        break;
+      case 7:
+        c->cond = rng() & 3;
+        break;
+      case 8:
+        if (c->word_count) c->words[i] = interesting_value();
+        break;
+      case 9:
+        // Nudge the low bits: offsets, immediates and trap vectors
+        if (c->word_count) c->words[i] = (c->words[i] & 0xFFC0) | ((c->words[i] + rng() % 5 - 2) & 0x3F);
+        break;
+    }
+  }
+}
+
+/* WORKER */
+static void init_lanes() {
+  static int initialized;
+
+  if (!initialized) {
+    for (int i = 0; i < ENGINE_COUNT; ++i) {
+      lane_init(&lanes[i], &harness_engines[i], NULL, 0);
+    }
+    initialized = 1;
+  }
+  loaded_pages = ALL_PAGES;
+}
+
+static void run_worker(int worker, uint64_t max_execs) {
+  fuzz_case* corpus = (fuzz_case*) malloc(MAX_CORPUS * sizeof(fuzz_case));
+  uint32_t corpus_size = 0;
+  uint64_t execs = 0;
+  uint64_t previous_execs = shared->execs[worker]; /* from a crashed predecessor */
+
+  snprintf(crash_path, sizeof(crash_path), "%s/crash-pid%d.case", output_directory, (int) getpid());
+  signal(SIGSEGV, handle_crash);
+  signal(SIGBUS, handle_crash);
+  signal(SIGFPE, handle_crash);
+  signal(SIGABRT, handle_crash);
+
+  // The stream depends only on the seed, the worker and how far a
+  // crashed predecessor got, so -s reproduces a run
+  rng_state = splitmix(splitmix(seed + (uint64_t) worker) + previous_execs) | 1;
+  init_lanes();
+
+  fuzz_case c;
+  while (!max_execs || execs < max_execs) {
+    if (!corpus_size || rng() % 16 == 0) {
+      generate_case(&c);
+    }
+    else {
+      c = corpus[rng() % corpus_size];
+      mutate_case(&c, corpus, corpus_size);
+    }
+
+    current_size = encode_case(&c, current_bytes);
+    int divergent = execute_case(&c, 1);
+
+    if (merge_coverage()) {
+      corpus[corpus_size < MAX_CORPUS ? corpus_size++ : rng() % MAX_CORPUS] = c;
+      shared->corpus[worker] = corpus_size;
+    }
+
+    if (divergent) {
+      handle_divergence(&c);
+    }
+
+    if ((++execs & 0x3FF) == 0) {
+      shared->execs[worker] = previous_execs + execs;
+    }
+  }
+  shared->execs[worker] = previous_execs + execs;
+  free(corpus);
+}
+
+/* SUPERVISOR */
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static pid_t start_worker(int worker, uint64_t max_execs) {
+  pid_t child = fork();
+  if (child == 0) {
+    run_worker(worker, max_execs);
+    _exit(0);
+  }
+  return child;
+}
+
+// Minimize the case a crashed worker left behind, keeping one copy of each minimized case
+static void collect_crash(pid_t child) {
+  static uint64_t seen[1024];
+  static uint32_t seen_count;
+
+  char path[4096];
+  fuzz_case c;
+
+  snprintf(path, sizeof(path), "%s/crash-pid%d.case", output_directory, (int) child);
+  if (!load_case_file(path, &c)) {
+    return;
+  }
+  unlink(path);
+
+  init_lanes();
+  minimize_case(&c, crashes);
+
+  uint8_t data[MAX_CASE_BYTES];
+  size_t size = encode_case(&c, data);
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001B3ull;
+  }
+
+  for (uint32_t i = 0; i < seen_count; ++i) {
+    if (seen[i] == hash) {
+      return;
+    }
+  }
+  if (seen_count < sizeof(seen) / sizeof(seen[0])) {
+    seen[seen_count++] = hash;
+  }
+
+  snprintf(path, sizeof(path), "%s/crash-%u.case", output_directory, shared->crashes++);
+  save_case(path, &c);
+  printf("crash saved: %s\n", path);
+}
+
+static void print_stats(int workers, double elapsed) {
+  uint64_t execs = 0;
+  uint64_t corpus = 0;
+  for (int i = 0; i < workers; ++i) {
+    execs += shared->execs[i];
+    corpus += shared->corpus[i];
+  }
+  printf("%8.0fs  execs %llu  %.0f/s  corpus %llu  edges %u  divergences %u  crashes %u\n",
+         elapsed, (unsigned long long) execs, execs / (elapsed > 0 ? elapsed : 1),
+         (unsigned long long) corpus, shared->edges, shared->divergences, shared->crashes);
+  fflush(stdout);
+}
+
+static int supervise(int workers, uint64_t max_execs, double seconds) {
+  pid_t children[MAX_WORKERS];
+  int running = workers;
+  double start = now();
+  double last_report = start;
+
+  for (int i = 0; i < workers; ++i) {
+    children[i] = start_worker(i, max_execs);
+  }
+
+  while (running) {
+    usleep(10000);
+
+    for (int i = 0; i < workers; ++i) {
+      int status;
+      if (children[i] <= 0 || waitpid(children[i], &status, WNOHANG) != children[i]) {
+        continue;
+      }
+
+      if (WIFSIGNALED(status)) {
+        printf("worker %d killed by signal %d\n", i, WTERMSIG(status));
+        collect_crash(children[i]);
+        children[i] = start_worker(i, max_execs);
+      }
+      else {
+        children[i] = 0;
+        --running;
+      }
+    }
+
+    double t = now();
+    if (seconds > 0 && t - start >= seconds) {
+      for (int i = 0; i < workers; ++i) {
+        if (children[i] > 0) {
+          kill(children[i], SIGTERM);
+          waitpid(children[i], NULL, 0);
+        }
+      }
+      running = 0;
+    }
+    if (t - last_report >= 1 || !running) {
+      print_stats(workers, t - start);
+      last_report = t;
+    }
+  }
+
+  return shared->divergences || shared->crashes;
+}
+
+// Replay a saved case and describe any divergence
+static int replay(const char* path) {
+  fuzz_case c;
+  if (!load_case_file(path, &c)) {
+    printf("failed to read case: %s\n", path);
+    return 2;
+  }
+
+  init_lanes();
+  if (!execute_case(&c, 0)) {
+    printf("no divergence: %llu instructions, %s\n",
+           (unsigned long long) executed[0], status_name(lanes[0].vm.status));
+    return 0;
+  }
+  describe_divergence(&c, stdout);
+  return 1;
+}
+
+#ifdef LC3_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static fuzz_shared local;
+  if (!shared) {
+    shared = &local;
+    init_lanes();
+  }
+
+  fuzz_case c;
+  decode_case(data, size, &c);
+  if (execute_case(&c, 0)) {
+    abort();
+  }
+  return 0;
+}
+
+#else
+
+static void usage() {
+  printf("lc3-fuzz [-j workers] [-b budget] [-t seconds] [-n execs] [-s seed] [-o directory]\n");
+  printf("lc3-fuzz -r case-file\n");
+  exit(2);
+}
+
+/* MAIN */
+int main(int argc, char* argv[]) {
+
+  int workers = 1;
+  uint64_t max_execs = 0;
+  double seconds = 0;
+  const char* replay_path = NULL;
+
+  int option;
+  while ((option = getopt(argc, argv, "j:b:t:n:s:o:r:")) != -1) {
+    switch (option) {
+      case 'j':
+        workers = atoi(optarg);
+        break;
+      case 'b':
+        budget = strtoull(optarg, NULL, 0);
+        break;
+      case 't':
+        seconds = atof(optarg);
+        break;
+      case 'n':
+        max_execs = strtoull(optarg, NULL, 0);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'o':
+        output_directory = optarg;
+        break;
+      case 'r':
+        replay_path = optarg;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (workers < 1 || workers > MAX_WORKERS || budget == 0 || budget > MAX_BUDGET) {
+    usage();
+  }
+
+  shared = (fuzz_shared*) mmap(NULL, sizeof(fuzz_shared), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return 2;
+  }
+
+  if (replay_path) {
+    return replay(replay_path);
+  }
+  return supervise(workers, max_execs, seconds);
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../core/disassembler.h"
+#include "../core/page-allocator.h"
+#include "../c/fetch-execute.h"
+#include "../c/threaded.h"
+#include "../cpp/fetch-execute.h"
+
+#include "lane.h"
+
+const lc3_engine harness_engines[ENGINE_COUNT] = {
+  { "switch", fetchExecuteLoop },
+  { "goto", fetchExecuteComputedGoto },
+  { "template", fetchExecuteTemplate },
+  { "threaded", fetchExecuteThreaded }
+};
+
+static const char* register_names[R_COUNT] = {
+  "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "PC", "COND"
+};
+
+static const char* status_names[] = { "running", "halted", "fault", "break", "wait" };
+
+const char* status_name(int status) {
+  return status_names[status];
+}
+
+// Read a whole file into a heap buffer
+uint8_t* read_file(const char* path, size_t* length) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+
+  size_t capacity = 4096;
+  uint8_t* data = (uint8_t*) malloc(capacity);
+  *length = 0;
+
+  size_t read;
+  while (data && (read = fread(data + *length, 1, capacity - *length, file)) > 0) {
+    *length += read;
+    if (*length == capacity) {
+      capacity *= 2;
+      data = (uint8_t*) realloc(data, capacity);
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+void lane_init(harness_lane* lane, const lc3_engine* engine, const uint8_t* input, size_t input_length) {
+  memset(&lane->console, 0, sizeof(lane->console));
+  lane->engine = engine;
+  lane->console.input = input;
+  lane->console.input_length = input_length;
+
+  if (!vm_init(&lane->vm) || !(lane->snapshot_memory = memory_alloc())) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(1);
+  }
+  lane->vm.console = buffer_console_make(&lane->console);
+}
+
+void lane_free(harness_lane* lane) {
+  buffer_console_free(&lane->console);
+  memory_free(lane->snapshot_memory);
+  vm_free(&lane->vm);
+}
+
+void lane_save(harness_lane* lane) {
+  lane->snapshot = lane->vm;
+  memcpy(lane->snapshot_memory, lane->vm.memory, MEMORY_SIZE * sizeof(uint16_t));
+  lane->snapshot_input_position = lane->console.input_position;
+  lane->snapshot_output_length = lane->console.output_length;
+}
+
+void lane_restore(harness_lane* lane) {
+  uint16_t* memory = lane->vm.memory;
+  lane->vm = lane->snapshot;
+  lane->vm.memory = memory;
+  memcpy(memory, lane->snapshot_memory, MEMORY_SIZE * sizeof(uint16_t));
+  lane->console.input_position = lane->snapshot_input_position;
+  lane->console.output_length = lane->snapshot_output_length;
+}
+
+// Non-zero if the lane matches the reference on the given memory pages
+int lanes_match(const harness_lane* reference, const harness_lane* other, uint64_t pages) {
+
+  if (reference->vm.status != other->vm.status
+      || memcmp(reference->vm.registers, other->vm.registers, sizeof(other->vm.registers)) != 0
+      || reference->console.input_position != other->console.input_position
+      || reference->console.output_length != other->console.output_length
+      || memcmp(reference->console.output, other->console.output, other->console.output_length) != 0) {
+    return 0;
+  }
+
+  if (pages == ALL_PAGES) {
+    return memcmp(reference->vm.memory, other->vm.memory, MEMORY_SIZE * sizeof(uint16_t)) == 0;
+  }
+
+  for (int page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+    if (pages & (1ull << page)) {
+      size_t offset = (size_t) page << MEMORY_PAGE_SHIFT;
+      if (memcmp(reference->vm.memory + offset, other->vm.memory + offset,
+                 MEMORY_PAGE_WORDS * sizeof(uint16_t)) != 0) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+void report_divergence(FILE* out, const harness_lane* reference, const harness_lane* other,
+                       uint64_t instruction_count, uint16_t pc, uint16_t instruction) {
+
+  const char* a = reference->engine->name;
+  const char* b = other->engine->name;
+
+  fprintf(out, "DIVERGENCE at instruction %llu: %s vs %s\n",
+          (unsigned long long) instruction_count, a, b);
+  char line[DISASSEMBLY_LINE_MAX];
+  disassemble_line(pc, instruction, NULL, line);
+  fprintf(out, "  %s\n", line);
+
+  if (reference->vm.status != other->vm.status) {
+    fprintf(out, "  status: %s=%s %s=%s\n", a, status_names[reference->vm.status],
+            b, status_names[other->vm.status]);
+  }
+
+  for (int r = 0; r < R_COUNT; ++r) {
+    if (reference->vm.registers[r] != other->vm.registers[r]) {
+      fprintf(out, "  %s: %s=0x%04X %s=0x%04X\n", register_names[r],
+              a, reference->vm.registers[r], b, other->vm.registers[r]);
+    }
+  }
+
+  int shown = 0;
+  for (uint32_t address = 0; address < MEMORY_SIZE && shown < 8; ++address) {
+    if (reference->vm.memory[address] != other->vm.memory[address]) {
+      fprintf(out, "  memory[0x%04X]: %s=0x%04X %s=0x%04X\n", address,
+              a, reference->vm.memory[address], b, other->vm.memory[address]);
+      ++shown;
+    }
+  }
+
+  if (reference->console.input_position != other->console.input_position) {
+    fprintf(out, "  input consumed: %s=%zu %s=%zu\n", a, reference->console.input_position,
+            b, other->console.input_position);
+  }
+
+  if (reference->console.output_length != other->console.output_length
+      || memcmp(reference->console.output, other->console.output, other->console.output_length) != 0) {
+    fprintf(out, "  output: %s=%zu bytes %s=%zu bytes\n", a, reference->console.output_length,
+            b, other->console.output_length);
+  }
+}
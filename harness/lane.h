@@ -0,0 +1,48 @@
+#ifndef _LANE
+#define _LANE
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/engine.h"
+
+/* Engines under test
+The first entry is the reference
+*/
+extern const lc3_engine harness_engines[];
+
+enum { ENGINE_COUNT = 4 };
+
+/* Compare every memory page */
+#define ALL_PAGES UINT64_MAX
+
+/* One engine under test with its own VM and console */
+typedef struct harness_lane {
+  const lc3_engine* engine;
+  lc3_vm vm;
+  buffer_console console;
+
+  lc3_vm snapshot;
+  uint16_t* snapshot_memory;
+  size_t snapshot_input_position;
+  size_t snapshot_output_length;
+} harness_lane;
+
+void lane_init(harness_lane* lane, const lc3_engine* engine, const uint8_t* input, size_t input_length);
+void lane_free(harness_lane* lane);
+
+void lane_save(harness_lane* lane);
+void lane_restore(harness_lane* lane);
+
+const char* status_name(int status);
+
+/* A whole file in a heap buffer, NULL if it cannot be read */
+uint8_t* read_file(const char* path, size_t* length);
+
+int lanes_match(const harness_lane* reference, const harness_lane* other, uint64_t pages);
+void report_divergence(FILE* out, const harness_lane* reference, const harness_lane* other,
+                       uint64_t instruction_count, uint16_t pc, uint16_t instruction);
+
+#endif
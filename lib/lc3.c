@@ -0,0 +1,327 @@
+#include "lc3.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/console.h"
+#include "../core/core.h"
+#include "../core/engine.h"
+#include "../core/loader.h"
+#include "../core/watch.h"
+#include "../c/fetch-execute.h"
+#include "../c/threaded.h"
+#include "../cpp/fetch-execute.h"
+
+struct lc3_machine {
+  lc3_vm* vm;
+  const lc3_engine* engine;
+
+  buffer_console buffer;
+  uint8_t* input;           /* owned; buffer.input points here */
+  size_t input_capacity;
+
+  lc3_io io;                /* callbacks, if set */
+  char error[256];
+};
+
+static const lc3_engine engines[] = {
+  { "switch", fetchExecuteLoop },
+  { "goto", fetchExecuteComputedGoto },
+  { "template", fetchExecuteTemplate },
+  { "threaded", fetchExecuteThreaded }
+};
+
+enum { ENGINE_COUNT = sizeof(engines) / sizeof(engines[0]) };
+
+const char* lc3_engine_name(int index) {
+  return index >= 0 && index < ENGINE_COUNT ? engines[index].name : NULL;
+}
+
+// The engines are portable C and C++ with no paths for particular
+// CPUs, so what decides is how they were compiled: the threaded engine
+// leads the corpus in bench/ wherever its tail calls become jumps,
+// which takes an optimizing build. Without one, every handler is a
+// real call and the computed goto engine is the better choice
+const char* lc3_engine_auto(void) {
+#if defined(THREADED_MUSTTAIL) || defined(__OPTIMIZE__)
+  return "threaded";
+#else
+  return "goto";
+#endif
+}
+
+static const lc3_engine* find_engine(const char* name) {
+  if (!name || !strcmp(name, "auto")) {
+    name = lc3_engine_auto();
+  }
+  for (int i = 0; i < ENGINE_COUNT; ++i) {
+    if (!strcmp(engines[i].name, name)) {
+      return &engines[i];
+    }
+  }
+  return NULL;
+}
+
+static void fail(lc3_machine* machine, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(machine->error, sizeof(machine->error), format, args);
+  va_end(args);
+}
+
+static void io_flush(void* context) {
+  (void) context;
+}
+
+// The owner's callbacks or the buffers, never blocking either way
+static void attach_console(lc3_machine* machine) {
+  lc3_vm* vm = machine->vm;
+  int waiting = vm->console.waiting;
+
+  if (machine->io.get_char) {
+    vm->console.get_char = machine->io.get_char;
+    vm->console.key_ready = machine->io.key_ready;
+    vm->console.put_char = machine->io.put_char;
+    vm->console.flush = machine->io.flush ? machine->io.flush : io_flush;
+    vm->console.context = machine->io.context;
+  }
+  else {
+    vm->console = buffer_console_make(&machine->buffer);
+  }
+  vm->console.nonblocking = 1;
+  vm->console.waiting = waiting;
+}
+
+lc3_machine* lc3_machine_create(const char* engine) {
+  const lc3_engine* found = find_engine(engine);
+  if (!found) {
+    return NULL;
+  }
+
+  lc3_machine* machine = (lc3_machine*) calloc(1, sizeof(lc3_machine));
+  if (!machine) {
+    return NULL;
+  }
+  machine->vm = vm_create();
+  if (!machine->vm) {
+    free(machine);
+    return NULL;
+  }
+  machine->engine = found;
+  attach_console(machine);
+  return machine;
+}
+
+void lc3_machine_destroy(lc3_machine* machine) {
+  if (machine) {
+    vm_destroy(machine->vm);
+    buffer_console_free(&machine->buffer);
+    free(machine->input);
+    free(machine);
+  }
+}
+
+int lc3_machine_set_engine(lc3_machine* machine, const char* engine) {
+  const lc3_engine* found = find_engine(engine);
+  if (!found) {
+    return 0;
+  }
+  machine->engine = found;
+  return 1;
+}
+
+const char* lc3_machine_engine(const lc3_machine* machine) {
+  return machine->engine->name;
+}
+
+int lc3_machine_load_words(lc3_machine* machine, uint16_t origin, const uint16_t* words, size_t count) {
+  lc3_loader loader;
+  loader_init(&loader);
+
+  if (count > MEMORY_SIZE) {
+    fail(machine, "image: %zu words is more than memory", count);
+    return 0;
+  }
+  if (!loader_add(&loader, "image", origin, words, (uint32_t) count)) {
+    fail(machine, "%s", loader.error);
+    return 0;
+  }
+  loader_install(&loader, machine->vm);
+  machine->vm->dirty_pages |= loader_pages(&loader);
+  loader_free(&loader);
+  return 1;
+}
+
+int lc3_machine_load(lc3_machine* machine, const void* image, size_t size) {
+  const uint8_t* data = (const uint8_t*) image;
+
+  if (size < 2 || size % 2 != 0 || size > 2 * (MEMORY_SIZE + 1)) {
+    fail(machine, "image: not an image (%zu bytes)", size);
+    return 0;
+  }
+
+  size_t count = size / 2 - 1;
+  uint16_t* words = (uint16_t*) malloc((count ? count : 1) * sizeof(uint16_t));
+  if (!words) {
+    fail(machine, "image: out of memory");
+    return 0;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    words[i] = data[2 * i + 2] << 8 | data[2 * i + 3];
+  }
+
+  int ok = lc3_machine_load_words(machine, data[0] << 8 | data[1], words, count);
+  free(words);
+  return ok;
+}
+
+const char* lc3_machine_error(const lc3_machine* machine) {
+  return machine->error;
+}
+
+void lc3_machine_reset(lc3_machine* machine) {
+  vm_reset(machine->vm);
+  if (machine->vm->debug) {
+    machine->vm->debug->resume_pc = -1;
+  }
+}
+
+static lc3_event event_of(const lc3_vm* vm) {
+  switch (vm->status) {
+    case VM_HALTED:
+      return LC3_EVENT_HALTED;
+    case VM_FAULT:
+      return LC3_EVENT_FAULT;
+    case VM_BREAK:
+      return LC3_EVENT_BREAK;
+    case VM_WAIT:
+      return LC3_EVENT_INPUT;
+    default:
+      return LC3_EVENT_BUDGET;
+  }
+}
+
+lc3_event lc3_machine_run(lc3_machine* machine, uint64_t count, uint64_t* executed) {
+  lc3_vm* vm = machine->vm;
+  uint64_t total = 0;
+
+  if (vm->status == VM_BREAK) {
+    vm_resume(vm);
+  }
+  else if (vm->status == VM_WAIT) {
+    vm->status = VM_RUNNING;
+  }
+
+  while (vm->status == VM_RUNNING && total < count) {
+    uint64_t ran = machine->engine->run(vm, count - total);
+
+    // Engines count stopping on a breakpoint, or at a GETC or IN that
+    // will run again, as an instruction; here only finished ones count
+    if (vm->status == VM_BREAK && vm->debug->hit.kind == WATCH_BREAKPOINT) {
+      --ran;
+    }
+    else if (vm->status == VM_WAIT && vm->console.waiting) {
+      --ran;
+    }
+    total += ran;
+  }
+  vm->console.flush(vm->console.context);
+
+  if (executed) {
+    *executed = total;
+  }
+  return event_of(vm);
+}
+
+uint16_t lc3_machine_register(const lc3_machine* machine, int r) {
+  return r >= 0 && r < R_COUNT ? machine->vm->registers[r] : 0;
+}
+
+void lc3_machine_set_register(lc3_machine* machine, int r, uint16_t value) {
+  if (r >= 0 && r < R_COUNT) {
+    machine->vm->registers[r] = value;
+  }
+}
+
+const uint16_t* lc3_machine_memory(const lc3_machine* machine) {
+  return machine->vm->memory;
+}
+
+uint16_t* lc3_machine_memory_write(lc3_machine* machine, uint16_t first, uint32_t count) {
+  lc3_vm* vm = machine->vm;
+  uint32_t end = (uint32_t) first + count;
+
+  if (end > MEMORY_SIZE) {
+    end = MEMORY_SIZE;
+  }
+  for (uint32_t page = first >> MEMORY_PAGE_SHIFT; page << MEMORY_PAGE_SHIFT < end; ++page) {
+    vm->dirty_pages |= 1ull << page;
+  }
+  return vm->memory + first;
+}
+
+int lc3_machine_break_add(lc3_machine* machine, uint16_t address) {
+  return break_add(machine->vm, address);
+}
+
+int lc3_machine_break_remove(lc3_machine* machine, uint16_t address) {
+  return break_remove(machine->vm, address);
+}
+
+int lc3_machine_input(lc3_machine* machine, const void* data, size_t length) {
+  buffer_console* buffer = &machine->buffer;
+
+  if (length == 0) {
+    return 1;
+  }
+
+  // Drop what the guest has read before growing
+  size_t pending = buffer->input_length - buffer->input_position;
+  if (buffer->input_position) {
+    memmove(machine->input, machine->input + buffer->input_position, pending);
+  }
+
+  if (pending + length > machine->input_capacity) {
+    size_t capacity = machine->input_capacity ? machine->input_capacity : 256;
+    while (capacity < pending + length) {
+      capacity *= 2;
+    }
+    uint8_t* input = (uint8_t*) realloc(machine->input, capacity);
+    if (!input) {
+      buffer->input_position = 0;
+      buffer->input_length = pending;
+      return 0;
+    }
+    machine->input = input;
+    machine->input_capacity = capacity;
+  }
+
+  memcpy(machine->input + pending, data, length);
+  buffer->input = machine->input;
+  buffer->input_position = 0;
+  buffer->input_length = pending + length;
+  return 1;
+}
+
+const char* lc3_machine_output(const lc3_machine* machine, size_t* length) {
+  if (length) {
+    *length = machine->buffer.output_length;
+  }
+  return machine->buffer.output;
+}
+
+void lc3_machine_output_clear(lc3_machine* machine) {
+  machine->buffer.output_length = 0;
+}
+
+void lc3_machine_set_io(lc3_machine* machine, const lc3_io* io) {
+  if (io) {
+    machine->io = *io;
+  }
+  else {
+    memset(&machine->io, 0, sizeof(machine->io));
+  }
+  attach_console(machine);
+}
@@ -0,0 +1,120 @@
+#ifndef _LIBLC3
+#define _LIBLC3
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* liblc3
+An LC-3 machine to embed in another program: load images from
+memory, run a number of instructions or until something happens,
+and look at or change memory in place. Machines are independent; one
+thread at a time may use each. See lc3.hpp for the C++ interface.
+
+Guest I/O goes to buffers by default: lc3_machine_input queues input,
+lc3_machine_output is what the guest wrote. GETC, IN and a KBSR poll
+with no input stop the machine with LC3_EVENT_INPUT rather than block,
+and the next run carries on once input has been queued.
+*/
+typedef struct lc3_machine lc3_machine;
+
+/* Why lc3_machine_run returned */
+typedef enum lc3_event {
+  LC3_EVENT_BUDGET = 0, /* ran every instruction asked for */
+  LC3_EVENT_HALTED,     /* TRAP HALT */
+  LC3_EVENT_FAULT,      /* RTI or reserved opcode */
+  LC3_EVENT_BREAK,      /* on a breakpoint, before running it */
+  LC3_EVENT_INPUT       /* waiting for input */
+} lc3_event;
+
+/* Register numbers, as in the ISA; LC3_PC and LC3_COND follow R7 */
+enum {
+  LC3_R0 = 0,
+  LC3_R7 = 7,
+  LC3_PC,
+  LC3_COND,
+  LC3_REGISTER_COUNT
+};
+
+enum { LC3_MEMORY_WORDS = 1 << 16 };
+
+/* Count meaning "until an event" */
+#define LC3_RUN_FOREVER UINT64_MAX
+
+/* Engines
+The same machine runs on any of them: "switch", "goto" (computed
+goto, with loop idioms), "template" (C++ templates) or "threaded"
+(tail calls). NULL or "auto" picks the fastest for this build.
+lc3_engine_name enumerates them and returns NULL past the last */
+const char* lc3_engine_name(int index);
+const char* lc3_engine_auto(void);
+
+/* NULL if the engine is unknown or there is no memory. The machine
+starts at x3000 with memory clear */
+lc3_machine* lc3_machine_create(const char* engine);
+void lc3_machine_destroy(lc3_machine* machine);
+
+/* Switching keeps all machine state; 0 if the engine is unknown */
+int lc3_machine_set_engine(lc3_machine* machine, const char* engine);
+const char* lc3_machine_engine(const lc3_machine* machine);
+
+/* Load an .obj image (big-endian origin, then words) or words at an
+origin. Return 0 and set lc3_machine_error if the image is malformed
+or runs past the end of memory */
+int lc3_machine_load(lc3_machine* machine, const void* image, size_t size);
+int lc3_machine_load_words(lc3_machine* machine, uint16_t origin, const uint16_t* words, size_t count);
+const char* lc3_machine_error(const lc3_machine* machine);
+
+/* Clear memory and registers, PC to x3000; queued input and output
+are kept, breakpoints too */
+void lc3_machine_reset(lc3_machine* machine);
+
+/* Run at most count instructions. A machine stopped on a breakpoint
+or for input carries on; one that halted or faulted stays stopped
+until reset. executed, if not NULL, is set to the instructions run */
+lc3_event lc3_machine_run(lc3_machine* machine, uint64_t count, uint64_t* executed);
+
+uint16_t lc3_machine_register(const lc3_machine* machine, int r);
+void lc3_machine_set_register(lc3_machine* machine, int r, uint16_t value);
+
+/* Memory views
+All LC3_MEMORY_WORDS words in place, valid until the machine is
+destroyed. Reading through the view has none of the effects of a
+guest load (the keyboard registers are not polled). Writes must go
+through lc3_machine_memory_write, which returns the same memory at
+first and records that count words from there may change */
+const uint16_t* lc3_machine_memory(const lc3_machine* machine);
+uint16_t* lc3_machine_memory_write(lc3_machine* machine, uint16_t first, uint32_t count);
+
+/* Breakpoints stop the machine with LC3_EVENT_BREAK before the
+instruction at address runs. 0 on failure */
+int lc3_machine_break_add(lc3_machine* machine, uint16_t address);
+int lc3_machine_break_remove(lc3_machine* machine, uint16_t address);
+
+/* Buffered I/O. Input is copied; 0 if there was no memory for it.
+The output stays until cleared, and the pointer until the next run */
+int lc3_machine_input(lc3_machine* machine, const void* data, size_t length);
+const char* lc3_machine_output(const lc3_machine* machine, size_t* length);
+void lc3_machine_output_clear(lc3_machine* machine);
+
+/* Callback I/O, instead of the buffers. get_char is only called
+after key_ready returned non-zero; flush may be NULL. NULL goes
+back to the buffers */
+typedef struct lc3_io {
+  int (*get_char)(void* context);
+  int (*key_ready)(void* context);
+  void (*put_char)(int c, void* context);
+  void (*flush)(void* context);
+  void* context;
+} lc3_io;
+
+void lc3_machine_set_io(lc3_machine* machine, const lc3_io* io);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
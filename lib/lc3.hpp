@@ -0,0 +1,88 @@
+#ifndef _LIBLC3_HPP
+#define _LIBLC3_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+#include <utility>
+
+#include "lc3.h"
+
+// C++ interface to liblc3: the same machine, owned by an object.
+// Failures are reported as in C, by return value; a machine that could
+// not be created tests false.
+namespace lc3 {
+
+// Words of guest memory in place
+template <typename Word>
+struct memory_view {
+  Word* words;
+  size_t length;
+
+  Word* begin() const { return words; }
+  Word* end() const { return words + length; }
+  size_t size() const { return length; }
+  Word& operator[](size_t i) const { return words[i]; }
+};
+
+class machine {
+public:
+  explicit machine(const char* engine = nullptr) : m(lc3_machine_create(engine)) {}
+  ~machine() { lc3_machine_destroy(m); }
+
+  machine(const machine&) = delete;
+  machine& operator=(const machine&) = delete;
+  machine(machine&& other) noexcept : m(std::exchange(other.m, nullptr)) {}
+  machine& operator=(machine&& other) noexcept {
+    std::swap(m, other.m);
+    return *this;
+  }
+
+  explicit operator bool() const { return m != nullptr; }
+  lc3_machine* handle() const { return m; }
+
+  bool set_engine(const char* engine) { return lc3_machine_set_engine(m, engine); }
+  const char* engine() const { return lc3_machine_engine(m); }
+
+  bool load(const void* image, size_t size) { return lc3_machine_load(m, image, size); }
+  bool load(uint16_t origin, const uint16_t* words, size_t count) {
+    return lc3_machine_load_words(m, origin, words, count);
+  }
+  const char* error() const { return lc3_machine_error(m); }
+  void reset() { lc3_machine_reset(m); }
+
+  lc3_event run(uint64_t count = LC3_RUN_FOREVER, uint64_t* executed = nullptr) {
+    return lc3_machine_run(m, count, executed);
+  }
+  lc3_event step() { return run(1); }
+
+  uint16_t reg(int r) const { return lc3_machine_register(m, r); }
+  void set_reg(int r, uint16_t value) { lc3_machine_set_register(m, r, value); }
+  uint16_t pc() const { return reg(LC3_PC); }
+
+  memory_view<const uint16_t> memory() const { return { lc3_machine_memory(m), LC3_MEMORY_WORDS }; }
+  memory_view<uint16_t> memory_write(uint16_t first, uint32_t count) {
+    uint32_t available = LC3_MEMORY_WORDS - first;
+    return { lc3_machine_memory_write(m, first, count), count < available ? count : available };
+  }
+
+  bool break_add(uint16_t address) { return lc3_machine_break_add(m, address); }
+  bool break_remove(uint16_t address) { return lc3_machine_break_remove(m, address); }
+
+  bool input(std::string_view data) { return lc3_machine_input(m, data.data(), data.size()); }
+  std::string_view output() const {
+    size_t length;
+    const char* data = lc3_machine_output(m, &length);
+    return { data, length };
+  }
+  void output_clear() { lc3_machine_output_clear(m); }
+  void set_io(const lc3_io* io) { lc3_machine_set_io(m, io); }
+
+private:
+  lc3_machine* m;
+};
+
+}
+
+#endif